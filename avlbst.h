@@ -5,7 +5,11 @@
 #include <exception>
 #include <cstdlib>
 #include <cstdint>
+#include <cmath>
 #include <algorithm>
+#include <future>
+#include <thread>
+#include <vector>
 #include "bst.h"
 
 struct KeyError { };
@@ -21,22 +25,29 @@ class AVLNode : public Node<Key, Value>
 public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    AVLNode(Key&& key, Value&& value, AVLNode<Key, Value>* parent);
+    ~AVLNode();
 
     // Getter/setter for the node's height.
     int8_t getBalance () const;
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
 
-    // Getters for parent, left, and right. These need to be redefined since they
-    // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
-    // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
+    // Getter/setter for the number of nodes in the subtree rooted here.
+    std::size_t getSize() const;
+    void setSize(std::size_t size);
+    void updateSize(std::ptrdiff_t diff);
+
+    // Getters for parent, left, and right. These hide the Node versions since they
+    // return pointers to AVLNodes - not plain Nodes. They are resolved statically,
+    // so they must be called through an AVLNode pointer to get the AVLNode type.
+    AVLNode<Key, Value>* getParent() const;
+    AVLNode<Key, Value>* getLeft() const;
+    AVLNode<Key, Value>* getRight() const;
 
 protected:
     int8_t balance_;    // effectively a signed char
+    std::size_t size_;  // nodes in this subtree, including this one
 };
 
 /*
@@ -50,7 +61,17 @@ protected:
 */
 template<class Key, class Value>
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
-    Node<Key, Value>(key, value, parent), balance_(0)
+    Node<Key, Value>(key, value, parent), balance_(0), size_(1)
+{
+
+}
+
+/**
+* The same, moving the key and value into the node.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>::AVLNode(Key&& key, Value&& value, AVLNode<Key, Value> *parent) :
+    Node<Key, Value>(std::move(key), std::move(value), parent), balance_(0), size_(1)
 {
 
 }
@@ -92,8 +113,35 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
 }
 
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
-* that our node is a AVLNode.
+* A getter for the subtree size of a AVLNode.
+*/
+template<class Key, class Value>
+std::size_t AVLNode<Key, Value>::getSize() const
+{
+    return size_;
+}
+
+/**
+* A setter for the subtree size of a AVLNode.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::setSize(std::size_t size)
+{
+    size_ = size;
+}
+
+/**
+* Adds diff to the subtree size of a AVLNode.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::updateSize(std::ptrdiff_t diff)
+{
+    size_ += diff;
+}
+
+/**
+* A getter for the parent that returns an AVLNode. The static_cast is safe because
+* an AVLTree only ever links AVLNodes together.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
@@ -102,7 +150,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
@@ -111,7 +159,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
@@ -127,14 +175,39 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+template <class Key, class Value, class Compare = std::less<Key> >
+class AVLTree : public BinarySearchTree<Key, Value, Compare>
 {
 public:
-    virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
+    AVLTree();
+    explicit AVLTree(const Compare& comp);
+    AVLTree(const AVLTree<Key, Value, Compare>& other);
+    AVLTree(AVLTree<Key, Value, Compare>&& other) noexcept;
+    AVLTree<Key, Value, Compare>& operator=(const AVLTree<Key, Value, Compare>& other);
+    AVLTree<Key, Value, Compare>& operator=(AVLTree<Key, Value, Compare>&& other) noexcept;
+    virtual ~AVLTree();
+    void copyFrom(const AVLTree<Key, Value, Compare>& other, unsigned threads = 1);
     virtual void remove(const Key& key);  // TODO
+    bool split(const Key& key, AVLTree<Key, Value, Compare>& less, AVLTree<Key, Value, Compare>& greater, Value* match = nullptr);
+    void join(AVLTree<Key, Value, Compare>& left, AVLTree<Key, Value, Compare>& right);
+    void unionWith(AVLTree<Key, Value, Compare>& other, unsigned threads = 0);
+    void intersectWith(AVLTree<Key, Value, Compare>& other, unsigned threads = 0);
+    void subtract(AVLTree<Key, Value, Compare>& other, unsigned threads = 0);
+
+    // Order statistics, all O(log n).
+    virtual std::size_t size() const override;
+    std::size_t rank(const Key& key) const;
+    typename BinarySearchTree<Key, Value, Compare>::iterator select(std::size_t k);
+    typename BinarySearchTree<Key, Value, Compare>::const_iterator select(std::size_t k) const;
+    std::size_t count_range(const Key& lo, const Key& hi) const;
 protected:
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    virtual Node<Key, Value>* createNode(Key&& key, Value&& value, Node<Key, Value>* parent) override;
+    virtual Node<Key, Value>* cloneNode(const Node<Key, Value>* nodePtr, Node<Key, Value>* parent, NodeArena& arena) const override;
+    virtual void linkNode(Node<Key, Value>* nodePtr, Node<Key, Value>* parent, bool left) override;
+    virtual void destroyNode(Node<Key, Value>* nodePtr) override;
+    virtual void refreshNode(Node<Key, Value>* nodePtr, int leftHeight, int rightHeight) override;
+    virtual const char* checkNode(const Node<Key, Value>* nodePtr, int leftHeight, int rightHeight, std::size_t leftCount, std::size_t rightCount) const override;
 
     // Add helper functions here
     void insertFix(AVLNode<Key,Value>* parent, AVLNode<Key,Value>* node);
@@ -145,78 +218,247 @@ protected:
     void rotateRight(AVLNode<Key,Value>* node);
     void rotateLeft(AVLNode<Key,Value>* node);
     void removeFix(AVLNode<Key,Value>* parent, int diff);
-    AVLNode<Key, Value>* getTaller(AVLNode<Key, Value>* left, AVLNode<Key, Value>* right);
+    static AVLNode<Key, Value>* getTaller(AVLNode<Key, Value>* node);
+    static std::size_t subtreeSize(AVLNode<Key, Value>* node);
+    AVLNode<Key, Value>* selectNode(std::size_t k) const;
+    static void updatePathSizes(AVLNode<Key, Value>* node, std::ptrdiff_t diff);
+
+    // split/join helpers
+    void unlinkNode(AVLNode<Key, Value>* toRemove);
+    static int subtreeHeight(AVLNode<Key, Value>* node);
+    AVLNode<Key, Value>* joinNodes(AVLNode<Key, Value>* left, int leftHeight, AVLNode<Key, Value>* mid, AVLNode<Key, Value>* right, int rightHeight, int& height);
+    void splitNode(AVLNode<Key, Value>* node, int height, const Key& key, AVLNode<Key, Value>*& less, int& lessHeight, AVLNode<Key, Value>*& greater, int& greaterHeight, AVLNode<Key, Value>*& match);
+
+    // set operation helpers
+    enum SetOp { SetUnion, SetIntersection, SetDifference };
+    void applySetOp(AVLTree<Key, Value, Compare>& other, SetOp op, unsigned threads);
+    AVLNode<Key, Value>* setOpNodes(SetOp op, AVLNode<Key, Value>* a, int aHeight, AVLNode<Key, Value>* b, int bHeight, int& height, std::vector<AVLNode<Key, Value>*>& discard, unsigned threads);
+    AVLNode<Key, Value>* joinPair(AVLNode<Key, Value>* left, int leftHeight, AVLNode<Key, Value>* right, int rightHeight, int& height);
+    AVLNode<Key, Value>* splitLast(AVLNode<Key, Value>* node, int height, int& restHeight, AVLNode<Key, Value>*& last);
 };
 
+/**
+* Default constructor; sizes the arena for AVLNodes.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree() :
+    BinarySearchTree<Key, Value, Compare>(sizeof(AVLNode<Key, Value>), alignof(AVLNode<Key, Value>))
+{
+
+}
+
+/**
+* Constructs an empty tree ordered by the given comparator.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(const Compare& comp) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(AVLNode<Key, Value>), alignof(AVLNode<Key, Value>), comp)
+{
+
+}
+
+/**
+* Copy constructor: an O(n) structural copy, balances included.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(const AVLTree<Key, Value, Compare>& other) :
+    BinarySearchTree<Key, Value, Compare>(sizeof(AVLNode<Key, Value>), alignof(AVLNode<Key, Value>), other.comp_)
+{
+    this -> cloneFrom(other, 1);
+}
+
+/**
+* Move constructor: takes other's nodes and arena in O(1) without
+* allocating, leaving it empty.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::AVLTree(AVLTree<Key, Value, Compare>&& other) noexcept :
+    BinarySearchTree<Key, Value, Compare>(std::move(other))
+{
+
+}
+
+/**
+* Copy assignment; this tree is unchanged if copying throws.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>& AVLTree<Key, Value, Compare>::operator=(const AVLTree<Key, Value, Compare>& other)
+{
+    if (this != &other)
+    {
+        AVLTree<Key, Value, Compare> copy(other);
+        this -> swapContents(copy);
+    }
+    return *this;
+}
+
+/**
+* Move assignment: frees this tree's nodes and takes other's nodes and
+* arena in their place, without allocating.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>& AVLTree<Key, Value, Compare>::operator=(AVLTree<Key, Value, Compare>&& other) noexcept
+{
+    BinarySearchTree<Key, Value, Compare>::operator=(std::move(other));
+    return *this;
+}
+
+/**
+* Destructor. Clears here rather than leaving it to ~BinarySearchTree so
+* that the nodes are destroyed as AVLNodes.
+*/
+template<class Key, class Value, class Compare>
+AVLTree<Key, Value, Compare>::~AVLTree()
+{
+    this -> clear();
+}
+
+/**
+* Replaces the contents of this tree with a node-for-node copy of other;
+* see BinarySearchTree::copyFrom.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::copyFrom(const AVLTree<Key, Value, Compare>& other, unsigned threads)
+{
+    BinarySearchTree<Key, Value, Compare>::copyFrom(other, threads);
+}
+
+/**
+* Builds an AVLNode in a slot taken from the tree's arena.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* AVLTree<Key, Value, Compare>::createNode(Key&& key, Value&& value, Node<Key, Value>* parent)
+{
+    NodeArena& arena = this -> nodeArena();
+    void* slot = arena.allocate();
+    try
+    {
+        return new (slot) AVLNode<Key, Value>(std::move(key), std::move(value), static_cast<AVLNode<Key, Value>*>(parent));
+    }
+    catch (...)
+    {
+        arena.deallocate(slot);
+        throw;
+    }
+}
+
+/**
+* Copies an AVLNode into a slot of arena, keeping its balance and size so
+* the copy needs no rebalancing.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* AVLTree<Key, Value, Compare>::cloneNode(const Node<Key, Value>* nodePtr, Node<Key, Value>* parent, NodeArena& arena) const
+{
+    const AVLNode<Key, Value>* source = static_cast<const AVLNode<Key, Value>*>(nodePtr);
+    void* slot = arena.allocate();
+    AVLNode<Key, Value>* node;
+    try
+    {
+        node = new (slot) AVLNode<Key, Value>(source -> getKey(), source -> getValue(), static_cast<AVLNode<Key, Value>*>(parent));
+    }
+    catch (...)
+    {
+        arena.deallocate(slot);
+        throw;
+    }
+    node -> setBalance(source -> getBalance());
+    node -> setSize(source -> getSize());
+    return node;
+}
+
+/**
+* Destroys an AVLNode and returns its slot to the arena for reuse.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* nodePtr)
+{
+    static_cast<AVLNode<Key, Value>*>(nodePtr) -> ~AVLNode();
+    this -> nodeArena().deallocate(nodePtr);
+}
+
+/**
+* Sets the balance and size of a node whose subtrees were just linked by
+* linkBalanced.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::refreshNode(Node<Key, Value>* nodePtr, int leftHeight, int rightHeight)
+{
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(nodePtr);
+    node -> setBalance(rightHeight - leftHeight);
+    node -> setSize(1 + subtreeSize(node -> getLeft()) + subtreeSize(node -> getRight()));
+}
+
+/**
+* validate()'s per-node AVL checks: the subtrees differ in height by at most
+* one, the stored balance and size agree with what the walk measured, and
+* the subtree is no taller than the AVL bound 1.4405 log2(n + 2) - 0.3277.
+*/
+template<class Key, class Value, class Compare>
+const char* AVLTree<Key, Value, Compare>::checkNode(const Node<Key, Value>* nodePtr, int leftHeight, int rightHeight, std::size_t leftCount, std::size_t rightCount) const
+{
+    const AVLNode<Key, Value>* node = static_cast<const AVLNode<Key, Value>*>(nodePtr);
+    int diff = rightHeight - leftHeight;
+    std::size_t count = 1 + leftCount + rightCount;
+    if (diff < -1 || diff > 1)
+    {
+        return "subtree heights differ by more than one";
+    }
+    if (node -> getBalance() != diff)
+    {
+        return "balance does not match subtree heights";
+    }
+    if (node -> getSize() != count)
+    {
+        return "size does not match subtree";
+    }
+    if (1 + std::max(leftHeight, rightHeight) > 1.4405 * std::log2(count + 2.0) - 0.3277)
+    {
+        return "subtree taller than the AVL height bound";
+    }
+    return nullptr;
+}
+
 /*
  * Recall: If key is already in the tree, you should 
  * overwrite the current value with the updated value.
+ * The lookup and overwrite happen in BinarySearchTree; by the time we get
+ * here the key is new and n just needs hanging and rebalancing.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::linkNode(Node<Key, Value>* nodePtr, Node<Key, Value>* parentPtr, bool left)
 { 
     //check if head
-    if (this -> root_ == nullptr)
+    AVLNode<Key, Value>* n = static_cast<AVLNode<Key, Value>*>(nodePtr);
+    AVLNode<Key, Value>* parent = static_cast<AVLNode<Key, Value>*>(parentPtr);
+    if (parent == nullptr)
     {
-
-        Node<Key, Value>* newRoot = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr); //be careful of dynamic data here!!! you may be allocating data that could cause leaks. 
-        this -> root_ = newRoot;
+        this -> root_ = n;
         return;
     }
 
-    //vars to find spot in tree
-    AVLNode<Key, Value>* finder = dynamic_cast<AVLNode<Key, Value>*>(this -> root_);
-
-    //find spot in tree
-    while (finder != nullptr)
+    if (left) //link in left direction
     {
-        if (new_item.first == finder->getKey()) //nodes are equal
+        parent -> setLeft(n);
+        updatePathSizes(parent, 1);
+        if (parent -> getBalance() == 1)
         {
-            finder -> setValue(new_item.second);
+            parent -> setBalance(0);
             return;
         }
-
-        else if (new_item.first < finder->getKey()) //move in left direction
-        {
-            if (finder -> getLeft() == nullptr)
-            {
-                AVLNode<Key, Value>* n = new AVLNode<Key, Value>(new_item.first, new_item.second, finder); //be careful of dynamic data here!!! you may be allocating data that could cause leaks. 
-                finder -> setLeft(n);
-                if (finder -> getBalance() == 1)
-                {
-                    finder -> setBalance(0);
-                    return;
-                }
-                else if (finder -> getBalance() == 0)
-                {
-                   finder -> updateBalance(-1);
-                   insertFix(finder, n); 
-                   return;
-                }
-            }
-            finder = finder -> getLeft();
-        }
-
-        else if(new_item.first > finder->getKey()) //move in right direction
+        parent -> updateBalance(-1);
+        insertFix(parent, n);
+    }
+    else //link in right direction
+    {
+        parent -> setRight(n);
+        updatePathSizes(parent, 1);
+        if (parent -> getBalance() == -1)
         {
-            if (finder -> getRight() == nullptr)
-            {
-                AVLNode<Key, Value>* n = new AVLNode<Key, Value>(new_item.first, new_item.second, finder); //be careful of dynamic data here!!! you may be allocating data that could cause leaks. 
-                finder -> setRight(n);
-                if (finder -> getBalance() == -1)
-                {
-                    finder -> setBalance(0);
-                    return;
-                }
-                else if (finder -> getBalance() == 0)
-                {
-                  finder -> updateBalance(1);
-                  insertFix(finder, n);
-                  return;
-                }
-            }
-            finder = finder -> getRight();
+            parent -> setBalance(0);
+            return;
         }
+        parent -> updateBalance(1);
+        insertFix(parent, n);
     }
 }
 
@@ -225,19 +467,28 @@ void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
  * should swap with the predecessor and then remove.
  */
 
-template<class Key, class Value>
-void AVLTree<Key, Value>:: remove(const Key& key)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>:: remove(const Key& key)
 {
-    AVLNode<Key, Value>* toRemove = dynamic_cast<AVLNode<Key, Value>*>(this -> internalFind(key)); //get node to remove
+    AVLNode<Key, Value>* toRemove = static_cast<AVLNode<Key, Value>*>(this -> internalFind(key)); //get node to remove
 
     if (toRemove == nullptr) //if not found, return
     {
       return;
     }
+    unlinkNode(toRemove);
+    this -> destroyNode(toRemove);
+}
 
+/**
+* Takes a node out of the tree and rebalances, without freeing it.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::unlinkNode(AVLNode<Key, Value>* toRemove)
+{
     if (toRemove -> getLeft() != nullptr && toRemove -> getRight() != nullptr) //2 child case
     {
-        AVLNode<Key, Value>* predecessor = dynamic_cast<AVLNode<Key, Value>*>(this -> predecessor(dynamic_cast<Node<Key, Value>*>(toRemove)));
+        AVLNode<Key, Value>* predecessor = static_cast<AVLNode<Key, Value>*>(this -> predecessor(toRemove));
         nodeSwap(toRemove, predecessor);
     }
 
@@ -261,20 +512,21 @@ void AVLTree<Key, Value>:: remove(const Key& key)
     {
         if (toRemove -> getLeft() == nullptr && toRemove -> getRight() == nullptr) //single root_ node
         {
-          delete toRemove;
           this -> root_ = nullptr;
         }
         else if (toRemove -> getBalance() == 1) //root_ node with right child
         {
             nodeSwap(toRemove, toRemove -> getRight());
             toRemove -> getParent() -> setRight(nullptr);
-            delete toRemove;
+            toRemove -> getParent() -> setBalance(0);
+            toRemove -> getParent() -> setSize(1);
         }
         else if (toRemove -> getBalance() == -1)//root_ node with left child
         {
           nodeSwap(toRemove, toRemove -> getLeft());
           toRemove -> getParent() -> setLeft(nullptr);
-          delete toRemove;
+          toRemove -> getParent() -> setBalance(0);
+          toRemove -> getParent() -> setSize(1);
         }
         return;
     }
@@ -289,7 +541,6 @@ void AVLTree<Key, Value>:: remove(const Key& key)
         {
             parent -> setRight(nullptr);
         }
-        delete toRemove;
     }
 
     else if (toRemove -> getLeft() == nullptr || toRemove -> getRight() == nullptr) //single child case
@@ -314,19 +565,22 @@ void AVLTree<Key, Value>:: remove(const Key& key)
             parent -> setRight(toRemove -> getRight());
             toRemove -> getRight() -> setParent(parent);
         }
-        delete toRemove;
     }
 
+    updatePathSizes(parent, -1);
     removeFix(parent, diff);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    BinarySearchTree<Key, Value, Compare>::nodeSwap(n1, n2);
     int8_t tempB = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(tempB);
+    std::size_t tempS = n1->getSize();
+    n1->setSize(n2->getSize());
+    n2->setSize(tempS);
 }
 
 
@@ -335,9 +589,10 @@ HELPER
 FUNCTIONS
 */
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insertFix(AVLNode<Key,Value>* parent, AVLNode<Key,Value>* child)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::insertFix(AVLNode<Key,Value>* parent, AVLNode<Key,Value>* child)
 { 
+    BST_STATS_DEPTH(StatInsertFixCalls);
     if (parent == nullptr || parent -> getParent() == nullptr) //base case
     {
         return;
@@ -442,31 +697,31 @@ void AVLTree<Key, Value>::insertFix(AVLNode<Key,Value>* parent, AVLNode<Key,Valu
     }
 }
 
-template<class Key, class Value>
-bool AVLTree<Key, Value>::ZigZigLeft(AVLNode<Key,Value>* child, AVLNode<Key,Value>* grandParent)
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::ZigZigLeft(AVLNode<Key,Value>* child, AVLNode<Key,Value>* grandParent)
 {
   return (grandParent -> getLeft() -> getLeft() == child);
 }
 
-template<class Key, class Value>
-bool AVLTree<Key, Value>::ZigZigRight(AVLNode<Key,Value>* child, AVLNode<Key,Value>* grandParent)
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::ZigZigRight(AVLNode<Key,Value>* child, AVLNode<Key,Value>* grandParent)
 {
   return (grandParent -> getRight() -> getRight() == child);
 }
-template<class Key, class Value>
-bool AVLTree<Key, Value>::ZigZagLeft(AVLNode<Key,Value>* child, AVLNode<Key,Value>* grandParent)
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::ZigZagLeft(AVLNode<Key,Value>* child, AVLNode<Key,Value>* grandParent)
 {
    return (grandParent -> getLeft() -> getRight() == child);
 }
 
-template<class Key, class Value>
-bool AVLTree<Key, Value>::ZigZagRight(AVLNode<Key,Value>* child, AVLNode<Key,Value>* grandParent)
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::ZigZagRight(AVLNode<Key,Value>* child, AVLNode<Key,Value>* grandParent)
 {
    return (grandParent -> getRight() -> getLeft() == child);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key,Value>* node)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rotateRight(AVLNode<Key,Value>* node)
 {
 
     AVLNode<Key,Value>* newParent = node -> getLeft();
@@ -475,10 +730,19 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key,Value>* node)
     {
         return;
     }
+    BST_STATS_ADD(StatRotateRight, 1);
+
+    //newParent takes over node's whole subtree; node keeps its right side plus newParent's right
+    std::size_t total = node -> getSize();
+    node -> setSize(total - newParent -> getSize() + subtreeSize(newParent -> getRight()));
+    newParent -> setSize(total);
 
-    if (node == this -> root_) //root case
+    if (node -> getParent() == nullptr) //root case (also roots of detached subtrees)
     {
-        this -> root_ = newParent; //root_ is now left child
+        if (node == this -> root_)
+        {
+            this -> root_ = newParent; //root_ is now left child
+        }
         newParent -> setParent(nullptr); // root parent has to be null
         node -> setLeft(newParent->getRight()); //node's left val is it's left child's right val(s)
         if (node -> getLeft() != nullptr)
@@ -511,8 +775,8 @@ void AVLTree<Key, Value>::rotateRight(AVLNode<Key,Value>* node)
     }
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key,Value>* node)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::rotateLeft(AVLNode<Key,Value>* node)
 {
   AVLNode<Key,Value>* newParent = node -> getRight();
 
@@ -520,10 +784,19 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key,Value>* node)
     {
         return;
     }
+    BST_STATS_ADD(StatRotateLeft, 1);
+
+    //newParent takes over node's whole subtree; node keeps its left side plus newParent's left
+    std::size_t total = node -> getSize();
+    node -> setSize(total - newParent -> getSize() + subtreeSize(newParent -> getLeft()));
+    newParent -> setSize(total);
 
-    if (node == this -> root_) //root case
+    if (node -> getParent() == nullptr) //root case (also roots of detached subtrees)
     {
-        this -> root_ = newParent; //root_ is now left child
+        if (node == this -> root_)
+        {
+            this -> root_ = newParent; //root_ is now left child
+        }
         newParent -> setParent(nullptr); // root parent has to be null
         node -> setRight(newParent->getLeft()); //node's left val is it's left child's right val(s)
         if (node -> getRight() != nullptr)
@@ -557,27 +830,21 @@ void AVLTree<Key, Value>::rotateLeft(AVLNode<Key,Value>* node)
     }
 }
 
-template <class Key, class Value>
-AVLNode<Key,Value>* AVLTree<Key, Value>::getTaller(AVLNode<Key,Value>* left, AVLNode<Key,Value>* right)
+/**
+* The taller child of a node that is out of balance after a removal, read
+* off its balance in O(1): removeFix only asks while the balance still
+* leans the way it is about to tip.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key,Value>* AVLTree<Key, Value, Compare>::getTaller(AVLNode<Key,Value>* node)
 {
-    if (left == nullptr)
-    {
-        return right;
-    }
-    if (right == nullptr)
-    {
-        return left;
-    }
-    if (this -> countSteps(dynamic_cast<Node<Key, Value>*>(left)) > this -> countSteps(dynamic_cast<Node<Key, Value>*>(right)))
-    {
-        return left;
-    }
-    return right;
+    return node -> getBalance() < 0 ? node -> getLeft() : node -> getRight();
 }
 
-template <class Key, class Value>
-void AVLTree<Key, Value>::removeFix(AVLNode<Key,Value>* n, int diff)
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::removeFix(AVLNode<Key,Value>* n, int diff)
 {
+    BST_STATS_DEPTH(StatRemoveFixCalls);
     if (n == nullptr) //base case
     {
         return;
@@ -585,7 +852,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key,Value>* n, int diff)
 
     //info for next recursive call
     AVLNode<Key,Value>* nextParent = n -> getParent();
-    int nextDiff;
+    int nextDiff = 0;
     if (nextParent != nullptr)
     {
         if (nextParent -> getLeft() == n)
@@ -603,7 +870,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key,Value>* n, int diff)
         if (n -> getBalance() + diff == -2) //new balance would be -2 (cause an inbalance)
         {
             //[Perform the check for the mirror case where b(n) + diff == +2, flipping left/right and -1/+1]
-            AVLNode<Key,Value>* c = getTaller(n -> getLeft(), n -> getRight());
+            AVLNode<Key,Value>* c = getTaller(n);
 
             if (c -> getBalance() == -1 ) //zig zig case
             {
@@ -664,7 +931,7 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key,Value>* n, int diff)
         if (n -> getBalance() + diff == 2) //new balance would be 2 (cause an inbalance)
         {
             //[Perform the check for the mirror case where b(n) + diff == -2, flipping left/right and -1/+1]
-            AVLNode<Key,Value>* c = getTaller(n -> getLeft(), n -> getRight());
+            AVLNode<Key,Value>* c = getTaller(n);
 
             if (c -> getBalance() == 1 ) //zig zig case
             {
@@ -719,4 +986,699 @@ void AVLTree<Key, Value>::removeFix(AVLNode<Key,Value>* n, int diff)
         }
     }
 }
+
+/**
+* The height of a subtree, found in O(log n) by following the taller child
+* at each level as recorded by the balances.
+*/
+template<class Key, class Value, class Compare>
+int AVLTree<Key, Value, Compare>::subtreeHeight(AVLNode<Key, Value>* node)
+{
+    int height = 0;
+    while (node != nullptr)
+    {
+        height++;
+        node = (node -> getBalance() == 1) ? node -> getRight() : node -> getLeft();
+    }
+    return height;
+}
+
+/**
+* Links the detached subtrees left and right (of the given heights) under the
+* detached single node mid, where every key in left < mid < every key in right,
+* and returns the root of the balanced result; height receives its height.
+*
+* When the heights are within one, mid simply becomes the root. Otherwise mid
+* is hung off the spine of the taller tree at the first node no more than one
+* level taller than the shorter tree, and the balances are retraced upward as
+* after an insert. This costs O(|leftHeight - rightHeight| + 1). root_ is
+* never touched, so disjoint subtrees can be joined concurrently.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::joinNodes(AVLNode<Key, Value>* left, int leftHeight, AVLNode<Key, Value>* mid, AVLNode<Key, Value>* right, int rightHeight, int& height)
+{
+    if (std::abs(leftHeight - rightHeight) <= 1)
+    {
+        mid -> setParent(nullptr);
+        mid -> setLeft(left);
+        mid -> setRight(right);
+        if (left != nullptr)
+        {
+            left -> setParent(mid);
+        }
+        if (right != nullptr)
+        {
+            right -> setParent(mid);
+        }
+        mid -> setBalance(rightHeight - leftHeight);
+        mid -> setSize(1 + subtreeSize(left) + subtreeSize(right));
+        height = std::max(leftHeight, rightHeight) + 1;
+        return mid;
+    }
+
+    bool grew = true;
+    if (leftHeight > rightHeight) //hang mid off the right spine of left
+    {
+        AVLNode<Key, Value>* c = left;
+        AVLNode<Key, Value>* p = nullptr;
+        int cHeight = leftHeight;
+        while (cHeight > rightHeight + 1)
+        {
+            p = c;
+            cHeight -= (c -> getBalance() == -1) ? 2 : 1;
+            c = c -> getRight();
+        }
+        mid -> setLeft(c);
+        if (c != nullptr)
+        {
+            c -> setParent(mid);
+        }
+        mid -> setRight(right);
+        if (right != nullptr)
+        {
+            right -> setParent(mid);
+        }
+        mid -> setBalance(rightHeight - cHeight);
+        mid -> setSize(1 + subtreeSize(c) + subtreeSize(right));
+        mid -> setParent(p);
+        p -> setRight(mid);
+        updatePathSizes(p, 1 + subtreeSize(right));
+
+        //the right subtree of n just grew by one
+        AVLNode<Key, Value>* child = mid;
+        AVLNode<Key, Value>* n = p;
+        while (n != nullptr)
+        {
+            n -> updateBalance(1);
+            if (n -> getBalance() == 0)
+            {
+                grew = false;
+                break;
+            }
+            if (n -> getBalance() == 1)
+            {
+                child = n;
+                n = n -> getParent();
+                continue;
+            }
+            if (child -> getBalance() == 1) //zig zig case
+            {
+                rotateLeft(n);
+                n -> setBalance(0);
+                child -> setBalance(0);
+                grew = false;
+                break;
+            }
+            else if (child -> getBalance() == 0) //zig zig case that still grows
+            {
+                rotateLeft(n);
+                n -> setBalance(1);
+                child -> setBalance(-1);
+                n = child -> getParent();
+            }
+            else // zig zag case
+            {
+                AVLNode<Key, Value>* g = child -> getLeft();
+                rotateRight(child);
+                rotateLeft(n);
+                n -> setBalance(g -> getBalance() == 1 ? -1 : 0);
+                child -> setBalance(g -> getBalance() == -1 ? 1 : 0);
+                g -> setBalance(0);
+                grew = false;
+                break;
+            }
+        }
+        height = leftHeight + (grew ? 1 : 0);
+    }
+    else //hang mid off the left spine of right
+    {
+        AVLNode<Key, Value>* c = right;
+        AVLNode<Key, Value>* p = nullptr;
+        int cHeight = rightHeight;
+        while (cHeight > leftHeight + 1)
+        {
+            p = c;
+            cHeight -= (c -> getBalance() == 1) ? 2 : 1;
+            c = c -> getLeft();
+        }
+        mid -> setRight(c);
+        if (c != nullptr)
+        {
+            c -> setParent(mid);
+        }
+        mid -> setLeft(left);
+        if (left != nullptr)
+        {
+            left -> setParent(mid);
+        }
+        mid -> setBalance(cHeight - leftHeight);
+        mid -> setSize(1 + subtreeSize(c) + subtreeSize(left));
+        mid -> setParent(p);
+        p -> setLeft(mid);
+        updatePathSizes(p, 1 + subtreeSize(left));
+
+        //the left subtree of n just grew by one
+        AVLNode<Key, Value>* child = mid;
+        AVLNode<Key, Value>* n = p;
+        while (n != nullptr)
+        {
+            n -> updateBalance(-1);
+            if (n -> getBalance() == 0)
+            {
+                grew = false;
+                break;
+            }
+            if (n -> getBalance() == -1)
+            {
+                child = n;
+                n = n -> getParent();
+                continue;
+            }
+            if (child -> getBalance() == -1) //zig zig case
+            {
+                rotateRight(n);
+                n -> setBalance(0);
+                child -> setBalance(0);
+                grew = false;
+                break;
+            }
+            else if (child -> getBalance() == 0) //zig zig case that still grows
+            {
+                rotateRight(n);
+                n -> setBalance(-1);
+                child -> setBalance(1);
+                n = child -> getParent();
+            }
+            else // zig zag case
+            {
+                AVLNode<Key, Value>* g = child -> getRight();
+                rotateLeft(child);
+                rotateRight(n);
+                n -> setBalance(g -> getBalance() == -1 ? 1 : 0);
+                child -> setBalance(g -> getBalance() == 1 ? -1 : 0);
+                g -> setBalance(0);
+                grew = false;
+                break;
+            }
+        }
+        height = rightHeight + (grew ? 1 : 0);
+    }
+    AVLNode<Key, Value>* top = mid;
+    while (top -> getParent() != nullptr)
+    {
+        top = top -> getParent();
+    }
+    return top;
+}
+
+/**
+* Splits the detached subtree at node (of the given height) into the
+* subtrees of keys below and above key, rejoining the pieces cut off along
+* the search path with joinNodes. The node holding key itself, if any, is
+* returned detached in match. The joins telescope, so this is O(log n).
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::splitNode(AVLNode<Key, Value>* node, int height, const Key& key, AVLNode<Key, Value>*& less, int& lessHeight, AVLNode<Key, Value>*& greater, int& greaterHeight, AVLNode<Key, Value>*& match)
+{
+    if (node == nullptr)
+    {
+        less = greater = nullptr;
+        lessHeight = greaterHeight = 0;
+        return;
+    }
+    AVLNode<Key, Value>* left = node -> getLeft();
+    AVLNode<Key, Value>* right = node -> getRight();
+    int leftHeight = height - (node -> getBalance() == 1 ? 2 : 1);
+    int rightHeight = height - (node -> getBalance() == -1 ? 2 : 1);
+    if (left != nullptr)
+    {
+        left -> setParent(nullptr);
+    }
+    if (right != nullptr)
+    {
+        right -> setParent(nullptr);
+    }
+    node -> setParent(nullptr);
+    node -> setLeft(nullptr);
+    node -> setRight(nullptr);
+    node -> setBalance(0);
+
+    if (this -> comp_(key, node -> getKey()))
+    {
+        AVLNode<Key, Value>* rest;
+        int restHeight;
+        splitNode(left, leftHeight, key, less, lessHeight, rest, restHeight, match);
+        greater = joinNodes(rest, restHeight, node, right, rightHeight, greaterHeight);
+    }
+    else if (this -> comp_(node -> getKey(), key))
+    {
+        AVLNode<Key, Value>* rest;
+        int restHeight;
+        splitNode(right, rightHeight, key, rest, restHeight, greater, greaterHeight, match);
+        less = joinNodes(left, leftHeight, node, rest, restHeight, lessHeight);
+    }
+    else
+    {
+        less = left;
+        lessHeight = leftHeight;
+        greater = right;
+        greaterHeight = rightHeight;
+        match = node;
+    }
+}
+
+/**
+* Moves the entries with keys below key into less and those above it into
+* greater, in O(log n), leaving this tree empty. Returns true if key itself
+* was present; its value is then moved into *match (when match is not NULL)
+* and its node freed. less and greater are cleared first and must be two
+* different trees, though either may be this one. All three trees share one
+* node arena afterwards, so they must not be modified concurrently, even
+* from different threads that each own one of them. To hand less and
+* greater to different threads, copyFrom() one of them into a tree with an
+* arena of its own first.
+*/
+template<class Key, class Value, class Compare>
+bool AVLTree<Key, Value, Compare>::split(const Key& key, AVLTree<Key, Value, Compare>& less, AVLTree<Key, Value, Compare>& greater, Value* match)
+{
+    AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    int height = subtreeHeight(root);
+    this -> nodeArena();
+    std::shared_ptr<NodeArena> arena = this -> arena_;
+    this -> root_ = nullptr;
+    if (&less != this)
+    {
+        less.clear();
+    }
+    if (&greater != this)
+    {
+        greater.clear();
+    }
+
+    AVLNode<Key, Value>* lessRoot;
+    AVLNode<Key, Value>* greaterRoot;
+    AVLNode<Key, Value>* found = nullptr;
+    int lessHeight, greaterHeight;
+    splitNode(root, height, key, lessRoot, lessHeight, greaterRoot, greaterHeight, found);
+
+    less.root_ = lessRoot;
+    less.arena_ = arena;
+    greater.root_ = greaterRoot;
+    greater.arena_ = arena;
+    if (found == nullptr)
+    {
+        return false;
+    }
+    if (match != nullptr)
+    {
+        *match = std::move(found -> getValue());
+    }
+    less.destroyNode(found);
+    return true;
+}
+
+/**
+* Replaces the contents of this tree with every entry of left followed by
+* every entry of right, in O(log n), leaving both of them empty. Every key
+* in left must be below every key in right; otherwise join throws
+* std::invalid_argument and changes nothing. this may be left or right. The
+* two arenas are merged so the result owns all the nodes; left and right,
+* where they are not this, let go of the merged arena and get a fresh one
+* on their next insert. Any other tree still sharing either arena (from an
+* earlier split) must not be modified concurrently with this one.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::join(AVLTree<Key, Value, Compare>& left, AVLTree<Key, Value, Compare>& right)
+{
+    //two O(log n) walks: the largest key of left against the smallest of right
+    if (left.root_ != nullptr && right.root_ != nullptr &&
+        !this -> comp_(left.getLargestNode() -> getKey(), right.getSmallestNode() -> getKey()))
+    {
+        throw std::invalid_argument("join: keys of left are not all below keys of right");
+    }
+    //the smallest entry of right becomes the pivot
+    AVLNode<Key, Value>* mid = nullptr;
+    if (right.root_ != nullptr)
+    {
+        mid = static_cast<AVLNode<Key, Value>*>(right.getSmallestNode());
+        right.unlinkNode(mid);
+    }
+    AVLNode<Key, Value>* leftRoot = static_cast<AVLNode<Key, Value>*>(left.root_);
+    AVLNode<Key, Value>* rightRoot = static_cast<AVLNode<Key, Value>*>(right.root_);
+    left.root_ = nullptr;
+    right.root_ = nullptr;
+
+    left.nodeArena();
+    right.nodeArena();
+    std::shared_ptr<NodeArena> arena = left.arena_;
+    std::shared_ptr<NodeArena> other = right.arena_;
+    NodeArena::merge(arena, other);
+    if (this != &left && this != &right)
+    {
+        this -> clear();
+    }
+    this -> arena_ = arena;
+    if (&left != this)
+    {
+        left.arena_.reset();
+    }
+    if (&right != this)
+    {
+        right.arena_.reset();
+    }
+
+    if (mid == nullptr)
+    {
+        this -> root_ = leftRoot;
+        return;
+    }
+    mid -> setParent(nullptr);
+    mid -> setLeft(nullptr);
+    mid -> setRight(nullptr);
+    mid -> setBalance(0);
+    int height;
+    this -> root_ = joinNodes(leftRoot, subtreeHeight(leftRoot), mid, rightRoot, subtreeHeight(rightRoot), height);
+}
+
+/**
+* Joins left and right, where every key in left is below every key in
+* right, by borrowing the largest entry of left as the pivot.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::joinPair(AVLNode<Key, Value>* left, int leftHeight, AVLNode<Key, Value>* right, int rightHeight, int& height)
+{
+    if (left == nullptr)
+    {
+        height = rightHeight;
+        return right;
+    }
+    if (right == nullptr)
+    {
+        height = leftHeight;
+        return left;
+    }
+    AVLNode<Key, Value>* last;
+    int restHeight;
+    AVLNode<Key, Value>* rest = splitLast(left, leftHeight, restHeight, last);
+    return joinNodes(rest, restHeight, last, right, rightHeight, height);
+}
+
+/**
+* Detaches the largest node of the detached subtree at node into last and
+* returns the balanced remainder, whose height goes in restHeight.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::splitLast(AVLNode<Key, Value>* node, int height, int& restHeight, AVLNode<Key, Value>*& last)
+{
+    AVLNode<Key, Value>* left = node -> getLeft();
+    AVLNode<Key, Value>* right = node -> getRight();
+    int leftHeight = height - (node -> getBalance() == 1 ? 2 : 1);
+    int rightHeight = height - (node -> getBalance() == -1 ? 2 : 1);
+    if (left != nullptr)
+    {
+        left -> setParent(nullptr);
+    }
+    node -> setParent(nullptr);
+    node -> setLeft(nullptr);
+    node -> setRight(nullptr);
+    node -> setBalance(0);
+    if (right == nullptr)
+    {
+        last = node;
+        restHeight = leftHeight;
+        return left;
+    }
+    right -> setParent(nullptr);
+    int restRightHeight;
+    AVLNode<Key, Value>* restRight = splitLast(right, rightHeight, restRightHeight, last);
+    return joinNodes(left, leftHeight, node, restRight, restRightHeight, restHeight);
+}
+
+/**
+* Combines the detached subtrees a and b by splitting a around the root of b
+* and recursing on the two halves, which are independent and so run on a
+* separate thread while more than one thread is left in the budget. Nodes
+* that drop out of the result are appended to discard rather than freed,
+* because the arena is not thread-safe. When a key is in both trees the node
+* from b is kept. This does O(m log(n/m + 1)) work for trees of sizes m <= n.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::setOpNodes(SetOp op, AVLNode<Key, Value>* a, int aHeight, AVLNode<Key, Value>* b, int bHeight, int& height, std::vector<AVLNode<Key, Value>*>& discard, unsigned threads)
+{
+    if (a == nullptr || b == nullptr)
+    {
+        AVLNode<Key, Value>* kept = (op == SetUnion) ? (a == nullptr ? b : a) : (op == SetDifference ? a : nullptr);
+        AVLNode<Key, Value>* dropped = (a == nullptr) ? b : a;
+        if (dropped != nullptr && dropped != kept)
+        {
+            discard.push_back(dropped);
+        }
+        height = (kept == nullptr) ? 0 : (kept == a ? aHeight : bHeight);
+        return kept;
+    }
+
+    AVLNode<Key, Value>* bLeft = b -> getLeft();
+    AVLNode<Key, Value>* bRight = b -> getRight();
+    int bLeftHeight = bHeight - (b -> getBalance() == 1 ? 2 : 1);
+    int bRightHeight = bHeight - (b -> getBalance() == -1 ? 2 : 1);
+    if (bLeft != nullptr)
+    {
+        bLeft -> setParent(nullptr);
+    }
+    if (bRight != nullptr)
+    {
+        bRight -> setParent(nullptr);
+    }
+    b -> setLeft(nullptr);
+    b -> setRight(nullptr);
+    b -> setBalance(0);
+
+    AVLNode<Key, Value>* aLess;
+    AVLNode<Key, Value>* aGreater;
+    AVLNode<Key, Value>* match = nullptr;
+    int aLessHeight, aGreaterHeight;
+    splitNode(a, aHeight, b -> getKey(), aLess, aLessHeight, aGreater, aGreaterHeight, match);
+    if (match != nullptr)
+    {
+        discard.push_back(match);
+    }
+
+    AVLNode<Key, Value>* left;
+    AVLNode<Key, Value>* right;
+    int leftHeight, rightHeight;
+    // only fork when both sides have enough work to pay for a thread
+    if (threads > 1 && std::min(aHeight, bHeight) > 10)
+    {
+        std::vector<AVLNode<Key, Value>*> leftDiscard;
+        unsigned leftThreads = threads / 2;
+        std::future<AVLNode<Key, Value>*> pending = std::async(std::launch::async, [&]() {
+            return setOpNodes(op, aLess, aLessHeight, bLeft, bLeftHeight, leftHeight, leftDiscard, leftThreads);
+        });
+        right = setOpNodes(op, aGreater, aGreaterHeight, bRight, bRightHeight, rightHeight, discard, threads - leftThreads);
+        left = pending.get();
+        discard.insert(discard.end(), leftDiscard.begin(), leftDiscard.end());
+    }
+    else
+    {
+        left = setOpNodes(op, aLess, aLessHeight, bLeft, bLeftHeight, leftHeight, discard, 1);
+        right = setOpNodes(op, aGreater, aGreaterHeight, bRight, bRightHeight, rightHeight, discard, 1);
+    }
+
+    if (op == SetUnion || (op == SetIntersection && match != nullptr))
+    {
+        return joinNodes(left, leftHeight, b, right, rightHeight, height);
+    }
+    discard.push_back(b);
+    return joinPair(left, leftHeight, right, rightHeight, height);
+}
+
+/**
+* Runs a set operation with this tree as the first operand and other as the
+* second, leaving the result here and other empty. Nodes are relinked, not
+* copied, so the arenas of the two trees are merged first; the nodes that
+* drop out are freed afterwards on the calling thread. other lets go of the
+* merged arena and gets a fresh one on its next insert.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::applySetOp(AVLTree<Key, Value, Compare>& other, SetOp op, unsigned threads)
+{
+    if (&other == this)
+    {
+        if (op == SetDifference)
+        {
+            this -> clear();
+        }
+        return;
+    }
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    AVLNode<Key, Value>* a = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    AVLNode<Key, Value>* b = static_cast<AVLNode<Key, Value>*>(other.root_);
+    this -> root_ = nullptr;
+    other.root_ = nullptr;
+
+    this -> nodeArena();
+    other.nodeArena();
+    std::shared_ptr<NodeArena> arena = this -> arena_;
+    std::shared_ptr<NodeArena> otherArena = other.arena_;
+    NodeArena::merge(arena, otherArena);
+    this -> arena_ = arena;
+    other.arena_.reset();
+
+    std::vector<AVLNode<Key, Value>*> discard;
+    int height;
+    this -> root_ = setOpNodes(op, a, subtreeHeight(a), b, subtreeHeight(b), height, discard, threads);
+    for (size_t i = 0; i < discard.size(); i++)
+    {
+        this -> destroySubtree(discard[i]);
+    }
+}
+
+/**
+* Adds every entry of other to this tree, taking other's value where a key
+* is in both (last writer wins), and leaves other empty. Up to threads
+* threads are used; 0 means one per core.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::unionWith(AVLTree<Key, Value, Compare>& other, unsigned threads)
+{
+    applySetOp(other, SetUnion, threads);
+}
+
+/**
+* Keeps only the keys that are also in other, with other's values, and
+* leaves other empty. Up to threads threads are used; 0 means one per core.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::intersectWith(AVLTree<Key, Value, Compare>& other, unsigned threads)
+{
+    applySetOp(other, SetIntersection, threads);
+}
+
+/**
+* Removes every key that is in other, and leaves other empty. Up to threads
+* threads are used; 0 means one per core.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::subtract(AVLTree<Key, Value, Compare>& other, unsigned threads)
+{
+    applySetOp(other, SetDifference, threads);
+}
+
+/**
+* The number of nodes under node, or 0 for NULL.
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::subtreeSize(AVLNode<Key, Value>* node)
+{
+    return node == nullptr ? 0 : node -> getSize();
+}
+
+/**
+* Adds diff to the size of node and of every ancestor up to the root.
+*/
+template<class Key, class Value, class Compare>
+void AVLTree<Key, Value, Compare>::updatePathSizes(AVLNode<Key, Value>* node, std::ptrdiff_t diff)
+{
+    while (node != nullptr)
+    {
+        node -> updateSize(diff);
+        node = node -> getParent();
+    }
+}
+
+/**
+* Returns the number of entries in O(1), read off the root's subtree size.
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::size() const
+{
+    return subtreeSize(static_cast<AVLNode<Key, Value>*>(this -> root_));
+}
+
+/**
+* Returns the number of keys less than key, whether or not key is present.
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::rank(const Key& key) const
+{
+    std::size_t below = 0;
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    BST_STATS_ADD(StatDescents, 1);
+    while (node != nullptr)
+    {
+        BST_STATS_ADD(StatNodesVisited, 1);
+        if (this -> comp_(node -> getKey(), key))
+        {
+            below += subtreeSize(node -> getLeft()) + 1;
+            node = node -> getRight();
+        }
+        else
+        {
+            node = node -> getLeft();
+        }
+    }
+    return below;
+}
+
+/**
+* Returns an iterator to the entry with exactly k smaller keys (the k-th
+* smallest, counting from 0), or end() if k >= size().
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator AVLTree<Key, Value, Compare>::select(std::size_t k)
+{
+    return this -> iteratorAt(selectNode(k));
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator AVLTree<Key, Value, Compare>::select(std::size_t k) const
+{
+    return this -> iteratorAt(selectNode(k));
+}
+
+/**
+* The node select() returns an iterator to, or NULL.
+*/
+template<class Key, class Value, class Compare>
+AVLNode<Key, Value>* AVLTree<Key, Value, Compare>::selectNode(std::size_t k) const
+{
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this -> root_);
+    while (node != nullptr)
+    {
+        std::size_t leftSize = subtreeSize(node -> getLeft());
+        if (k < leftSize)
+        {
+            node = node -> getLeft();
+        }
+        else if (k == leftSize)
+        {
+            break;
+        }
+        else
+        {
+            k -= leftSize + 1;
+            node = node -> getRight();
+        }
+    }
+    return node;
+}
+
+/**
+* Returns the number of keys in the half-open range [lo, hi).
+*/
+template<class Key, class Value, class Compare>
+std::size_t AVLTree<Key, Value, Compare>::count_range(const Key& lo, const Key& hi) const
+{
+    if (!this -> comp_(lo, hi))
+    {
+        return 0;
+    }
+    return rank(hi) - rank(lo);
+}
 #endif
@@ -0,0 +1,970 @@
+#ifndef BPLUSTREE_H
+#define BPLUSTREE_H
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+/**
+* A templated B+tree with the same insert/remove/find/operator[]/iterator
+* and lower_bound/upper_bound/floor/ceiling/range surface as
+* BinarySearchTree, so code can switch engines with a typedef. Keys are
+* ordered by Compare, a strict weak ordering as for std::map.
+*
+* Entries live only in the leaves, which are linked left to right so that
+* iteration and range scans move through whole arrays of entries instead of
+* chasing one pointer per key. Internal nodes hold separator keys: child i
+* contains the keys k with keys[i-1] <= k < keys[i].
+*
+* Fanout is the maximum number of children of an internal node and the
+* maximum number of entries in a leaf; pick it so a node spans a few cache
+* lines (or a page, for very large trees). Keys must be default
+* constructible and copy assignable since internal nodes store them in
+* plain arrays.
+*/
+template <typename Key, typename Value, std::size_t Fanout = 16, typename Compare = std::less<Key> >
+class BPlusTree
+{
+    static_assert(Fanout >= 4, "BPlusTree needs a fanout of at least 4");
+
+    struct NodeBase;
+    struct Leaf;
+    struct Internal;
+
+public:
+    BPlusTree();
+    explicit BPlusTree(const Compare& comp);
+    ~BPlusTree();
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    std::size_t size() const;
+    Compare key_comp() const;
+
+    /**
+    * An iterator over the entries in key order; it walks each leaf's array
+    * and then follows the leaf links.
+    */
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class BPlusTree<Key, Value, Fanout, Compare>;
+        iterator(Leaf* leaf, std::size_t index);
+        Leaf* leaf_;
+        std::size_t index_;
+    };
+
+    /**
+    * A pair of iterators that can be walked with a range-for loop.
+    */
+    class iterator_range
+    {
+    public:
+        iterator_range(iterator first, iterator last);
+
+        iterator begin() const;
+        iterator end() const;
+
+    private:
+        iterator first_;
+        iterator last_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key) const;
+    iterator floor(const Key& key) const;
+    iterator ceiling(const Key& key) const;
+    iterator_range range(const Key& lo, const Key& hi) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+private:
+    // Not copyable: the tree owns its nodes.
+    BPlusTree(const BPlusTree&);
+    BPlusTree& operator=(const BPlusTree&);
+
+    typedef std::pair<const Key, Value> Item;
+
+    struct NodeBase
+    {
+        explicit NodeBase(bool isLeaf) : leaf(isLeaf), count(0) {}
+        bool leaf;
+        std::size_t count;    // entries in a leaf, separator keys in an internal node
+    };
+
+    struct Leaf : NodeBase
+    {
+        Leaf() : NodeBase(true), next(nullptr) {}
+        Item* item(std::size_t i) { return reinterpret_cast<Item*>(&slots[i]); }
+        const Item* item(std::size_t i) const { return reinterpret_cast<const Item*>(&slots[i]); }
+
+        Leaf* next;
+        typename std::aligned_storage<sizeof(Item), alignof(Item)>::type slots[Fanout];
+    };
+
+    struct Internal : NodeBase
+    {
+        Internal() : NodeBase(false) {}
+
+        // one spare key/child so a node can overflow briefly before it splits
+        Key keys[Fanout];
+        NodeBase* children[Fanout + 1];
+    };
+
+    static const std::size_t minLeaf = Fanout / 2;
+    static const std::size_t minKeys = (Fanout + 1) / 2 - 1;
+
+    std::size_t leafLowerBound(const Leaf* leaf, const Key& key) const;
+    std::size_t leafUpperBound(const Leaf* leaf, const Key& key) const;
+    std::size_t childIndex(const Internal* node, const Key& key) const;
+    static void moveItem(Leaf* from, std::size_t i, Leaf* to, std::size_t j);
+    Leaf* findLeaf(const Key& key) const;
+    static iterator entryAt(Leaf* leaf, std::size_t index);
+
+    bool insertInto(NodeBase* node, const Item& keyValuePair, Key& upKey, NodeBase*& upNode);
+    bool removeFrom(NodeBase* node, const Key& key);
+    void fixChild(Internal* parent, std::size_t i);
+    void destroy(NodeBase* node);
+
+    NodeBase* root_;
+    std::size_t size_;
+    Compare comp_;
+};
+
+/*
+--------------------------------------------------------
+Begin implementations for the BPlusTree::iterator class.
+--------------------------------------------------------
+*/
+
+/**
+* Explicit constructor that points the iterator at an entry of a leaf.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+BPlusTree<Key, Value, Fanout, Compare>::iterator::iterator(Leaf* leaf, std::size_t index) :
+    leaf_(leaf), index_(index)
+{
+
+}
+
+/**
+* A default constructor that initializes the iterator to end().
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+BPlusTree<Key, Value, Fanout, Compare>::iterator::iterator() :
+    leaf_(nullptr), index_(0)
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+std::pair<const Key,Value>& BPlusTree<Key, Value, Fanout, Compare>::iterator::operator*() const
+{
+    return *leaf_->item(index_);
+}
+
+/**
+* Provides access to the address of the item.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+std::pair<const Key,Value>* BPlusTree<Key, Value, Fanout, Compare>::iterator::operator->() const
+{
+    return leaf_->item(index_);
+}
+
+/**
+* Checks if 'this' iterator points at the same entry as 'rhs'
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+bool BPlusTree<Key, Value, Fanout, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+/**
+* Checks if 'this' iterator points at a different entry than 'rhs'
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+bool BPlusTree<Key, Value, Fanout, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Advances to the next entry, moving to the next leaf at the end of this one.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::iterator& BPlusTree<Key, Value, Fanout, Compare>::iterator::operator++()
+{
+    if (++index_ == leaf_->count)
+    {
+        leaf_ = leaf_->next;
+        index_ = 0;
+    }
+    return *this;
+}
+
+/**
+* Constructs the range [first, last).
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+BPlusTree<Key, Value, Fanout, Compare>::iterator_range::iterator_range(iterator first, iterator last) :
+    first_(first), last_(last)
+{
+
+}
+
+/**
+* Returns the first iterator of the range.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::iterator BPlusTree<Key, Value, Fanout, Compare>::iterator_range::begin() const
+{
+    return first_;
+}
+
+/**
+* Returns the past-the-end iterator of the range.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::iterator BPlusTree<Key, Value, Fanout, Compare>::iterator_range::end() const
+{
+    return last_;
+}
+
+/*
+------------------------------------------------------
+End implementations for the BPlusTree::iterator class.
+------------------------------------------------------
+*/
+
+/*
+-----------------------------------------------
+Begin implementations for the BPlusTree class.
+-----------------------------------------------
+*/
+
+/**
+* Default constructor for an empty tree.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+BPlusTree<Key, Value, Fanout, Compare>::BPlusTree() :
+    root_(nullptr), size_(0), comp_()
+{
+
+}
+
+/**
+* Constructor for an empty tree ordered by comp.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+BPlusTree<Key, Value, Fanout, Compare>::BPlusTree(const Compare& comp) :
+    root_(nullptr), size_(0), comp_(comp)
+{
+
+}
+
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+BPlusTree<Key, Value, Fanout, Compare>::~BPlusTree()
+{
+    clear();
+}
+
+/**
+* Removes every entry and frees every node.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+void BPlusTree<Key, Value, Fanout, Compare>::clear()
+{
+    if (root_ != nullptr)
+    {
+        destroy(root_);
+    }
+    root_ = nullptr;
+    size_ = 0;
+}
+
+/**
+* Returns true if tree is empty
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+bool BPlusTree<Key, Value, Fanout, Compare>::empty() const
+{
+    return root_ == nullptr;
+}
+
+/**
+* The number of entries in the tree.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+std::size_t BPlusTree<Key, Value, Fanout, Compare>::size() const
+{
+    return size_;
+}
+
+/**
+* Returns a copy of the comparator that orders the keys.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+Compare BPlusTree<Key, Value, Fanout, Compare>::key_comp() const
+{
+    return comp_;
+}
+
+/**
+* Returns an iterator to the smallest entry (the front of the leftmost leaf).
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::iterator BPlusTree<Key, Value, Fanout, Compare>::begin() const
+{
+    if (root_ == nullptr)
+    {
+        return end();
+    }
+    NodeBase* node = root_;
+    while (!node->leaf)
+    {
+        node = static_cast<Internal*>(node)->children[0];
+    }
+    return iterator(static_cast<Leaf*>(node), 0);
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::iterator BPlusTree<Key, Value, Fanout, Compare>::end() const
+{
+    return iterator();
+}
+
+/**
+* Returns an iterator to the item with the given key, or end().
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::iterator BPlusTree<Key, Value, Fanout, Compare>::find(const Key& key) const
+{
+    Leaf* leaf = findLeaf(key);
+    if (leaf == nullptr)
+    {
+        return end();
+    }
+    std::size_t i = leafLowerBound(leaf, key);
+    if (i == leaf->count || comp_(key, leaf->item(i)->first))
+    {
+        return end();
+    }
+    return iterator(leaf, i);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or end() if there is none. Only the leaf whose range holds key is
+* searched; if every entry there is smaller, the answer is the front of the
+* next leaf.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::iterator BPlusTree<Key, Value, Fanout, Compare>::lower_bound(const Key& key) const
+{
+    Leaf* leaf = findLeaf(key);
+    if (leaf == nullptr)
+    {
+        return end();
+    }
+    return entryAt(leaf, leafLowerBound(leaf, key));
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key,
+* or end() if there is none.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::iterator BPlusTree<Key, Value, Fanout, Compare>::upper_bound(const Key& key) const
+{
+    Leaf* leaf = findLeaf(key);
+    if (leaf == nullptr)
+    {
+        return end();
+    }
+    return entryAt(leaf, leafUpperBound(leaf, key));
+}
+
+/**
+* Returns the items whose key equals key as [lower_bound, upper_bound);
+* the range holds one item or none.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+std::pair<typename BPlusTree<Key, Value, Fanout, Compare>::iterator, typename BPlusTree<Key, Value, Fanout, Compare>::iterator>
+BPlusTree<Key, Value, Fanout, Compare>::equal_range(const Key& key) const
+{
+    iterator first = lower_bound(key);
+    iterator last = first;
+    if (first != end() && !comp_(key, first->first))
+    {
+        ++last;
+    }
+    return std::make_pair(first, last);
+}
+
+/**
+* Returns an iterator to the item with the greatest key not greater than
+* key, or end() if every key is greater. Leaves are only linked forwards,
+* so the descent remembers the last subtree it passed on its left; when
+* the leaf holds nothing small enough (its separator can be stale after a
+* removal), the answer is the last entry of that subtree.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::iterator BPlusTree<Key, Value, Fanout, Compare>::floor(const Key& key) const
+{
+    NodeBase* node = root_;
+    NodeBase* before = nullptr;
+    if (node == nullptr)
+    {
+        return end();
+    }
+    while (!node->leaf)
+    {
+        Internal* internal = static_cast<Internal*>(node);
+        std::size_t i = childIndex(internal, key);
+        if (i > 0)
+        {
+            before = internal->children[i - 1];
+        }
+        node = internal->children[i];
+    }
+    Leaf* leaf = static_cast<Leaf*>(node);
+    std::size_t i = leafUpperBound(leaf, key);
+    if (i > 0)
+    {
+        return iterator(leaf, i - 1);
+    }
+    if (before == nullptr)
+    {
+        return end();
+    }
+    while (!before->leaf)
+    {
+        Internal* internal = static_cast<Internal*>(before);
+        before = internal->children[internal->count];
+    }
+    return iterator(static_cast<Leaf*>(before), before->count - 1);
+}
+
+/**
+* Returns an iterator to the item with the smallest key not less than key,
+* or end() if every key is less. The same as lower_bound.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::iterator BPlusTree<Key, Value, Fanout, Compare>::ceiling(const Key& key) const
+{
+    return lower_bound(key);
+}
+
+/**
+* Returns the items with keys in [lo, hi) for use in a range-for loop.
+* Finding the start costs one descent; the scan then runs along the leaf
+* links.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::iterator_range BPlusTree<Key, Value, Fanout, Compare>::range(const Key& lo, const Key& hi) const
+{
+    if (!comp_(lo, hi))
+    {
+        return iterator_range(end(), end());
+    }
+    return iterator_range(lower_bound(lo), lower_bound(hi));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+Value& BPlusTree<Key, Value, Fanout, Compare>::operator[](const Key& key)
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+Value const & BPlusTree<Key, Value, Fanout, Compare>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* Inserts a pair, overwriting the value if the key is already present.
+* A split at the root grows the tree by one level.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+void BPlusTree<Key, Value, Fanout, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    if (root_ == nullptr)
+    {
+        Leaf* leaf = new Leaf;
+        new (leaf->item(0)) Item(keyValuePair);
+        leaf->count = 1;
+        root_ = leaf;
+        size_ = 1;
+        return;
+    }
+    Key upKey;
+    NodeBase* upNode = nullptr;
+    if (insertInto(root_, keyValuePair, upKey, upNode))
+    {
+        Internal* newRoot = new Internal;
+        newRoot->keys[0] = upKey;
+        newRoot->children[0] = root_;
+        newRoot->children[1] = upNode;
+        newRoot->count = 1;
+        root_ = newRoot;
+    }
+}
+
+/**
+* Removes the entry with the given key, if any. Underfull nodes borrow from
+* or merge with a sibling on the way back up, and an internal root left with
+* a single child is replaced by that child.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+void BPlusTree<Key, Value, Fanout, Compare>::remove(const Key& key)
+{
+    if (root_ == nullptr)
+    {
+        return;
+    }
+    removeFrom(root_, key);
+    if (root_->count == 0)
+    {
+        NodeBase* old = root_;
+        root_ = old->leaf ? nullptr : static_cast<Internal*>(old)->children[0];
+        if (old->leaf)
+        {
+            delete static_cast<Leaf*>(old);
+        }
+        else
+        {
+            delete static_cast<Internal*>(old);
+        }
+    }
+}
+
+/**
+* Index of the first entry in the leaf whose key is not less than key.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+std::size_t BPlusTree<Key, Value, Fanout, Compare>::leafLowerBound(const Leaf* leaf, const Key& key) const
+{
+    std::size_t lo = 0, hi = leaf->count;
+    while (lo < hi)
+    {
+        std::size_t mid = (lo + hi) / 2;
+        if (comp_(leaf->item(mid)->first, key))
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+* Index of the first entry in the leaf whose key is greater than key.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+std::size_t BPlusTree<Key, Value, Fanout, Compare>::leafUpperBound(const Leaf* leaf, const Key& key) const
+{
+    std::size_t lo = 0, hi = leaf->count;
+    while (lo < hi)
+    {
+        std::size_t mid = (lo + hi) / 2;
+        if (comp_(key, leaf->item(mid)->first))
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+/**
+* Index of the child whose range contains key: the number of separator keys
+* that are less than or equal to it.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+std::size_t BPlusTree<Key, Value, Fanout, Compare>::childIndex(const Internal* node, const Key& key) const
+{
+    std::size_t lo = 0, hi = node->count;
+    while (lo < hi)
+    {
+        std::size_t mid = (lo + hi) / 2;
+        if (comp_(key, node->keys[mid]))
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+/**
+* Moves the entry in slot i of one leaf into the empty slot j of another
+* (or the same) leaf.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+void BPlusTree<Key, Value, Fanout, Compare>::moveItem(Leaf* from, std::size_t i, Leaf* to, std::size_t j)
+{
+    new (to->item(j)) Item(std::move(*from->item(i)));
+    from->item(i)->~Item();
+}
+
+/**
+* Descends to the leaf whose range contains key, or returns NULL for an
+* empty tree.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::Leaf* BPlusTree<Key, Value, Fanout, Compare>::findLeaf(const Key& key) const
+{
+    NodeBase* node = root_;
+    if (node == nullptr)
+    {
+        return nullptr;
+    }
+    while (!node->leaf)
+    {
+        Internal* internal = static_cast<Internal*>(node);
+        node = internal->children[childIndex(internal, key)];
+    }
+    return static_cast<Leaf*>(node);
+}
+
+/**
+* An iterator to slot index of leaf, or to the front of the next leaf when
+* index is one past its last entry.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+typename BPlusTree<Key, Value, Fanout, Compare>::iterator BPlusTree<Key, Value, Fanout, Compare>::entryAt(Leaf* leaf, std::size_t index)
+{
+    if (index == leaf->count)
+    {
+        return iterator(leaf->next, 0);
+    }
+    return iterator(leaf, index);
+}
+
+/**
+* Inserts into the subtree at node. Returns true if node had to split, in
+* which case upNode is the new right sibling and upKey its smallest key.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+bool BPlusTree<Key, Value, Fanout, Compare>::insertInto(NodeBase* node, const Item& keyValuePair, Key& upKey, NodeBase*& upNode)
+{
+    if (node->leaf)
+    {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        std::size_t idx = leafLowerBound(leaf, keyValuePair.first);
+        if (idx < leaf->count && !comp_(keyValuePair.first, leaf->item(idx)->first))
+        {
+            leaf->item(idx)->second = keyValuePair.second;
+            return false;
+        }
+        size_++;
+
+        Leaf* target = leaf;
+        Leaf* right = nullptr;
+        if (leaf->count == Fanout)
+        {
+            // split: the upper half moves to a new leaf linked after this one
+            std::size_t half = (Fanout + 1) / 2;
+            right = new Leaf;
+            for (std::size_t i = half; i < Fanout; i++)
+            {
+                moveItem(leaf, i, right, i - half);
+            }
+            right->count = Fanout - half;
+            leaf->count = half;
+            right->next = leaf->next;
+            leaf->next = right;
+            if (idx >= half)
+            {
+                target = right;
+                idx -= half;
+            }
+        }
+
+        for (std::size_t j = target->count; j > idx; j--)
+        {
+            moveItem(target, j - 1, target, j);
+        }
+        new (target->item(idx)) Item(keyValuePair);
+        target->count++;
+
+        if (right == nullptr)
+        {
+            return false;
+        }
+        upKey = right->item(0)->first;
+        upNode = right;
+        return true;
+    }
+
+    Internal* internal = static_cast<Internal*>(node);
+    std::size_t i = childIndex(internal, keyValuePair.first);
+    Key childKey;
+    NodeBase* childNode = nullptr;
+    if (!insertInto(internal->children[i], keyValuePair, childKey, childNode))
+    {
+        return false;
+    }
+
+    for (std::size_t j = internal->count; j > i; j--)
+    {
+        internal->keys[j] = internal->keys[j - 1];
+        internal->children[j + 1] = internal->children[j];
+    }
+    internal->keys[i] = childKey;
+    internal->children[i + 1] = childNode;
+    internal->count++;
+    if (internal->count < Fanout)
+    {
+        return false;
+    }
+
+    // split: the middle key moves up, everything after it moves right
+    std::size_t mid = internal->count / 2;
+    Internal* right = new Internal;
+    for (std::size_t j = mid + 1; j < internal->count; j++)
+    {
+        right->keys[j - mid - 1] = internal->keys[j];
+    }
+    for (std::size_t j = mid + 1; j <= internal->count; j++)
+    {
+        right->children[j - mid - 1] = internal->children[j];
+    }
+    right->count = internal->count - mid - 1;
+    internal->count = mid;
+    upKey = internal->keys[mid];
+    upNode = right;
+    return true;
+}
+
+/**
+* Removes key from the subtree at node. Returns true if node is now below
+* its minimum occupancy and the caller must fix it up.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+bool BPlusTree<Key, Value, Fanout, Compare>::removeFrom(NodeBase* node, const Key& key)
+{
+    if (node->leaf)
+    {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        std::size_t idx = leafLowerBound(leaf, key);
+        if (idx == leaf->count || comp_(key, leaf->item(idx)->first))
+        {
+            return false;
+        }
+        leaf->item(idx)->~Item();
+        for (std::size_t j = idx + 1; j < leaf->count; j++)
+        {
+            moveItem(leaf, j, leaf, j - 1);
+        }
+        leaf->count--;
+        size_--;
+        return leaf->count < minLeaf;
+    }
+
+    Internal* internal = static_cast<Internal*>(node);
+    std::size_t i = childIndex(internal, key);
+    if (removeFrom(internal->children[i], key))
+    {
+        fixChild(internal, i);
+    }
+    return internal->count < minKeys;
+}
+
+/**
+* Restores the minimum occupancy of parent->children[i] by borrowing one
+* entry from a sibling that can spare it, or else merging with a sibling.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+void BPlusTree<Key, Value, Fanout, Compare>::fixChild(Internal* parent, std::size_t i)
+{
+    NodeBase* child = parent->children[i];
+    NodeBase* left = i > 0 ? parent->children[i - 1] : nullptr;
+    NodeBase* right = i < parent->count ? parent->children[i + 1] : nullptr;
+
+    if (child->leaf)
+    {
+        Leaf* c = static_cast<Leaf*>(child);
+        if (left != nullptr && left->count > minLeaf)
+        {
+            Leaf* l = static_cast<Leaf*>(left);
+            for (std::size_t j = c->count; j > 0; j--)
+            {
+                moveItem(c, j - 1, c, j);
+            }
+            moveItem(l, l->count - 1, c, 0);
+            l->count--;
+            c->count++;
+            parent->keys[i - 1] = c->item(0)->first;
+            return;
+        }
+        if (right != nullptr && right->count > minLeaf)
+        {
+            Leaf* r = static_cast<Leaf*>(right);
+            moveItem(r, 0, c, c->count);
+            for (std::size_t j = 1; j < r->count; j++)
+            {
+                moveItem(r, j, r, j - 1);
+            }
+            r->count--;
+            c->count++;
+            parent->keys[i] = r->item(0)->first;
+            return;
+        }
+    }
+    else
+    {
+        Internal* c = static_cast<Internal*>(child);
+        if (left != nullptr && left->count > minKeys)
+        {
+            Internal* l = static_cast<Internal*>(left);
+            for (std::size_t j = c->count; j > 0; j--)
+            {
+                c->keys[j] = c->keys[j - 1];
+            }
+            for (std::size_t j = c->count + 1; j > 0; j--)
+            {
+                c->children[j] = c->children[j - 1];
+            }
+            c->keys[0] = parent->keys[i - 1];
+            c->children[0] = l->children[l->count];
+            parent->keys[i - 1] = l->keys[l->count - 1];
+            l->count--;
+            c->count++;
+            return;
+        }
+        if (right != nullptr && right->count > minKeys)
+        {
+            Internal* r = static_cast<Internal*>(right);
+            c->keys[c->count] = parent->keys[i];
+            c->children[c->count + 1] = r->children[0];
+            parent->keys[i] = r->keys[0];
+            for (std::size_t j = 1; j < r->count; j++)
+            {
+                r->keys[j - 1] = r->keys[j];
+            }
+            for (std::size_t j = 1; j <= r->count; j++)
+            {
+                r->children[j - 1] = r->children[j];
+            }
+            r->count--;
+            c->count++;
+            return;
+        }
+    }
+
+    // neither sibling can spare an entry: merge the pair around separator s
+    std::size_t s = left != nullptr ? i - 1 : i;
+    NodeBase* into = parent->children[s];
+    NodeBase* from = parent->children[s + 1];
+    if (into->leaf)
+    {
+        Leaf* l = static_cast<Leaf*>(into);
+        Leaf* r = static_cast<Leaf*>(from);
+        for (std::size_t j = 0; j < r->count; j++)
+        {
+            moveItem(r, j, l, l->count + j);
+        }
+        l->count += r->count;
+        l->next = r->next;
+        delete r;
+    }
+    else
+    {
+        Internal* l = static_cast<Internal*>(into);
+        Internal* r = static_cast<Internal*>(from);
+        l->keys[l->count] = parent->keys[s];
+        for (std::size_t j = 0; j < r->count; j++)
+        {
+            l->keys[l->count + 1 + j] = r->keys[j];
+        }
+        for (std::size_t j = 0; j <= r->count; j++)
+        {
+            l->children[l->count + 1 + j] = r->children[j];
+        }
+        l->count += 1 + r->count;
+        delete r;
+    }
+    for (std::size_t j = s + 1; j < parent->count; j++)
+    {
+        parent->keys[j - 1] = parent->keys[j];
+        parent->children[j] = parent->children[j + 1];
+    }
+    parent->count--;
+}
+
+/**
+* Frees a subtree, destroying the entries in its leaves.
+*/
+template<typename Key, typename Value, std::size_t Fanout, typename Compare>
+void BPlusTree<Key, Value, Fanout, Compare>::destroy(NodeBase* node)
+{
+    if (node->leaf)
+    {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        for (std::size_t i = 0; i < leaf->count; i++)
+        {
+            leaf->item(i)->~Item();
+        }
+        delete leaf;
+        return;
+    }
+    Internal* internal = static_cast<Internal*>(node);
+    for (std::size_t i = 0; i <= internal->count; i++)
+    {
+        destroy(internal->children[i]);
+    }
+    delete internal;
+}
+
+/*
+---------------------------------------------
+End implementations for the BPlusTree class.
+---------------------------------------------
+*/
+
+#endif
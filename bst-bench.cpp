@@ -0,0 +1,1815 @@
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include "bst.h"
+#include "avlbst.h"
+#include "bplustree.h"
+#include "concurrentavl.h"
+#include "persistentavl.h"
+#include <cstdio>
+#include <fstream>
+#include <cmath>
+#include <cstdlib>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Benchmarks for the search trees. Build with `make bench` and pass a
+// section name (e.g. ./bst-bench alloc) to run only that section.
+
+typedef chrono::steady_clock Clock;
+
+/**
+* Nanoseconds per operation since start.
+*/
+double nsPerOp(Clock::time_point start, size_t ops)
+{
+    chrono::duration<double, nano> elapsed = Clock::now() - start;
+    return elapsed.count() / (ops == 0 ? 1 : ops);
+}
+
+/**
+* The keys 0..n-1 in a reproducible random order.
+*/
+vector<int> shuffledKeys(size_t n, unsigned seed)
+{
+    vector<int> keys(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        keys[i] = static_cast<int>(i);
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(seed));
+    return keys;
+}
+
+/**
+* Random inserts, then remove/insert churn, then teardown. This is the
+* workload that is dominated by node allocation.
+*/
+template<typename Tree>
+void benchChurn(const char* treeName, size_t n)
+{
+    vector<int> keys = shuffledKeys(2 * n, 1);
+    Tree* tree = new Tree;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; i++)
+    {
+        tree->insert(make_pair(keys[i], keys[i]));
+    }
+    double insertNs = nsPerOp(start, n);
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; i++)
+    {
+        tree->remove(keys[i]);
+        tree->insert(make_pair(keys[n + i], keys[n + i]));
+    }
+    double churnNs = nsPerOp(start, 2 * n);
+
+    start = Clock::now();
+    delete tree;
+    double clearNs = nsPerOp(start, n);
+
+    cout << "alloc allocator=" << (NodeArena::pooled ? "slab" : "heap")
+         << " tree=" << treeName << " n=" << n
+         << " insert_ns=" << insertNs << " churn_ns=" << churnNs
+         << " clear_ns=" << clearNs << endl;
+}
+
+void benchAlloc()
+{
+    for (size_t n = 10000; n <= 1000000; n *= 10)
+    {
+        benchChurn<BinarySearchTree<int, int> >("bst", n);
+        benchChurn<AVLTree<int, int> >("avl", n);
+    }
+}
+
+/**
+* Node footprint plus random insert and lookup throughput; the numbers that
+* move when the node layout changes.
+*/
+void benchLayout()
+{
+    cout << "layout node_bytes=" << sizeof(Node<int, int>)
+         << " avlnode_bytes=" << sizeof(AVLNode<int, int>) << endl;
+    for (size_t n = 10000; n <= 1000000; n *= 10)
+    {
+        vector<int> keys = shuffledKeys(n, 2);
+        vector<int> probes = shuffledKeys(n, 3);
+        AVLTree<int, int> tree;
+
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; i++)
+        {
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        double insertNs = nsPerOp(start, n);
+
+        long sum = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < n; i++)
+        {
+            sum += tree.find(probes[i])->second;
+        }
+        double findNs = nsPerOp(start, n);
+
+        cout << "layout tree=avl n=" << n << " insert_ns=" << insertNs
+             << " find_ns=" << findNs << " checksum=" << sum << endl;
+    }
+}
+
+/**
+* Building from already-sorted input: n AVL inserts against one linear
+* assignSorted pass.
+*/
+void benchBulk()
+{
+    for (size_t n = 10000; n <= 1000000; n *= 10)
+    {
+        vector<pair<int, int> > items(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            items[i] = make_pair(static_cast<int>(i), static_cast<int>(i));
+        }
+
+        AVLTree<int, int> looped;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; i++)
+        {
+            looped.insert(items[i]);
+        }
+        double loopNs = nsPerOp(start, n);
+
+        AVLTree<int, int> bulk;
+        start = Clock::now();
+        bulk.assignSorted(items.begin(), items.end());
+        double bulkNs = nsPerOp(start, n);
+
+        BinarySearchTree<int, int> plain;
+        start = Clock::now();
+        plain.assignSorted(items.begin(), items.end());
+        double plainNs = nsPerOp(start, n);
+
+        cout << "bulk n=" << n << " avl_insert_loop_ns=" << loopNs
+             << " avl_assign_sorted_ns=" << bulkNs
+             << " bst_assign_sorted_ns=" << plainNs << endl;
+    }
+}
+
+/**
+* Applying unsorted batches to a 1e6-entry tree: a loop of insert against
+* insert_range.
+*/
+void benchBatch()
+{
+    const size_t n = 1000000;
+    vector<pair<int, int> > base(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        base[i] = make_pair(static_cast<int>(2 * i), 0);
+    }
+    for (size_t m = 10000; m <= 1000000; m *= 10)
+    {
+        mt19937 rng(4);
+        vector<pair<int, int> > updates(m);
+        for (size_t i = 0; i < m; i++)
+        {
+            int key = static_cast<int>(rng() % (2 * n));
+            updates[i] = make_pair(key, key);
+        }
+
+        AVLTree<int, int> looped;
+        looped.assignSorted(base.begin(), base.end());
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < m; i++)
+        {
+            looped.insert(updates[i]);
+        }
+        double loopNs = nsPerOp(start, m);
+
+        AVLTree<int, int> batched;
+        batched.assignSorted(base.begin(), base.end());
+        start = Clock::now();
+        batched.insert_range(updates.begin(), updates.end());
+        double rangeNs = nsPerOp(start, m);
+
+        cout << "batch n=" << n << " m=" << m << " insert_loop_ns=" << loopNs
+             << " insert_range_ns=" << rangeNs << endl;
+    }
+}
+
+/**
+* Random lookups against a frozen snapshot, the live AVLTree and std::map.
+*/
+void benchFreeze()
+{
+    for (size_t n = 10000; n <= 1000000; n *= 10)
+    {
+        vector<int> keys = shuffledKeys(n, 5);
+        vector<int> probes = shuffledKeys(n, 6);
+        AVLTree<int, int> tree;
+        map<int, int> stdMap;
+        for (size_t i = 0; i < n; i++)
+        {
+            tree.insert(make_pair(keys[i], keys[i]));
+            stdMap.insert(make_pair(keys[i], keys[i]));
+        }
+
+        Clock::time_point start = Clock::now();
+        FrozenTree<int, int> frozen = tree.freeze();
+        double freezeNs = nsPerOp(start, n);
+
+        long sum = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < n; i++)
+        {
+            sum += frozen.find(probes[i])->second;
+        }
+        double frozenNs = nsPerOp(start, n);
+
+        start = Clock::now();
+        for (size_t i = 0; i < n; i++)
+        {
+            sum += tree.find(probes[i])->second;
+        }
+        double treeNs = nsPerOp(start, n);
+
+        start = Clock::now();
+        for (size_t i = 0; i < n; i++)
+        {
+            sum += stdMap.find(probes[i])->second;
+        }
+        double mapNs = nsPerOp(start, n);
+
+        cout << "freeze n=" << n << " freeze_ns=" << freezeNs
+             << " frozen_find_ns=" << frozenNs << " avl_find_ns=" << treeNs
+             << " map_find_ns=" << mapNs << " checksum=" << sum << endl;
+    }
+}
+
+/**
+* One engine through the shared workload: insert, lookup, full scan and
+* remove, over the given key order.
+*/
+template<typename Tree>
+void benchEngine(const char* engine, const char* order, const vector<int>& keys)
+{
+    size_t n = keys.size();
+    vector<int> probes = shuffledKeys(n, 8);
+    Tree tree;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; i++)
+    {
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    double insertNs = nsPerOp(start, n);
+
+    long sum = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += tree.find(probes[i])->second;
+    }
+    double findNs = nsPerOp(start, n);
+
+    start = Clock::now();
+    for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it)
+    {
+        sum += it->second;
+    }
+    double scanNs = nsPerOp(start, n);
+
+    start = Clock::now();
+    for (size_t i = 0; i < n; i++)
+    {
+        tree.remove(probes[i]);
+    }
+    double removeNs = nsPerOp(start, n);
+
+    cout << "engines engine=" << engine << " order=" << order << " n=" << n
+         << " insert_ns=" << insertNs << " find_ns=" << findNs
+         << " scan_ns=" << scanNs << " remove_ns=" << removeNs
+         << " checksum=" << sum << endl;
+}
+
+void benchEngines()
+{
+    for (size_t n = 100000; n <= 1000000; n *= 10)
+    {
+        vector<int> sequential = shuffledKeys(n, 0);
+        sort(sequential.begin(), sequential.end());
+        vector<int> random = shuffledKeys(n, 7);
+
+        benchEngine<AVLTree<int, int> >("avl", "sequential", sequential);
+        benchEngine<BPlusTree<int, int, 16> >("bplus16", "sequential", sequential);
+        benchEngine<BPlusTree<int, int, 64> >("bplus64", "sequential", sequential);
+        benchEngine<AVLTree<int, int> >("avl", "random", random);
+        benchEngine<BPlusTree<int, int, 16> >("bplus16", "random", random);
+        benchEngine<BPlusTree<int, int, 64> >("bplus64", "random", random);
+    }
+}
+
+/**
+* Cutting a tree in two at its median and putting it back together: split
+* plus join against rebuilding both halves with insert. The pivot entry
+* itself is dropped by the first split.
+*/
+void benchSplitJoin()
+{
+    for (size_t n = 10000; n <= 1000000; n *= 10)
+    {
+        vector<int> keys = shuffledKeys(n, 9);
+        AVLTree<int, int> tree;
+        for (size_t i = 0; i < n; i++)
+        {
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        const int pivot = static_cast<int>(n / 2);
+        const size_t rounds = 1000;
+
+        AVLTree<int, int> less, greater;
+        Clock::time_point start = Clock::now();
+        for (size_t r = 0; r < rounds; r++)
+        {
+            tree.split(pivot, less, greater);
+            tree.join(less, greater);
+        }
+        double splitJoinNs = nsPerOp(start, rounds);
+
+        AVLTree<int, int> lessCopy, greaterCopy;
+        start = Clock::now();
+        for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it)
+        {
+            if (it->first < pivot)
+            {
+                lessCopy.insert(*it);
+            }
+            else
+            {
+                greaterCopy.insert(*it);
+            }
+        }
+        double copyNs = nsPerOp(start, 1);
+
+        cout << "splitjoin n=" << n << " split_join_ns=" << splitJoinNs
+             << " reinsert_ns=" << copyNs << endl;
+    }
+}
+
+/**
+* n sorted entries spaced stride apart (stride must be even), with every
+* other key nudged to an odd value when odd is set. Against a tree of the
+* even keys, that gives an operand half of whose keys are already present.
+*/
+vector<pair<int, int> > stridedItems(size_t n, int stride, bool odd)
+{
+    vector<pair<int, int> > items(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        int key = static_cast<int>(i) * stride + (odd ? static_cast<int>(i % 2) : 0);
+        items[i] = make_pair(key, key);
+    }
+    return items;
+}
+
+/**
+* Union, intersection and difference of a 1e6-entry tree with trees of
+* 1e4..1e6 entries at 1/2/4/8 threads, against the single-threaded
+* iterate-and-insert (or remove) loop they replace.
+*/
+void benchSetOps()
+{
+    const size_t n = 1000000;
+    vector<pair<int, int> > base = stridedItems(n, 2, false);
+    const char* names[] = { "union", "intersection", "difference" };
+    for (size_t m = 10000; m <= 1000000; m *= 10)
+    {
+        vector<pair<int, int> > other = stridedItems(m, static_cast<int>(2 * n / m), true);
+        for (int op = 0; op < 3; op++)
+        {
+            AVLTree<int, int> looped, operand;
+            looped.assignSorted(base.begin(), base.end());
+            operand.assignSorted(other.begin(), other.end());
+            Clock::time_point start = Clock::now();
+            for (AVLTree<int, int>::iterator it = operand.begin(); it != operand.end(); ++it)
+            {
+                if (op == 0)
+                {
+                    looped.insert(*it);
+                }
+                else if (op == 2)
+                {
+                    looped.remove(it->first);
+                }
+            }
+            if (op == 1)
+            {
+                AVLTree<int, int> kept;
+                for (AVLTree<int, int>::iterator it = operand.begin(); it != operand.end(); ++it)
+                {
+                    if (looped.find(it->first) != looped.end())
+                    {
+                        kept.insert(*it);
+                    }
+                }
+            }
+            double loopMs = nsPerOp(start, 1) / 1e6;
+
+            cout << "setops op=" << names[op] << " n=" << n << " m=" << m
+                 << " loop_ms=" << loopMs;
+            for (unsigned threads = 1; threads <= 8; threads *= 2)
+            {
+                AVLTree<int, int> tree, rhs;
+                tree.assignSorted(base.begin(), base.end());
+                rhs.assignSorted(other.begin(), other.end());
+                start = Clock::now();
+                if (op == 0)
+                {
+                    tree.unionWith(rhs, threads);
+                }
+                else if (op == 1)
+                {
+                    tree.intersectWith(rhs, threads);
+                }
+                else
+                {
+                    tree.subtract(rhs, threads);
+                }
+                cout << " threads" << threads << "_ms=" << nsPerOp(start, 1) / 1e6;
+            }
+            cout << endl;
+        }
+    }
+}
+
+/**
+* Percentile and pagination queries: select, rank and count_range on the
+* subtree counts, against walking from begin() to the same position.
+*/
+void benchOrder()
+{
+    for (size_t n = 10000; n <= 1000000; n *= 10)
+    {
+        vector<int> keys = shuffledKeys(n, 10);
+        AVLTree<int, int> tree;
+        for (size_t i = 0; i < n; i++)
+        {
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        const size_t queries = 100000;
+        const size_t walks = 100;
+        mt19937 rng(11);
+
+        long sum = 0;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < queries; i++)
+        {
+            sum += tree.select(rng() % n)->first;
+        }
+        double selectNs = nsPerOp(start, queries);
+
+        start = Clock::now();
+        for (size_t i = 0; i < queries; i++)
+        {
+            sum += tree.rank(static_cast<int>(rng() % n));
+        }
+        double rankNs = nsPerOp(start, queries);
+
+        start = Clock::now();
+        for (size_t i = 0; i < queries; i++)
+        {
+            int lo = static_cast<int>(rng() % n);
+            sum += tree.count_range(lo, lo + 1000);
+        }
+        double rangeNs = nsPerOp(start, queries);
+
+        start = Clock::now();
+        for (size_t i = 0; i < walks; i++)
+        {
+            size_t k = rng() % n;
+            AVLTree<int, int>::iterator it = tree.begin();
+            for (size_t j = 0; j < k; j++)
+            {
+                ++it;
+            }
+            sum += it->first;
+        }
+        double walkNs = nsPerOp(start, walks);
+
+        cout << "order n=" << n << " select_ns=" << selectNs << " rank_ns=" << rankNs
+             << " count_range_ns=" << rangeNs << " walk_select_ns=" << walkNs
+             << " checksum=" << sum << endl;
+    }
+}
+
+/**
+* Short range scans (100 keys) starting at random points: range() seeks
+* with lower_bound, the old way walks forward from begin().
+*/
+void benchBounds()
+{
+    for (size_t n = 10000; n <= 1000000; n *= 10)
+    {
+        vector<int> keys = shuffledKeys(n, 12);
+        AVLTree<int, int> tree;
+        for (size_t i = 0; i < n; i++)
+        {
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        const size_t scans = 10000;
+        const size_t walks = 100;
+        mt19937 rng(13);
+
+        long sum = 0;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < scans; i++)
+        {
+            int lo = static_cast<int>(rng() % n);
+            for (const pair<const int, int>& item : tree.range(lo, lo + 100))
+            {
+                sum += item.second;
+            }
+        }
+        double rangeNs = nsPerOp(start, scans);
+
+        start = Clock::now();
+        for (size_t i = 0; i < scans; i++)
+        {
+            sum += tree.floor(static_cast<int>(rng() % n))->second;
+        }
+        double floorNs = nsPerOp(start, scans);
+
+        start = Clock::now();
+        for (size_t i = 0; i < walks; i++)
+        {
+            int lo = static_cast<int>(rng() % n);
+            AVLTree<int, int>::iterator it = tree.begin();
+            while (it != tree.end() && it->first < lo)
+            {
+                ++it;
+            }
+            for (; it != tree.end() && it->first < lo + 100; ++it)
+            {
+                sum += it->second;
+            }
+        }
+        double walkNs = nsPerOp(start, walks);
+
+        cout << "bounds n=" << n << " range_scan_ns=" << rangeNs << " floor_ns=" << floorNs
+             << " walk_scan_ns=" << walkNs << " checksum=" << sum << endl;
+    }
+}
+
+/**
+* std::less<std::string> without the three-way hook, so the tree falls back
+* to one operator< per level.
+*/
+struct PlainStringLess
+{
+    bool operator()(const string& a, const string& b) const
+    {
+        return a < b;
+    }
+};
+
+/**
+* Keys that share a long prefix, so every comparison has to scan it.
+*/
+vector<string> prefixedKeys(size_t n, unsigned seed)
+{
+    vector<int> ids = shuffledKeys(n, seed);
+    vector<string> keys(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        keys[i] = string(64, 'k') + to_string(ids[i]);
+    }
+    return keys;
+}
+
+/**
+* Insert and lookup of long shared-prefix string keys in one container.
+*/
+template<typename Tree>
+void benchStringTree(const char* tree, const vector<string>& keys, const vector<string>& probes)
+{
+    Tree container;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        container.insert(make_pair(keys[i], static_cast<int>(i)));
+    }
+    double insertNs = nsPerOp(start, keys.size());
+
+    long sum = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < probes.size(); i++)
+    {
+        sum += container.find(probes[i])->second;
+    }
+    double findNs = nsPerOp(start, probes.size());
+
+    cout << "strings tree=" << tree << " n=" << keys.size() << " insert_ns=" << insertNs
+         << " find_ns=" << findNs << " checksum=" << sum << endl;
+}
+
+void benchStrings()
+{
+    for (size_t n = 10000; n <= 1000000; n *= 10)
+    {
+        vector<string> keys = prefixedKeys(n, 14);
+        vector<string> probes = prefixedKeys(n, 15);
+        benchStringTree<AVLTree<string, int> >("avl_three_way", keys, probes);
+        benchStringTree<AVLTree<string, int, PlainStringLess> >("avl_less", keys, probes);
+        benchStringTree<map<string, int> >("std_map", keys, probes);
+    }
+}
+
+/**
+* Inserting entries with heap-owning keys and values (64-byte strings and
+* 64-element vectors): copying insert(const pair&), moving insert(pair&&)
+* and try_emplace building the vector inside the node.
+*/
+void benchMoves()
+{
+    const size_t valueLength = 64;
+    for (size_t n = 10000; n <= 1000000; n *= 10)
+    {
+        vector<string> keys = prefixedKeys(n, 16);
+        typedef AVLTree<string, vector<int> > Tree;
+
+        vector<pair<const string, vector<int> > > items;
+        items.reserve(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            items.push_back(make_pair(keys[i], vector<int>(valueLength, static_cast<int>(i))));
+        }
+        Tree copied;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < n; i++)
+        {
+            copied.insert(items[i]);
+        }
+        double copyNs = nsPerOp(start, n);
+
+        vector<pair<string, vector<int> > > movable;
+        movable.reserve(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            movable.push_back(make_pair(keys[i], vector<int>(valueLength, static_cast<int>(i))));
+        }
+        Tree moved;
+        start = Clock::now();
+        for (size_t i = 0; i < n; i++)
+        {
+            moved.insert(std::move(movable[i]));
+        }
+        double moveNs = nsPerOp(start, n);
+
+        Tree emplaced;
+        start = Clock::now();
+        for (size_t i = 0; i < n; i++)
+        {
+            emplaced.try_emplace(std::move(keys[i]), valueLength, static_cast<int>(i));
+        }
+        double emplaceNs = nsPerOp(start, n);
+
+        cout << "moves n=" << n << " copy_insert_ns=" << copyNs << " move_insert_ns=" << moveNs
+             << " try_emplace_ns=" << emplaceNs << endl;
+    }
+}
+
+void benchRemove()
+{
+    const size_t ops = 10000;
+    for (size_t n = 10000; n <= 1000000; n *= 10)
+    {
+        vector<int> keys = shuffledKeys(n, 17);
+        AVLTree<int, int> tree;
+        for (size_t i = 0; i < n; i++)
+        {
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        // remove and put back, so every removal sees a tree of n keys
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < ops; i++)
+        {
+            tree.remove(keys[i]);
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        double churnNs = nsPerOp(start, ops);
+
+        start = Clock::now();
+        for (size_t i = 0; i < ops; i++)
+        {
+            tree.remove(keys[i]);
+        }
+        double removeNs = nsPerOp(start, ops);
+
+        // draining in key order rebalances near the root over and over, which
+        // is where a remove that has to measure subtree heights falls over
+        std::sort(keys.begin(), keys.end());
+        vector<double> latencies;
+        latencies.reserve(n);
+        start = Clock::now();
+        for (size_t i = 0; i < n; i++)
+        {
+            Clock::time_point one = Clock::now();
+            tree.remove(keys[i]);
+            latencies.push_back(static_cast<double>(
+                chrono::duration_cast<chrono::nanoseconds>(Clock::now() - one).count()));
+        }
+        double drainNs = nsPerOp(start, n);
+        vector<double>::iterator p999 = latencies.begin() + latencies.size() * 999 / 1000;
+        std::nth_element(latencies.begin(), p999, latencies.end());
+        cout << "remove n=" << n << " remove_ns=" << removeNs << " remove_insert_ns=" << churnNs
+             << " drain_ns=" << drainNs << " drain_p999_ns=" << *p999
+             << " empty=" << tree.empty() << endl;
+    }
+}
+
+void benchValidate()
+{
+    for (size_t n = 10000; n <= 1000000; n *= 10)
+    {
+        vector<int> keys = shuffledKeys(n, 18);
+        AVLTree<int, int> tree;
+        for (size_t i = 0; i < n; i++)
+        {
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+        Clock::time_point start = Clock::now();
+        TreeShape shape = tree.validate();
+        double serialNs = nsPerOp(start, n);
+        start = Clock::now();
+        TreeShape parallel = tree.validate(0);
+        double parallelNs = nsPerOp(start, n);
+        start = Clock::now();
+        bool balanced = tree.isBalanced();
+        double balancedNs = nsPerOp(start, n);
+        cout << "validate n=" << n << " validate_ns_per_node=" << serialNs
+             << " parallel_ns_per_node=" << parallelNs << " isBalanced_ns_per_node=" << balancedNs
+             << " valid=" << (shape.valid && parallel.valid && balanced) << " height=" << shape.height
+             << " avg_depth=" << shape.averageDepth() << " leaning=" << shape.balance[-1] + shape.balance[1] << endl;
+    }
+}
+
+/**
+* Builds a million-entry tree of the given type from sorted items and times
+* its destructor.
+*/
+template<typename Tree, typename Item>
+double teardownNs(const vector<Item>& items)
+{
+    Tree* tree = new Tree;
+    tree->assignSorted(items.begin(), items.end());
+    Clock::time_point start = Clock::now();
+    delete tree;
+    return nsPerOp(start, items.size());
+}
+
+/**
+* Builds a chain from sorted single inserts into an unbalanced tree, the
+* shape that used to overflow the stack on destruction, and times its
+* destructor. Building costs O(n^2), so n stays well below a million.
+*/
+template<typename Tree, typename Item>
+double chainTeardownNs(const vector<Item>& items, size_t n)
+{
+    Tree* tree = new Tree;
+    for (size_t i = 0; i < n; i++)
+    {
+        tree->insert(items[i]);
+    }
+    Clock::time_point start = Clock::now();
+    delete tree;
+    return nsPerOp(start, n);
+}
+
+void benchTeardown()
+{
+    const size_t n = 1000000;
+    vector<pair<int, int> > ints;
+    vector<pair<int, string> > strings;
+    ints.reserve(n);
+    strings.reserve(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        ints.push_back(make_pair(static_cast<int>(i), static_cast<int>(i)));
+        strings.push_back(make_pair(static_cast<int>(i), string(32, 'v')));
+    }
+    // int entries are released slab by slab unless BST_HEAP_NODES is set;
+    // string entries always need their destructors run node by node
+    cout << "teardown n=" << n
+         << " bst_int_ns=" << teardownNs<BinarySearchTree<int, int> >(ints)
+         << " avl_int_ns=" << teardownNs<AVLTree<int, int> >(ints)
+         << " bst_string_ns=" << teardownNs<BinarySearchTree<int, string> >(strings)
+         << " avl_string_ns=" << teardownNs<AVLTree<int, string> >(strings) << endl;
+    const size_t chain = 30000;
+    cout << "teardown chain n=" << chain
+         << " bst_int_ns=" << chainTeardownNs<BinarySearchTree<int, int> >(ints, chain)
+         << " bst_string_ns=" << chainTeardownNs<BinarySearchTree<int, string> >(strings, chain) << endl;
+}
+
+/**
+* The obvious way to share an AVLTree: readers take a std::shared_mutex in
+* shared mode, the writer takes it exclusively.
+*/
+class SharedMutexAVLTree
+{
+public:
+    bool find(const int& key, int& value) const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        AVLTree<int, int>::const_iterator it = tree_.find(key);
+        if (it == tree_.end())
+        {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    void insert(const pair<const int, int>& keyValuePair)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        tree_.insert(keyValuePair);
+    }
+
+    void remove(const int& key)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        tree_.remove(key);
+    }
+
+private:
+    mutable std::shared_mutex mutex_;
+    AVLTree<int, int> tree_;
+};
+
+/**
+* Runs readers threads doing random finds against tree while one writer
+* inserts and removes odd keys, for durationMs. Reports reads per
+* microsecond (all readers together) and writes per millisecond.
+*/
+template<typename Tree>
+void readScaling(Tree& tree, size_t n, unsigned readers, int durationMs, double& readsPerUs, double& writesPerMs)
+{
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> reads(0);
+    std::atomic<size_t> writes(0);
+    vector<std::thread> threads;
+    for (unsigned r = 0; r < readers; r++)
+    {
+        threads.push_back(std::thread([&tree, &stop, &reads, n, r]() {
+            mt19937 rng(100 + r);
+            size_t done = 0;
+            int value;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                tree.find(static_cast<int>(rng() % (2 * n)), value);
+                ++done;
+            }
+            reads += done;
+        }));
+    }
+    threads.push_back(std::thread([&tree, &stop, &writes, n]() {
+        mt19937 rng(7);
+        size_t done = 0;
+        while (!stop.load(std::memory_order_relaxed))
+        {
+            int key = static_cast<int>(2 * (rng() % n) + 1);
+            if (done % 2 == 0)
+            {
+                tree.insert(make_pair(key, key));
+            }
+            else
+            {
+                tree.remove(key);
+            }
+            ++done;
+        }
+        writes += done;
+    }));
+    Clock::time_point start = Clock::now();
+    std::this_thread::sleep_for(chrono::milliseconds(durationMs));
+    stop = true;
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+    chrono::duration<double, micro> elapsed = Clock::now() - start;
+    readsPerUs = reads / elapsed.count();
+    writesPerMs = writes / elapsed.count() * 1000;
+}
+
+void benchConcurrent()
+{
+    const size_t n = 1000000;
+    const int durationMs = 200;
+    vector<int> keys = shuffledKeys(n, 19);
+    ConcurrentAVLTree<int, int> epoch;
+    SharedMutexAVLTree locked;
+    for (size_t i = 0; i < n; i++)
+    {
+        epoch.insert(make_pair(2 * keys[i], keys[i]));
+        locked.insert(make_pair(2 * keys[i], keys[i]));
+    }
+    cout << "concurrent hardware_threads=" << std::thread::hardware_concurrency() << endl;
+    for (unsigned readers = 1; readers <= 16; readers *= 2)
+    {
+        double epochReads, epochWrites, lockedReads, lockedWrites;
+        readScaling(epoch, n, readers, durationMs, epochReads, epochWrites);
+        readScaling(locked, n, readers, durationMs, lockedReads, lockedWrites);
+        cout << "concurrent readers=" << readers
+             << " epoch_reads_per_us=" << epochReads << " epoch_writes_per_ms=" << epochWrites
+             << " shared_mutex_reads_per_us=" << lockedReads << " shared_mutex_writes_per_ms=" << lockedWrites << endl;
+    }
+}
+
+/**
+* Inserts and then removes the keys ops..2*ops-1 of keys, taking a snapshot
+* before each write when snapshotEvery is set, so every write has to copy
+* its path. Returns ns per write.
+*/
+template<typename Tree>
+double persistentChurnNs(Tree& tree, const vector<int>& keys, size_t ops, bool snapshotEvery)
+{
+    Tree held;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < ops; i++)
+    {
+        if (snapshotEvery)
+        {
+            held = tree.snapshot();
+        }
+        tree.insert(make_pair(keys[i] + 1, keys[i]));
+        if (snapshotEvery)
+        {
+            held = tree.snapshot();
+        }
+        tree.remove(keys[i] + 1);
+    }
+    return nsPerOp(start, 2 * ops);
+}
+
+void benchPersistent()
+{
+    const size_t ops = 20000;
+    typedef PersistentAVLTree<int, int> Tree;
+    for (size_t n = 10000; n <= 1000000; n *= 10)
+    {
+        vector<int> keys = shuffledKeys(n, 20);
+        for (size_t i = 0; i < n; i++)
+        {
+            keys[i] *= 2;
+        }
+        Tree tree;
+        AVLTree<int, int> plain;
+        for (size_t i = 0; i < n; i++)
+        {
+            tree.insert(make_pair(keys[i], keys[i]));
+            plain.insert(make_pair(keys[i], keys[i]));
+        }
+
+        const size_t snapshots = 100000;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < snapshots; i++)
+        {
+            Tree snapshot = tree.snapshot();
+        }
+        double snapshotNs = nsPerOp(start, snapshots);
+
+        start = Clock::now();
+        for (size_t i = 0; i < ops; i++)
+        {
+            plain.insert(make_pair(keys[i] + 1, keys[i]));
+            plain.remove(keys[i] + 1);
+        }
+        double avlNs = nsPerOp(start, 2 * ops);
+
+        double unsharedNs = persistentChurnNs(tree, keys, ops, false);
+        size_t copiesBefore = tree.copyCount();
+        double sharedNs = persistentChurnNs(tree, keys, ops, true);
+        double copiesPerWrite = static_cast<double>(tree.copyCount() - copiesBefore) / (2 * ops);
+
+        cout << "persistent n=" << n << " snapshot_ns=" << snapshotNs
+             << " avl_write_ns=" << avlNs << " unshared_write_ns=" << unsharedNs
+             << " snapshotted_write_ns=" << sharedNs << " copies_per_write=" << copiesPerWrite
+             << " bytes_per_write=" << copiesPerWrite * Tree::nodeBytes() << endl;
+    }
+}
+
+/**
+* Copying a tree: the structural copy against rebuilding the copy by
+* inserting every entry of the source, and the O(1) move.
+*/
+void benchClone()
+{
+    const size_t n = 1000000;
+    vector<int> keys = shuffledKeys(n, 21);
+    AVLTree<int, int> tree;
+    for (size_t i = 0; i < n; i++)
+    {
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+
+    Clock::time_point start = Clock::now();
+    {
+        AVLTree<int, int> copy;
+        for (AVLTree<int, int>::iterator it = tree.begin(); it != tree.end(); ++it)
+        {
+            copy.insert(*it);
+        }
+    }
+    double reinsertNs = nsPerOp(start, n);
+
+    start = Clock::now();
+    {
+        AVLTree<int, int> copy(tree);
+    }
+    double cloneNs = nsPerOp(start, n);
+
+    start = Clock::now();
+    {
+        AVLTree<int, int> copy;
+        copy.copyFrom(tree, 0);
+    }
+    double parallelNs = nsPerOp(start, n);
+
+    const size_t moves = 1000000;
+    AVLTree<int, int> a(tree);
+    AVLTree<int, int> b;
+    start = Clock::now();
+    for (size_t i = 0; i < moves; i++)
+    {
+        b = std::move(a);
+        a = std::move(b);
+    }
+    double moveNs = nsPerOp(start, 2 * moves);
+
+    // the copies include their teardown
+    cout << "clone n=" << n << " reinsert_ns=" << reinsertNs << " clone_ns=" << cloneNs
+         << " parallel_clone_ns=" << parallelNs << " threads=" << thread::hardware_concurrency()
+         << " move_ns=" << moveNs << " moved_size=" << a.size() << endl;
+}
+
+/**
+* A less-than that counts how often it is called.
+*/
+struct CountingLess
+{
+    static size_t calls;
+    bool operator()(int a, int b) const
+    {
+        calls++;
+        return a < b;
+    }
+};
+size_t CountingLess::calls = 0;
+
+/**
+* Timestamp-like keys: 0, 10, 20, ... with each key displaced by up to
+* jitter positions from where it belongs.
+*/
+vector<int> nearlySortedKeys(size_t n, size_t jitter, unsigned seed)
+{
+    vector<int> keys(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        keys[i] = static_cast<int>(10 * i);
+    }
+    mt19937 rng(seed);
+    for (size_t i = 0; jitter > 0 && i + 1 < n; i++)
+    {
+        swap(keys[i], keys[min(n - 1, i + rng() % (jitter + 1))]);
+    }
+    return keys;
+}
+
+/**
+* Inserting a nearly-sorted stream: no hint, end() as the hint, and the
+* previous insert's position as the hint, with ns and comparisons per key.
+*/
+void benchHint()
+{
+    const size_t n = 1000000;
+    typedef AVLTree<int, int, CountingLess> Tree;
+    const size_t jitters[] = { 0, 4, 64 };
+    for (size_t j = 0; j < sizeof(jitters) / sizeof(jitters[0]); j++)
+    {
+        vector<int> keys = nearlySortedKeys(n, jitters[j], 22);
+        double ns[3];
+        double compares[3];
+        for (int mode = 0; mode < 3; mode++)
+        {
+            Tree tree;
+            Tree::iterator last = tree.end();
+            CountingLess::calls = 0;
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < n; i++)
+            {
+                if (mode == 0)
+                {
+                    tree.insert(make_pair(keys[i], keys[i]));
+                }
+                else
+                {
+                    last = tree.insert(mode == 1 ? tree.end() : last, make_pair(keys[i], keys[i]));
+                }
+            }
+            ns[mode] = nsPerOp(start, n);
+            compares[mode] = static_cast<double>(CountingLess::calls) / n;
+        }
+        cout << "hint n=" << n << " jitter=" << jitters[j]
+             << " plain_ns=" << ns[0] << " plain_compares=" << compares[0]
+             << " end_hint_ns=" << ns[1] << " end_hint_compares=" << compares[1]
+             << " last_hint_ns=" << ns[2] << " last_hint_compares=" << compares[2] << endl;
+    }
+}
+
+/**
+* Nanoseconds per entry for a forward and a reverse scan that sums the
+* values, through the tree's own iterators.
+*/
+template<typename Tree>
+void scanNs(const Tree& tree, double& forwardNs, double& reverseNs, long long& sum)
+{
+    Clock::time_point start = Clock::now();
+    for (typename Tree::const_iterator it = tree.begin(); it != tree.end(); ++it)
+    {
+        sum += it->second;
+    }
+    forwardNs = nsPerOp(start, tree.size());
+    start = Clock::now();
+    for (typename Tree::const_reverse_iterator it = tree.rbegin(); it != tree.rend(); ++it)
+    {
+        sum += it->second;
+    }
+    reverseNs = nsPerOp(start, tree.size());
+}
+
+/**
+* Full-scan throughput of AVLTree against std::map, both filled in random
+* key order so neither gets its nodes laid out in key order.
+*/
+void benchScan()
+{
+    for (size_t n = 1000000; n <= 10000000; n *= 10)
+    {
+        vector<int> keys = shuffledKeys(n, 23);
+        long long sum = 0;
+        double avlForward, avlReverse, mapForward, mapReverse;
+        {
+            AVLTree<int, int> tree;
+            for (size_t i = 0; i < n; i++)
+            {
+                tree.insert(make_pair(keys[i], keys[i]));
+            }
+            scanNs(tree, avlForward, avlReverse, sum);
+        }
+        {
+            map<int, int> tree;
+            for (size_t i = 0; i < n; i++)
+            {
+                tree.insert(make_pair(keys[i], keys[i]));
+            }
+            scanNs(tree, mapForward, mapReverse, sum);
+        }
+        cout << "scan n=" << n << " avl_forward_ns=" << avlForward << " avl_reverse_ns=" << avlReverse
+             << " map_forward_ns=" << mapForward << " map_reverse_ns=" << mapReverse
+             << " checksum=" << sum << endl;
+    }
+}
+
+/**
+* Saves tree to memory and loads it back, reporting MB/s both ways, and
+* the load's ns per entry next to rebuilding the same tree by insert.
+*/
+template<typename Tree>
+void serializeRoundTrip(const char* types, const Tree& tree)
+{
+    Clock::time_point start = Clock::now();
+    ostringstream out;
+    tree.serialize(out);
+    double saveNs = nsPerOp(start, 1);
+    string bytes = out.str();
+    double megabytes = bytes.size() / 1e6;
+
+    istringstream in(bytes);
+    Tree loaded;
+    start = Clock::now();
+    loaded.deserialize(in);
+    double loadNs = nsPerOp(start, 1);
+
+    // the loaded tree's nodes were allocated in key order
+    start = Clock::now();
+    ostringstream again;
+    loaded.serialize(again);
+    double resaveNs = nsPerOp(start, 1);
+
+    start = Clock::now();
+    {
+        Tree rebuilt;
+        for (typename Tree::const_iterator it = tree.begin(); it != tree.end(); ++it)
+        {
+            rebuilt.insert(*it);
+        }
+    }
+    double insertNs = nsPerOp(start, tree.size());
+
+    cout << "serialize types=" << types << " n=" << tree.size() << " mb=" << megabytes
+         << " save_mb_s=" << megabytes / (saveNs / 1e9) << " resave_mb_s=" << megabytes / (resaveNs / 1e9)
+         << " load_mb_s=" << megabytes / (loadNs / 1e9)
+         << " load_ns=" << loadNs / tree.size() << " insert_ns=" << insertNs
+         << " loaded_ok=" << (again.str() == bytes) << endl;
+}
+
+void benchSerialize()
+{
+    const size_t n = 1000000;
+    vector<int> keys = shuffledKeys(n, 24);
+    AVLTree<int, int> ints;
+    AVLTree<int, string> strings;
+    for (size_t i = 0; i < n; i++)
+    {
+        ints.insert(make_pair(keys[i], keys[i]));
+        strings.insert(make_pair(keys[i], string(32, 'a' + keys[i] % 26)));
+    }
+    serializeRoundTrip("int,int", ints);
+    serializeRoundTrip("int,string32", strings);
+}
+
+/**
+* Page faults taken by this process so far, minor and major.
+*/
+long pageFaults()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+/**
+* Cold start from a mapped tree file against deserializing the same tree:
+* the time to open the file, the first query and the pages it faulted in,
+* then steady-state lookups next to the in-memory AVLTree. The file's
+* cached pages are dropped first where the OS allows it.
+*/
+void benchMapped()
+{
+    const char* path = "/tmp/bst-bench-mapped.bin";
+    for (size_t n = 100000; n <= 10000000; n *= 10)
+    {
+        vector<pair<int, int> > items(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            items[i] = make_pair(static_cast<int>(2 * i), static_cast<int>(i));
+        }
+        AVLTree<int, int> tree;
+        tree.assignSorted(items.begin(), items.end());
+
+        Clock::time_point start = Clock::now();
+        {
+            ofstream out(path, ios::binary);
+            tree.writeMapped(out);
+        }
+        double writeNs = nsPerOp(start, 1);
+        ostringstream serialized;
+        tree.serialize(serialized);
+        string bytes = serialized.str();
+
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0)
+        {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+
+        long faults = pageFaults();
+        start = Clock::now();
+        MappedTree<int, int> mapped(path);
+        double openNs = nsPerOp(start, 1);
+        int probe = static_cast<int>(n);
+        start = Clock::now();
+        bool hit = mapped.find(probe) != mapped.end();
+        double firstNs = nsPerOp(start, 1);
+        long firstFaults = pageFaults() - faults;
+
+        start = Clock::now();
+        {
+            AVLTree<int, int> loaded;
+            istringstream in(bytes);
+            loaded.deserialize(in);
+        }
+        double deserializeNs = nsPerOp(start, 1);
+
+        const size_t lookups = 1000000;
+        vector<int> probes = shuffledKeys(n, 25);
+        long long sum = hit;
+        start = Clock::now();
+        for (size_t i = 0; i < lookups; i++)
+        {
+            sum += mapped.find(2 * probes[i % n]) -> second;
+        }
+        double mappedNs = nsPerOp(start, lookups);
+        start = Clock::now();
+        for (size_t i = 0; i < lookups; i++)
+        {
+            sum += tree.find(2 * probes[i % n]) -> second;
+        }
+        double avlNs = nsPerOp(start, lookups);
+
+        cout << "mapped n=" << n << " file_mb=" << (MappedTreeHeader::headerBytes + n * sizeof(MappedNode<int, int>)) / 1e6
+             << " write_ms=" << writeNs / 1e6 << " open_us=" << openNs / 1e3
+             << " first_find_us=" << firstNs / 1e3 << " first_find_faults=" << firstFaults
+             << " deserialize_ms=" << deserializeNs / 1e6
+             << " mapped_find_ns=" << mappedNs << " avl_find_ns=" << avlNs
+             << " checksum=" << sum << endl;
+    }
+    remove(path);
+}
+
+/**
+* Keys drawn from a Zipfian distribution over [0, items) with skew theta,
+* using the generator from Gray et al. ("Quickly generating billion-record
+* synthetic databases") as YCSB does: O(items) setup, O(1) per key. Ranks
+* are scattered over the key space so the hot keys are not all adjacent.
+*/
+class ZipfKeys
+{
+public:
+    ZipfKeys(size_t items, double theta, unsigned seed)
+        : items_(items), theta_(theta), random_(seed)
+    {
+        zetan_ = 0;
+        for (size_t i = 1; i <= items; i++)
+        {
+            zetan_ += 1.0 / pow(static_cast<double>(i), theta);
+        }
+        double zeta2 = 1.0 + pow(0.5, theta);
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1.0 - pow(2.0 / items, 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+    }
+
+    int next()
+    {
+        double u = uniform_(random_);
+        double uz = u * zetan_;
+        size_t rank;
+        if (uz < 1.0)
+        {
+            rank = 0;
+        }
+        else if (uz < 1.0 + pow(0.5, theta_))
+        {
+            rank = 1;
+        }
+        else
+        {
+            rank = static_cast<size_t>(items_ * pow(eta_ * u - eta_ + 1.0, alpha_));
+        }
+        return static_cast<int>((rank % items_) * 2654435761ULL % items_);
+    }
+
+private:
+    size_t items_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+    mt19937 random_;
+    uniform_real_distribution<double> uniform_;
+};
+
+/**
+* std::map under the remove() name the trees use, so the workloads can
+* drive all three through one template.
+*/
+struct MapTree : map<int, int>
+{
+    void remove(int key)
+    {
+        erase(key);
+    }
+};
+
+/**
+* Resident set size of this process in bytes, from /proc/self/statm; 0
+* where that is not available.
+*/
+size_t residentBytes()
+{
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL)
+    {
+        return 0;
+    }
+    unsigned long size = 0, resident = 0;
+    if (fscanf(statm, "%lu %lu", &size, &resident) != 2)
+    {
+        resident = 0;
+    }
+    fclose(statm);
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+/**
+* The mixed workloads: the tree starts with n random keys out of [0, 2n),
+* then runs n operations on keys drawn from the same range, uniformly or
+* Zipfian. Removes take the remaining share.
+*/
+struct WorkloadMix
+{
+    const char* name;
+    int findPercent;
+    int insertPercent;
+    bool zipfian;
+};
+
+const WorkloadMix workloadMixes[] = {
+    { "zipfian", 90, 10, true },
+    { "read-heavy", 95, 5, false },
+    { "write-heavy", 20, 40, false },
+    { "delete-heavy", 10, 10, false },
+};
+
+const char* const workloadNames[] = {
+    "sequential", "random", "zipfian", "read-heavy", "write-heavy", "delete-heavy"
+};
+
+const size_t workloadCount = sizeof(workloadNames) / sizeof(workloadNames[0]);
+
+struct WorkloadResult
+{
+    size_t ops;
+    double ns;
+    double bytesPerEntry;
+    long long checksum;
+};
+
+/**
+* Runs one workload against a fresh Tree of n entries. sequential and
+* random time the build (ascending or shuffled inserts) followed by n
+* finds; the mixes time only their operations. Bytes per entry is the
+* growth in resident memory across the build.
+*/
+template<typename Tree>
+WorkloadResult runWorkload(size_t workload, size_t n)
+{
+    WorkloadResult result = { 0, 0, 0, 0 };
+    vector<int> keys = shuffledKeys(workload < 2 ? n : 2 * n, 31);
+    keys.resize(n);
+    vector<int> probes = workload < 2 ? shuffledKeys(n, 34) : vector<int>();
+    if (workload == 0)
+    {
+        sort(keys.begin(), keys.end());
+        sort(probes.begin(), probes.end());
+    }
+
+    // the mixes' operations, drawn before anything is measured
+    vector<pair<char, int> > ops;
+    if (workload >= 2)
+    {
+        const WorkloadMix& mix = workloadMixes[workload - 2];
+        mt19937 random(32);
+        uniform_int_distribution<int> percent(0, 99);
+        uniform_int_distribution<int> uniform(0, static_cast<int>(2 * n - 1));
+        ZipfKeys zipf(2 * n, 0.99, 33);
+        ops.resize(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            int roll = percent(random);
+            char kind = roll < mix.findPercent ? 'f' : roll < mix.findPercent + mix.insertPercent ? 'i' : 'r';
+            ops[i] = make_pair(kind, mix.zipfian ? zipf.next() : uniform(random));
+        }
+    }
+
+    Tree tree;
+    size_t before = residentBytes();
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < n; i++)
+    {
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    double buildNs = nsPerOp(start, 1);
+    size_t after = residentBytes();
+    result.bytesPerEntry = after > before ? static_cast<double>(after - before) / n : 0;
+
+    long long sum = 0;
+    start = Clock::now();
+    if (workload < 2)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            typename Tree::iterator it = tree.find(probes[i]);
+            sum += it != tree.end() ? it->second : 0;
+        }
+        result.ops = 2 * n;
+        result.ns = buildNs + nsPerOp(start, 1);
+    }
+    else
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            if (ops[i].first == 'f')
+            {
+                typename Tree::iterator it = tree.find(ops[i].second);
+                sum += it != tree.end() ? it->second : 0;
+            }
+            else if (ops[i].first == 'i')
+            {
+                tree.insert(make_pair(ops[i].second, ops[i].second));
+            }
+            else
+            {
+                tree.remove(ops[i].second);
+            }
+        }
+        result.ops = n;
+        result.ns = nsPerOp(start, 1);
+    }
+    result.checksum = sum + static_cast<long long>(tree.size());
+    return result;
+}
+
+/**
+* Runs one row of the workload matrix and prints it in format ("csv" or
+* "json"); first says whether a JSON separator is needed.
+*/
+void workloadRow(const char* treeName, size_t workload, size_t n, const char* format, bool first)
+{
+    WorkloadResult result;
+    if (strcmp(treeName, "bst") == 0)
+    {
+        result = runWorkload<BinarySearchTree<int, int> >(workload, n);
+    }
+    else if (strcmp(treeName, "avl") == 0)
+    {
+        result = runWorkload<AVLTree<int, int> >(workload, n);
+    }
+    else
+    {
+        result = runWorkload<MapTree>(workload, n);
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double perOp = result.ns / result.ops;
+    const char* allocator = strcmp(treeName, "map") == 0 ? "std" : NodeArena::pooled ? "slab" : "heap";
+    if (strcmp(format, "json") == 0)
+    {
+        cout << (first ? "  " : ",\n  ")
+             << "{\"tree\": \"" << treeName << "\", \"allocator\": \"" << allocator
+             << "\", \"workload\": \"" << workloadNames[workload] << "\", \"n\": " << n
+             << ", \"ops\": " << result.ops << ", \"ops_per_s\": " << 1e9 / perOp
+             << ", \"ns_per_op\": " << perOp << ", \"peak_rss_kb\": " << usage.ru_maxrss
+             << ", \"bytes_per_entry\": " << result.bytesPerEntry
+             << ", \"checksum\": " << result.checksum << "}";
+    }
+    else
+    {
+        cout << treeName << "," << allocator << "," << workloadNames[workload] << "," << n
+             << "," << result.ops << "," << 1e9 / perOp << "," << perOp
+             << "," << usage.ru_maxrss << "," << result.bytesPerEntry
+             << "," << result.checksum << "\n";
+    }
+    cout.flush();
+}
+
+/**
+* The workload matrix: BinarySearchTree, AVLTree and std::map through
+* sequential, random, Zipfian, read-heavy, write-heavy and delete-heavy
+* workloads at n = 1e3 up to maxN (1e6 unless given), as CSV (the
+* default) or a JSON array on stdout:
+*
+*   ./bst-bench workloads [csv|json] [maxN]
+*
+* Each row runs in its own child process so peak RSS belongs to that row
+* alone. The unbalanced tree is skipped for sequential input above 1e4
+* keys, where it degenerates into a list.
+*/
+void benchWorkloads(const char* format, size_t maxN)
+{
+    const char* const trees[] = { "bst", "avl", "map" };
+    bool json = strcmp(format, "json") == 0;
+    if (json)
+    {
+        cout << "[\n";
+    }
+    else
+    {
+        cout << "tree,allocator,workload,n,ops,ops_per_s,ns_per_op,peak_rss_kb,bytes_per_entry,checksum\n";
+    }
+    cout.flush();
+    bool first = true;
+    for (size_t n = 1000; n <= maxN; n *= 10)
+    {
+        for (size_t workload = 0; workload < workloadCount; workload++)
+        {
+            for (size_t t = 0; t < 3; t++)
+            {
+                if (workload == 0 && n > 10000 && strcmp(trees[t], "bst") == 0)
+                {
+                    continue;
+                }
+                pid_t child = fork();
+                if (child == 0)
+                {
+                    workloadRow(trees[t], workload, n, format, first);
+                    _exit(0);
+                }
+                if (child < 0)
+                {
+                    workloadRow(trees[t], workload, n, format, first);
+                }
+                else
+                {
+                    int status = 0;
+                    waitpid(child, &status, 0);
+                }
+                first = false;
+            }
+        }
+    }
+    if (json)
+    {
+        cout << "\n]\n";
+    }
+    cout.flush();
+}
+
+/**
+* Structural counters per operation for random inserts, finds and removes:
+* comparisons, nodes visited per descent, rotations, fix-up depth, node
+* swaps and allocations. Needs a build with BST_STATS (bst-bench-stats).
+*/
+template<typename Tree>
+void statsRun(const char* treeName, size_t n)
+{
+    vector<int> keys = shuffledKeys(n, 41);
+    vector<int> probes = shuffledKeys(n, 42);
+    Tree tree;
+    const char* phases[] = { "insert", "find", "remove" };
+    for (int phase = 0; phase < 3; phase++)
+    {
+        Tree::resetStats();
+        long long sum = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (phase == 0)
+            {
+                tree.insert(make_pair(keys[i], keys[i]));
+            }
+            else if (phase == 1)
+            {
+                sum += tree.find(probes[i])->second;
+            }
+            else
+            {
+                tree.remove(probes[i]);
+            }
+        }
+        TreeStats stats = Tree::stats();
+        cout << "stats tree=" << treeName << " n=" << n << " op=" << phases[phase]
+             << " compares_per_op=" << static_cast<double>(stats.comparisons) / n
+             << " visited_per_descent=" << stats.visitedPerDescent()
+             << " rotations_per_op=" << static_cast<double>(stats.rotateLeft + stats.rotateRight) / n
+             << " insert_fix_depth=" << (stats.insertFixRuns == 0 ? 0 : static_cast<double>(stats.insertFixCalls) / stats.insertFixRuns)
+             << " insert_fix_max=" << stats.insertFixMaxDepth
+             << " remove_fix_depth=" << (stats.removeFixRuns == 0 ? 0 : static_cast<double>(stats.removeFixCalls) / stats.removeFixRuns)
+             << " remove_fix_max=" << stats.removeFixMaxDepth
+             << " swaps=" << stats.nodeSwaps << " allocations=" << stats.allocations
+             << " frees=" << stats.frees << " checksum=" << sum << endl;
+    }
+}
+
+void benchStats()
+{
+    if (!TreeStats::enabled)
+    {
+        cout << "stats disabled (build bst-bench-stats)" << endl;
+        return;
+    }
+    for (size_t n = 100000; n <= 1000000; n *= 10)
+    {
+        statsRun<BinarySearchTree<int, int> >("bst", n);
+        statsRun<AVLTree<int, int> >("avl", n);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* only = argc > 1 ? argv[1] : NULL;
+    if (only == NULL || strcmp(only, "alloc") == 0)
+    {
+        benchAlloc();
+    }
+    if (only == NULL || strcmp(only, "layout") == 0)
+    {
+        benchLayout();
+    }
+    if (only == NULL || strcmp(only, "bulk") == 0)
+    {
+        benchBulk();
+    }
+    if (only == NULL || strcmp(only, "batch") == 0)
+    {
+        benchBatch();
+    }
+    if (only == NULL || strcmp(only, "freeze") == 0)
+    {
+        benchFreeze();
+    }
+    if (only == NULL || strcmp(only, "engines") == 0)
+    {
+        benchEngines();
+    }
+    if (only == NULL || strcmp(only, "splitjoin") == 0)
+    {
+        benchSplitJoin();
+    }
+    if (only == NULL || strcmp(only, "setops") == 0)
+    {
+        benchSetOps();
+    }
+    if (only == NULL || strcmp(only, "order") == 0)
+    {
+        benchOrder();
+    }
+    if (only == NULL || strcmp(only, "bounds") == 0)
+    {
+        benchBounds();
+    }
+    if (only == NULL || strcmp(only, "strings") == 0)
+    {
+        benchStrings();
+    }
+    if (only == NULL || strcmp(only, "moves") == 0)
+    {
+        benchMoves();
+    }
+    if (only == NULL || strcmp(only, "remove") == 0)
+    {
+        benchRemove();
+    }
+    if (only == NULL || strcmp(only, "validate") == 0)
+    {
+        benchValidate();
+    }
+    if (only == NULL || strcmp(only, "teardown") == 0)
+    {
+        benchTeardown();
+    }
+    if (only == NULL || strcmp(only, "concurrent") == 0)
+    {
+        benchConcurrent();
+    }
+    if (only == NULL || strcmp(only, "persistent") == 0)
+    {
+        benchPersistent();
+    }
+    if (only == NULL || strcmp(only, "clone") == 0)
+    {
+        benchClone();
+    }
+    if (only == NULL || strcmp(only, "hint") == 0)
+    {
+        benchHint();
+    }
+    if (only == NULL || strcmp(only, "scan") == 0)
+    {
+        benchScan();
+    }
+    if (only == NULL || strcmp(only, "serialize") == 0)
+    {
+        benchSerialize();
+    }
+    if (only == NULL || strcmp(only, "mapped") == 0)
+    {
+        benchMapped();
+    }
+    if (only == NULL || strcmp(only, "workloads") == 0)
+    {
+        benchWorkloads(argc > 2 ? argv[2] : "csv", argc > 3 ? strtoul(argv[3], NULL, 10) : 1000000);
+    }
+    if (only == NULL || strcmp(only, "stats") == 0)
+    {
+        benchStats();
+    }
+    return 0;
+}
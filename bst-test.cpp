@@ -1,10 +1,1241 @@
+#include <atomic>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
 #include "bst.h"
 #include "avlbst.h"
+#include "bplustree.h"
+#include "concurrentavl.h"
+#include "persistentavl.h"
 
 using namespace std;
 
+static int failures = 0;
+
+// Moves hand over the nodes and the arena and allocate nothing, so they
+// cannot throw; containers of trees rely on that to move instead of copy.
+static_assert(std::is_nothrow_move_constructible<BinarySearchTree<int, int> >::value, "BST move must be noexcept");
+static_assert(std::is_nothrow_move_assignable<BinarySearchTree<int, int> >::value, "BST move must be noexcept");
+static_assert(std::is_nothrow_move_constructible<AVLTree<int, int> >::value, "AVLTree move must be noexcept");
+static_assert(std::is_nothrow_move_assignable<AVLTree<int, int> >::value, "AVLTree move must be noexcept");
+
+// Prints one named result and remembers failures for the exit status.
+void check(const char* name, bool ok)
+{
+    cout << name << ": " << ok << endl;
+    if (!ok)
+    {
+        failures++;
+    }
+}
+
+// The key an iterator of a tree or std::map points at, or -1 at end().
+template<typename Container, typename It>
+int keyOrNone(Container& container, It it)
+{
+    return it == container.end() ? -1 : it->first;
+}
+
+// Runs the same insert/overwrite/remove workload through any engine with
+// the BinarySearchTree surface and checks the result against std::map.
+template<typename Tree>
+bool matchesMap()
+{
+    Tree tree;
+    map<int, int> expected;
+    unsigned state = 12345;
+    for (int i = 0; i < 20000; i++)
+    {
+        state = state * 1103515245 + 12345;
+        int key = (state >> 8) % 2000;
+        if (i % 3 == 2)
+        {
+            tree.remove(key);
+            expected.erase(key);
+        }
+        else
+        {
+            tree.insert(std::make_pair(key, i));
+            expected[key] = i;
+        }
+    }
+    typename Tree::iterator it = tree.begin();
+    for (map<int, int>::iterator exp = expected.begin(); exp != expected.end(); ++exp, ++it)
+    {
+        if (it == tree.end() || it->first != exp->first || it->second != exp->second) {
+            return false;
+        }
+    }
+    return it == tree.end();
+}
+
+// True when the tree holds exactly the entries of expected, in order, and
+// its structure passes validate().
+template<typename Tree>
+bool sameAsMap(const Tree& tree, const map<int, int>& expected)
+{
+    if (tree.size() != expected.size() || !tree.validate().valid)
+    {
+        return false;
+    }
+    typename Tree::const_iterator it = tree.begin();
+    for (map<int, int>::const_iterator exp = expected.begin(); exp != expected.end(); ++exp, ++it)
+    {
+        if (it == tree.end() || it->first != exp->first || it->second != exp->second)
+        {
+            return false;
+        }
+    }
+    return it == tree.end();
+}
+
+// assignSorted on sorted input with runs of equal keys must match std::map
+// (last value wins) in a tree of minimal height; out-of-order input must
+// throw and leave the tree empty.
+template<typename Tree>
+bool assignSortedMatchesMap()
+{
+    for (int n = 0; n <= 1100; n += 157)
+    {
+        vector<pair<int, int> > items;
+        map<int, int> expected;
+        for (int i = 0; i < n; i++)
+        {
+            items.push_back(std::make_pair(i / 3 * 2, i));
+            expected[i / 3 * 2] = i;
+        }
+        Tree tree;
+        tree.insert(std::make_pair(-5, -5));
+        tree.assignSorted(items.begin(), items.end());
+        int minimal = 0;
+        while ((std::size_t(1) << minimal) <= expected.size())
+        {
+            minimal++;
+        }
+        if (!sameAsMap(tree, expected) || tree.validate().height != minimal)
+        {
+            return false;
+        }
+    }
+    vector<pair<int, int> > unsorted;
+    unsorted.push_back(std::make_pair(1, 1));
+    unsorted.push_back(std::make_pair(3, 3));
+    unsorted.push_back(std::make_pair(2, 2));
+    Tree tree;
+    tree.insert(std::make_pair(7, 7));
+    try
+    {
+        tree.assignSorted(unsorted.begin(), unsorted.end());
+    }
+    catch (const std::invalid_argument&)
+    {
+        return tree.empty() && tree.size() == 0 && tree.begin() == tree.end();
+    }
+    return false;
+}
+
+// A value whose copies start throwing once copiesLeft (when not negative)
+// runs out; the string lets a leak checker see any node that is not freed.
+struct CopyLimited
+{
+    static int copiesLeft;
+
+    explicit CopyLimited(const string& t = string()) : text(t)
+    {
+    }
+
+    CopyLimited(const CopyLimited& other) : text(other.text)
+    {
+        if (copiesLeft == 0)
+        {
+            throw runtime_error("copy limit reached");
+        }
+        if (copiesLeft > 0)
+        {
+            copiesLeft--;
+        }
+    }
+
+    CopyLimited(CopyLimited&& other) = default;
+    CopyLimited& operator=(const CopyLimited& other) = default;
+    CopyLimited& operator=(CopyLimited&& other) = default;
+
+    string text;
+};
+
+int CopyLimited::copiesLeft = -1;
+
+// assignSorted that throws while copying an entry frees the nodes it has
+// built and leaves the tree empty; then it works again.
+template<typename Tree>
+bool assignSortedCleansUpOnThrow()
+{
+    vector<pair<int, CopyLimited> > items;
+    for (int i = 0; i < 200; i++)
+    {
+        items.push_back(std::make_pair(i, CopyLimited(string(40, 'a' + i % 26))));
+    }
+    Tree tree;
+    tree.insert(std::make_pair(-1, CopyLimited("old")));
+    CopyLimited::copiesLeft = 150;
+    bool threw = false;
+    try
+    {
+        tree.assignSorted(items.begin(), items.end());
+    }
+    catch (const runtime_error&)
+    {
+        threw = true;
+    }
+    CopyLimited::copiesLeft = -1;
+    if (!threw || !tree.empty() || tree.begin() != tree.end() || !tree.validate().valid)
+    {
+        return false;
+    }
+    tree.assignSorted(items.begin(), items.end());
+    return tree.size() == items.size() && tree.validate().valid;
+}
+
+// insert_range with unsorted batches, small and large relative to the
+// tree, holding repeated keys and keys already present: the result must
+// match inserting the batch into std::map one pair at a time.
+template<typename Tree>
+bool insertRangeMatchesMap()
+{
+    int sizes[] = { 0, 1, 10, 500, 6000 };
+    for (int s = 0; s < 5; s++)
+    {
+        Tree tree;
+        map<int, int> expected;
+        for (int i = 0; i < 3000; i++)
+        {
+            int key = (i * 7919) % 9000;
+            tree.insert(std::make_pair(key, i));
+            expected[key] = i;
+        }
+        vector<pair<int, int> > batch;
+        for (int i = 0; i < sizes[s]; i++)
+        {
+            int key = (i * 104729) % (sizes[s] / 2 + 1) * 3;
+            batch.push_back(std::make_pair(key, -i));
+            expected[key] = -i;
+        }
+        tree.insert_range(batch.begin(), batch.end());
+        if (!sameAsMap(tree, expected))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Hinted insert with good hints (the previous entry, end()), bad hints
+// (begin(), an entry far away) and repeated keys: the contents must match
+// std::map, the returned iterator must point at the key, and the tree must
+// stay valid.
+template<typename Tree>
+bool hintedInsertMatchesMap()
+{
+    Tree tree;
+    map<int, int> expected;
+    typename Tree::iterator last = tree.end();
+    for (int i = 0; i < 4000; i++)
+    {
+        // mostly ascending, with every seventh key jumping back
+        int key = i % 7 == 6 ? (i * 7919) % 4000 : i;
+        typename Tree::const_iterator hint;
+        switch (i % 4)
+        {
+            case 0: hint = last; break;
+            case 1: hint = tree.end(); break;
+            case 2: hint = tree.begin(); break;
+            default: hint = tree.find(key / 2); break;
+        }
+        last = i % 2 == 0 ? tree.insert(hint, std::make_pair(key, i)) : tree.insert(hint, std::pair<const int, int>(key, i));
+        expected[key] = i;
+        if (last == tree.end() || last->first != key || last->second != i)
+        {
+            return false;
+        }
+    }
+    return sameAsMap(tree, expected);
+}
+
+// Walks the tree backwards three ways (operator-- from end(), postfix --,
+// reverse_iterator and const_reverse_iterator) and compares each walk with
+// std::map in reverse; also checks the empty tree and round trips of ++/--.
+template<typename Tree>
+bool reverseWalksMatchMap()
+{
+    Tree empty;
+    const Tree& constEmpty = empty;
+    if (empty.begin() != empty.end() || empty.rbegin() != empty.rend() || constEmpty.crbegin() != constEmpty.crend())
+    {
+        return false;
+    }
+
+    Tree tree;
+    map<int, int> expected;
+    for (int i = 0; i < 2000; i++)
+    {
+        int key = (i * 7919) % 3001;
+        tree.insert(std::make_pair(key, i));
+        expected[key] = i;
+    }
+    const Tree& constTree = tree;
+
+    map<int, int>::reverse_iterator exp = expected.rbegin();
+    typename Tree::iterator it = tree.end();
+    typename Tree::const_iterator postfix = constTree.end();
+    typename Tree::reverse_iterator rit = tree.rbegin();
+    typename Tree::const_reverse_iterator crit = constTree.crbegin();
+    for (; exp != expected.rend(); ++exp, ++rit, ++crit)
+    {
+        --it;
+        postfix--;
+        if (it->first != exp->first || postfix->first != exp->first ||
+            rit == tree.rend() || rit->first != exp->first || crit->second != exp->second)
+        {
+            return false;
+        }
+        typename Tree::iterator copy = it;
+        if (++copy != std::next(it) || --copy != it || typename Tree::const_iterator(it) != postfix)
+        {
+            return false;
+        }
+    }
+    if (it != tree.begin() || rit != tree.rend() || crit != constTree.crend())
+    {
+        return false;
+    }
+    // iterators survive writes through them
+    for (typename Tree::reverse_iterator w = tree.rbegin(); w != tree.rend(); ++w)
+    {
+        w->second = -w->second;
+    }
+    return std::prev(tree.end())->first == expected.rbegin()->first
+        && std::prev(tree.end())->second == -expected.rbegin()->second;
+}
+
+// Moving a tree carries its entries over; the moved-from tree is empty and
+// still usable, and moving into a tree that holds entries frees them.
+template<typename Tree>
+bool movesMatchMap()
+{
+    Tree source;
+    map<int, int> expected;
+    for (int i = 0; i < 1000; i++)
+    {
+        source.insert(std::make_pair((i * 7919) % 1503, i));
+        expected[(i * 7919) % 1503] = i;
+    }
+    Tree moved(std::move(source));
+    if (!sameAsMap(moved, expected) || !sameAsMap(source, map<int, int>()))
+    {
+        return false;
+    }
+    source.insert(std::make_pair(5, 5));
+    Tree target;
+    target.insert(std::make_pair(1, 1));
+    target = std::move(moved);
+    moved = std::move(source);
+    vector<Tree> trees;
+    trees.push_back(std::move(target));
+    trees.resize(8);    // reallocation moves the elements
+    return sameAsMap(trees[0], expected) && moved.size() == 1 && moved.find(5) != moved.end()
+        && source.empty() && source.begin() == source.end();
+}
+
+// True if a persistent tree holds exactly the entries of expected.
+bool persistentSameAsMap(const PersistentAVLTree<int, int>& tree, const map<int, int>& expected)
+{
+    if (tree.size() != expected.size())
+    {
+        return false;
+    }
+    map<int, int>::const_iterator exp = expected.begin();
+    for (PersistentAVLTree<int, int>::const_iterator it = tree.begin(); it != tree.end(); ++it, ++exp)
+    {
+        if (it->first != exp->first || it->second != exp->second)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Takes several snapshots of a persistent tree as it changes, each paired
+// with a copy of std::map at that moment, then writes to every snapshot and
+// to the original; no write may show up in any other version.
+bool persistentSnapshotsMatchMap()
+{
+    PersistentAVLTree<int, int> tree;
+    map<int, int> expected;
+    vector<PersistentAVLTree<int, int> > snapshots;
+    vector<map<int, int> > expectedSnapshots;
+    for (int round = 0; round < 6; round++)
+    {
+        for (int i = 0; i < 400; i++)
+        {
+            int key = (round * 4001 + i * 7919) % 2003;
+            if (i % 5 == 4)
+            {
+                tree.remove(key);
+                expected.erase(key);
+            }
+            else
+            {
+                tree.insert(std::make_pair(key, round * 1000 + i));
+                expected[key] = round * 1000 + i;
+            }
+        }
+        snapshots.push_back(tree.snapshot());
+        expectedSnapshots.push_back(expected);
+    }
+    for (size_t s = 0; s < snapshots.size(); s++)
+    {
+        if (!persistentSameAsMap(snapshots[s], expectedSnapshots[s]))
+        {
+            return false;
+        }
+    }
+
+    for (size_t s = 0; s < snapshots.size(); s++)
+    {
+        for (int i = 0; i < 150; i++)
+        {
+            int key = (int(s) * 131 + i * 17) % 2500;
+            if (i % 3 == 0)
+            {
+                snapshots[s].remove(key);
+                expectedSnapshots[s].erase(key);
+            }
+            else
+            {
+                snapshots[s].insert(std::make_pair(key, -i));
+                expectedSnapshots[s][key] = -i;
+            }
+        }
+    }
+    for (int i = 0; i < 300; i++)
+    {
+        tree.insert(std::make_pair(i * 3, i));
+        expected[i * 3] = i;
+        tree.remove(i * 7);
+        expected.erase(i * 7);
+    }
+    for (size_t s = 0; s < snapshots.size(); s++)
+    {
+        if (!persistentSameAsMap(snapshots[s], expectedSnapshots[s]))
+        {
+            return false;
+        }
+    }
+
+    // assigning a version over one that has copied starts its count again
+    if (snapshots[1].copyCount() == 0)
+    {
+        return false;
+    }
+    snapshots[1] = snapshots[0];
+    return persistentSameAsMap(tree, expected) && snapshots[1].copyCount() == 0
+        && persistentSameAsMap(snapshots[1], expectedSnapshots[0]);
+}
+
+// Checks one version of a concurrent tree: keys strictly increasing, every
+// value 3 * key (the only value the writer ever stores), find agreeing
+// with iteration, and every multiple of 10 below keyRange present, since
+// the writer never removes those.
+bool concurrentViewConsistent(const ConcurrentAVLTree<int, int>& tree, int keyRange)
+{
+    ConcurrentAVLTree<int, int>::ReadView view = tree.read();
+    int previous = -1;
+    int tens = 0;
+    for (ConcurrentAVLTree<int, int>::const_iterator it = view.begin(); it != view.end(); ++it)
+    {
+        const int* found = view.find(it->first);
+        if (it->first <= previous || it->second != 3 * it->first || found == nullptr || *found != it->second)
+        {
+            return false;
+        }
+        tens += it->first % 10 == 0;
+        previous = it->first;
+    }
+    return tens == keyRange / 10 && view.find(-5) == nullptr;
+}
+
+// Several readers check versions of a ConcurrentAVLTree while one writer
+// churns it with a fixed sequence of inserts and removes; the final
+// contents must then match std::map given the same sequence.
+bool concurrentReadersMatchMap()
+{
+    const int keyRange = 4000;
+    ConcurrentAVLTree<int, int> tree;
+    map<int, int> expected;
+    for (int key = 0; key < keyRange; key += 10)
+    {
+        tree.insert(std::make_pair(key, 3 * key));
+        expected[key] = 3 * key;
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<int> badViews(0);
+    std::atomic<int> views(0);
+    vector<std::thread> readers;
+    for (int r = 0; r < 3; r++)
+    {
+        readers.push_back(std::thread([&]() {
+            do
+            {
+                if (!concurrentViewConsistent(tree, keyRange))
+                {
+                    badViews++;
+                }
+                views++;
+            } while (!done.load());
+        }));
+    }
+
+    for (int i = 0; i < 20000; i++)
+    {
+        int key = (i * 7919) % keyRange;
+        if (key % 10 == 0)
+        {
+            key++;
+        }
+        if (i % 3 == 2)
+        {
+            tree.remove(key);
+            expected.erase(key);
+        }
+        else
+        {
+            tree.insert(std::make_pair(key, 3 * key));
+            expected[key] = 3 * key;
+        }
+    }
+    done.store(true);
+    for (size_t r = 0; r < readers.size(); r++)
+    {
+        readers[r].join();
+    }
+    tree.reclaim();
+
+    ConcurrentAVLTree<int, int>::ReadView view = tree.read();
+    map<int, int>::const_iterator exp = expected.begin();
+    for (ConcurrentAVLTree<int, int>::const_iterator it = view.begin(); it != view.end(); ++it, ++exp)
+    {
+        if (exp == expected.end() || it->first != exp->first || it->second != exp->second)
+        {
+            return false;
+        }
+    }
+    return badViews.load() == 0 && views.load() >= 3 && exp == expected.end()
+        && tree.size() == expected.size() && tree.retiredCount() == 0;
+}
+
+// Runs check on a thread whose stack is only stackBytes long, so that any
+// recursion as deep as a tree is tall overflows it.
+template<typename Check>
+bool onSmallStack(size_t stackBytes, Check check)
+{
+    struct Call
+    {
+        static void* run(void* arg)
+        {
+            Check& body = *static_cast<Check*>(arg);
+            return body() ? arg : nullptr;
+        }
+    };
+    pthread_attr_t attr;
+    pthread_t thread;
+    void* result = nullptr;
+    if (pthread_attr_init(&attr) != 0 || pthread_attr_setstacksize(&attr, stackBytes) != 0 ||
+        pthread_create(&thread, &attr, &Call::run, &check) != 0)
+    {
+        return false;
+    }
+    pthread_attr_destroy(&attr);
+    pthread_join(thread, &result);
+    return result != nullptr;
+}
+
+// Sorted inserts make an unbalanced tree one long chain. Copying, clearing
+// and destroying it must not recurse down the chain, which would overflow
+// a 256 KB stack long before the end.
+bool sortedChainSurvivesTeardown()
+{
+    return onSmallStack(256 * 1024, []() {
+        const int n = 30000;
+        BinarySearchTree<int, string>* chain = new BinarySearchTree<int, string>;
+        for (int i = 0; i < n; i++)
+        {
+            chain->insert(std::make_pair(i, string(24, 'c')));
+        }
+        BinarySearchTree<int, string> copy(*chain);
+        BinarySearchTree<int, string> assigned;
+        assigned = copy;
+        bool ok = copy.size() == size_t(n) && assigned.size() == size_t(n)
+            && std::prev(assigned.end())->first == n - 1;
+        delete chain;
+        copy.clear();
+        ok = ok && copy.empty();
+        copy.insert(std::make_pair(1, string("again")));
+        return ok && copy.size() == 1;
+    });
+}
+
+// freeze() of trees of every size up to a few hundred answers find,
+// lower_bound and operator[] as std::map does, for present keys (even),
+// absent ones (odd) and keys beyond both ends.
+bool frozenMatchesMap()
+{
+    for (int n = 0; n <= 300; n++)
+    {
+        AVLTree<int, int> tree;
+        map<int, int> expected;
+        for (int i = 0; i < n; i++)
+        {
+            tree.insert(std::make_pair(2 * i, i));
+            expected[2 * i] = i;
+        }
+        FrozenTree<int, int> frozen = tree.freeze();
+        if (frozen.size() != expected.size() || frozen.empty() != expected.empty() ||
+            !std::equal(expected.begin(), expected.end(), frozen.begin(),
+                        [](const pair<const int, int>& a, const pair<int, int>& b) { return a.first == b.first && a.second == b.second; }))
+        {
+            return false;
+        }
+        for (int key = -3; key <= 2 * n + 2; key++)
+        {
+            if (keyOrNone(frozen, frozen.find(key)) != keyOrNone(expected, expected.find(key)) ||
+                keyOrNone(frozen, frozen.lower_bound(key)) != keyOrNone(expected, expected.lower_bound(key)))
+            {
+                return false;
+            }
+            bool threw = false;
+            try
+            {
+                if (frozen[key] != expected.at(key))
+                {
+                    return false;
+                }
+            }
+            catch (const out_of_range&)
+            {
+                threw = true;
+            }
+            if (threw != (expected.count(key) == 0))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// emplace, try_emplace and insert_or_assign against std::map (spelled
+// with C++11 calls, since this test builds as C++11), with vector values: the (iterator, bool) results must agree, emplace and
+// try_emplace must leave an existing value alone, insert_or_assign must
+// overwrite it, and try_emplace must build the value from all its arguments.
+template<typename Tree>
+bool emplaceMatchesMap()
+{
+    Tree tree;
+    map<int, vector<int> > expected;
+    for (int i = 0; i < 600; i++)
+    {
+        int key = (i * 7919) % 211;
+        std::pair<typename Tree::iterator, bool> got;
+        std::pair<map<int, vector<int> >::iterator, bool> want;
+        switch (i % 4)
+        {
+        case 0:
+            got = tree.emplace(key, vector<int>(1, i));
+            want = expected.emplace(key, vector<int>(1, i));
+            break;
+        case 1:
+            got = tree.try_emplace(key, size_t(i % 5 + 1), i);
+            want = expected.insert(std::make_pair(key, vector<int>(size_t(i % 5 + 1), i)));
+            break;
+        case 2:
+            got = tree.try_emplace(int(key), vector<int>(2, -i));
+            want = expected.insert(std::make_pair(key, vector<int>(2, -i)));
+            break;
+        default:
+            got = tree.insert_or_assign(key, vector<int>(3, i));
+            want = expected.insert(std::make_pair(key, vector<int>(3, i)));
+            want.first->second = vector<int>(3, i);
+            break;
+        }
+        if (got.second != want.second || got.first == tree.end() ||
+            got.first->first != key || got.first->second != want.first->second)
+        {
+            return false;
+        }
+    }
+    if (tree.size() != expected.size() || !tree.validate().valid)
+    {
+        return false;
+    }
+    map<int, vector<int> >::const_iterator exp = expected.begin();
+    for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it, ++exp)
+    {
+        if (it->first != exp->first || it->second != exp->second)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if every counter of a snapshot is zero.
+bool statsAreZero(const TreeStats& stats)
+{
+    return stats.comparisons == 0 && stats.descents == 0 && stats.nodesVisited == 0
+        && stats.rotateLeft == 0 && stats.rotateRight == 0
+        && stats.insertFixCalls == 0 && stats.insertFixRuns == 0 && stats.insertFixMaxDepth == 0
+        && stats.removeFixCalls == 0 && stats.removeFixRuns == 0 && stats.removeFixMaxDepth == 0
+        && stats.nodeSwaps == 0 && stats.allocations == 0 && stats.frees == 0;
+}
+
+// With BST_STATS, n sequential AVL inserts allocate n nodes and rotate,
+// and resetStats() zeroes everything; without it the counters always read
+// zero.
+bool statsCountInserts()
+{
+    const int n = 1000;
+    AVLTree<int, int>::resetStats();
+    if (!statsAreZero(AVLTree<int, int>::stats()))
+    {
+        return false;
+    }
+    TreeStats counted;
+    {
+        AVLTree<int, int> tree;
+        for (int i = 0; i < n; i++)
+        {
+            tree.insert(std::make_pair(i, i));
+        }
+        counted = AVLTree<int, int>::stats();
+    }
+#ifdef BST_STATS
+    bool ok = TreeStats::enabled && counted.allocations == std::uint64_t(n)
+        && counted.rotateLeft > 0 && counted.insertFixRuns > 0 && counted.comparisons > 0;
+#else
+    bool ok = !TreeStats::enabled && statsAreZero(counted);
+#endif
+    AVLTree<int, int>::resetStats();
+    return ok && statsAreZero(AVLTree<int, int>::stats());
+}
+
+// The trees join() and unionWith() empty keep no share of the result's
+// arena, so another thread may refill them while the result is updated.
+// (Under -fsanitize=thread a shared free list shows up as a race.)
+bool emptiedOperandsAreIndependent()
+{
+    AVLTree<int, int> left, right, joined, result, other;
+    map<int, int> expected;
+    for (int i = 0; i < 2000; i++)
+    {
+        left.insert(std::make_pair(i, i));
+        right.insert(std::make_pair(5000 + i, i));
+        result.insert(std::make_pair(2 * i, i));
+        other.insert(std::make_pair(3 * i, i));
+    }
+    joined.join(left, right);
+    result.unionWith(other);
+    std::thread refill([&]() {
+        for (int i = 0; i < 3000; i++)
+        {
+            left.insert(std::make_pair(i, -i));
+            right.insert(std::make_pair(i, -i));
+            other.insert(std::make_pair(i, -i));
+        }
+    });
+    for (int i = 0; i < 3000; i++)
+    {
+        joined.remove(i);
+        joined.insert(std::make_pair(10000 + i, i));
+        result.remove(2 * i);
+        result.insert(std::make_pair(-1 - i, i));
+    }
+    refill.join();
+    for (int i = 0; i < 3000; i++)
+    {
+        expected[i] = -i;
+    }
+    return sameAsMap(left, expected) && sameAsMap(right, expected) && sameAsMap(other, expected)
+        && joined.size() == 5000 && joined.validate().valid && result.validate().valid;
+}
+
+// An AVLTree whose invariants a test can break on purpose.
+class DamagedTree : public AVLTree<int, int>
+{
+public:
+    void swapRootChildren()
+    {
+        Node<int, int>* left = root_ -> getLeft();
+        root_ -> setLeft(root_ -> getRight());
+        root_ -> setRight(left);
+    }
+
+    void skewRootBalance(int8_t balance)
+    {
+        static_cast<AVLNode<int, int>*>(root_) -> setBalance(balance);
+    }
+
+    void skewRootSize(std::size_t size)
+    {
+        static_cast<AVLNode<int, int>*>(root_) -> setSize(size);
+    }
+};
+
+// validate() reports the shape of a healthy tree exactly, serially and in
+// parallel (the tree is above the size where validate() forks), and flags out-of-order keys, a wrong balance and a wrong subtree
+// size once each is planted.
+bool validateCatchesDamage()
+{
+    DamagedTree tree;
+    vector<pair<int, int> > items;
+    for (int i = 0; i < 131071; i++)
+    {
+        items.push_back(std::make_pair(i, i));
+    }
+    tree.assignSorted(items.begin(), items.end());
+    TreeShape serial = tree.validate(1);
+    TreeShape parallel = tree.validate(4);
+    if (!serial.valid || !serial.problem.empty() || serial.nodes != 131071 || serial.height != 17 ||
+        serial.maxDepth != 16 || !parallel.valid || parallel.nodes != 131071 || parallel.depthSum != serial.depthSum)
+    {
+        return false;
+    }
+
+    tree.swapRootChildren();
+    bool caught = !tree.validate(1).valid && !tree.validate(4).valid && !tree.validate().problem.empty();
+    tree.swapRootChildren();
+    tree.skewRootBalance(1);
+    caught = caught && !tree.validate().valid;
+    tree.skewRootBalance(0);
+    tree.skewRootSize(5);
+    caught = caught && !tree.validate().valid;
+    tree.skewRootSize(131071);
+    return caught && tree.validate().valid;
+}
+
+// An AVLTree and a std::map holding the same n scattered keys out of
+// [0, 4n), with value key * scale.
+void fillBoth(AVLTree<int, int>& tree, map<int, int>& expected, int n, int seed, int scale = 10)
+{
+    unsigned state = seed;
+    for (int i = 0; i < n; i++)
+    {
+        state = state * 1103515245 + 12345;
+        int key = (state >> 8) % (4 * n);
+        tree.insert(std::make_pair(key, key * scale));
+        expected[key] = key * scale;
+    }
+}
+
+// Deserializes bytes into a tree that already holds filler; true if that
+// throws std::runtime_error and leaves the tree empty.
+template<typename Tree, typename Entry>
+bool rejectsStream(Tree& tree, const string& bytes, const Entry& filler)
+{
+    tree.insert(filler);
+    istringstream in(bytes);
+    try
+    {
+        tree.deserialize(in);
+    }
+    catch (const runtime_error&)
+    {
+        return tree.size() == 0 && tree.begin() == tree.end() && tree.validate().valid;
+    }
+    return false;
+}
+
+// serialize() then deserialize() reproduces std::map, for raw int entries
+// (BST and AVL) and for strings through the string codec; a truncated
+// stream, the wrong magic or version and out-of-order keys are rejected.
+bool serializeRoundTrips()
+{
+    AVLTree<int, int> avl;
+    map<int, int> expected;
+    fillBoth(avl, expected, 3000, 5);   // more than one serialBlock
+    ostringstream out;
+    avl.serialize(out);
+    const string bytes = out.str();
+
+    AVLTree<int, int> avlCopy;
+    BinarySearchTree<int, int> bstCopy;
+    istringstream avlIn(bytes);
+    istringstream bstIn(bytes);
+    avlCopy.deserialize(avlIn);
+    bstCopy.deserialize(bstIn);
+    if (!sameAsMap(avlCopy, expected) || !sameAsMap(bstCopy, expected))
+    {
+        return false;
+    }
+
+    // header: magic, u32 version, u32 key size, u32 value size, u64 count
+    const size_t header = 4 + 4 + 4 + 4 + 8;
+    string badMagic = bytes;
+    badMagic[0] = 'X';
+    string badVersion = bytes;
+    badVersion[4]++;
+    string outOfOrder = bytes;
+    std::swap_ranges(outOfOrder.begin() + header, outOfOrder.begin() + header + 4, outOfOrder.begin() + header + 8);
+    AVLTree<int, int> bad;
+    const pair<int, int> filler(1, 1);
+    if (!rejectsStream(bad, bytes.substr(0, bytes.size() - 1), filler) || !rejectsStream(bad, bytes.substr(0, 10), filler) ||
+        !rejectsStream(bad, badMagic, filler) || !rejectsStream(bad, badVersion, filler) || !rejectsStream(bad, outOfOrder, filler))
+    {
+        return false;
+    }
+
+    AVLTree<string, string> words;
+    map<string, string> expectedWords;
+    for (int i = 0; i < 500; i++)
+    {
+        string key = to_string((i * 7919) % 1009) + string(i % 40, 'k');
+        words.insert(std::make_pair(key, string(i % 70, 'v')));
+        expectedWords[key] = string(i % 70, 'v');
+    }
+    ostringstream wordsOut;
+    words.serialize(wordsOut);
+    AVLTree<string, string> wordsCopy;
+    istringstream wordsIn(wordsOut.str());
+    wordsCopy.deserialize(wordsIn);
+    if (wordsCopy.size() != expectedWords.size() || !wordsCopy.validate().valid ||
+        !std::equal(expectedWords.begin(), expectedWords.end(), wordsCopy.begin(),
+                    [](const pair<const string, string>& a, const pair<const string, string>& b) { return a == b; }))
+    {
+        return false;
+    }
+    string wordBytes = wordsOut.str();
+    return rejectsStream(wordsCopy, wordBytes.substr(0, wordBytes.size() - 3), make_pair(string("a"), string("b")));
+}
+
+// Writes tree with writeMapped() to a temporary file and reopens it as a
+// MappedTree; false if the file could not be written.
+template<typename Check>
+bool withMappedFile(const AVLTree<int, int>& tree, Check check)
+{
+    char path[] = "/tmp/bst-test-mapped-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        return false;
+    }
+    close(fd);
+    bool ok;
+    {
+        ofstream out(path, ios::binary);
+        tree.writeMapped(out);
+        out.close();
+        MappedTree<int, int> mapped(path);
+        ok = check(mapped);
+    }
+    unlink(path);
+    return ok;
+}
+
+// A tree written by writeMapped() and opened as a MappedTree answers find,
+// lower_bound, upper_bound, --end() and both iteration directions as
+// std::map does; an empty tree maps to an empty file.
+bool mappedTreeMatchesMap()
+{
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    fillBoth(tree, expected, 5000, 9);
+    bool full = withMappedFile(tree, [&](const MappedTree<int, int>& mapped) {
+        if (mapped.size() != expected.size() || !std::equal(expected.begin(), expected.end(), mapped.begin()) ||
+            !std::equal(expected.rbegin(), expected.rend(), std::reverse_iterator<MappedTree<int, int>::iterator>(mapped.end())))
+        {
+            return false;
+        }
+        if ((--mapped.end())->first != expected.rbegin()->first)
+        {
+            return false;
+        }
+        for (int key = -1; key <= 4 * 5000; key++)
+        {
+            if (keyOrNone(mapped, mapped.find(key)) != keyOrNone(expected, expected.find(key)) ||
+                keyOrNone(mapped, mapped.lower_bound(key)) != keyOrNone(expected, expected.lower_bound(key)) ||
+                keyOrNone(mapped, mapped.upper_bound(key)) != keyOrNone(expected, expected.upper_bound(key)))
+            {
+                return false;
+            }
+        }
+        return true;
+    });
+    AVLTree<int, int> none;
+    bool empty = withMappedFile(none, [](const MappedTree<int, int>& mapped) {
+        return mapped.empty() && mapped.begin() == mapped.end() && mapped.find(0) == mapped.end();
+    });
+    return full && empty;
+}
+
+// rank, select and count_range against positions in std::map, after a mix
+// of inserts and removes so the subtree counts have been through rotations
+// in both directions.
+bool orderStatisticsMatchMap()
+{
+    AVLTree<int, int> tree;
+    map<int, int> expected;
+    fillBoth(tree, expected, 3000, 21);
+    for (int i = 0; i < 6000; i += 3)
+    {
+        tree.remove(i);
+        expected.erase(i);
+    }
+    if (tree.size() != expected.size())
+    {
+        return false;
+    }
+    vector<int> keys;
+    for (map<int, int>::iterator it = expected.begin(); it != expected.end(); ++it)
+    {
+        keys.push_back(it->first);
+    }
+    for (std::size_t k = 0; k < keys.size(); k++)
+    {
+        AVLTree<int, int>::iterator it = tree.select(k);
+        if (it == tree.end() || it->first != keys[k] || tree.rank(keys[k]) != k)
+        {
+            return false;
+        }
+    }
+    if (tree.select(keys.size()) != tree.end())
+    {
+        return false;
+    }
+    for (int lo = -5; lo < 12010; lo += 97)
+    {
+        for (int width = 0; width < 700; width += 233)
+        {
+            std::size_t inRange = std::distance(expected.lower_bound(lo), expected.lower_bound(lo + width));
+            std::size_t below = std::distance(expected.begin(), expected.lower_bound(lo));
+            if (tree.count_range(lo, lo + width) != inRange || tree.rank(lo) != below ||
+                tree.count_range(lo + width, lo) != 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Splits at present and absent keys and at both ends, checks each half
+// against std::map, then joins the halves back and checks the whole. A join
+// whose halves overlap must throw and leave both trees as they were.
+bool splitJoinMatchMap()
+{
+    for (int pivot = -1; pivot <= 8001; pivot += 163)
+    {
+        AVLTree<int, int> tree, less, greater;
+        map<int, int> expected;
+        fillBoth(tree, expected, 2000, pivot + 7);
+        map<int, int> below(expected.begin(), expected.lower_bound(pivot));
+        map<int, int> above(expected.upper_bound(pivot), expected.end());
+        int value = -1;
+        bool found = tree.split(pivot, less, greater, &value);
+        if (found != (expected.count(pivot) == 1) || (found && value != pivot * 10) ||
+            !tree.empty() || !sameAsMap(less, below) || !sameAsMap(greater, above))
+        {
+            return false;
+        }
+        if (found)
+        {
+            expected.erase(pivot);
+        }
+        if (!less.empty() && !greater.empty())
+        {
+            bool threw = false;
+            try
+            {
+                tree.join(greater, less);
+            }
+            catch (const std::invalid_argument&)
+            {
+                threw = true;
+            }
+            if (!threw || !sameAsMap(less, below) || !sameAsMap(greater, above))
+            {
+                return false;
+            }
+        }
+        tree.join(less, greater);
+        if (!sameAsMap(tree, expected) || !less.empty() || !greater.empty())
+        {
+            return false;
+        }
+        // split into this tree itself, then join into one of the operands
+        AVLTree<int, int> rest;
+        tree.split(pivot, tree, rest);
+        less.join(tree, rest);
+        if (!sameAsMap(less, expected) || !tree.empty() || !rest.empty())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Union, intersection and difference of two overlapping trees against the
+// same operations on std::map, serially and with several threads (the
+// trees are tall enough for the parallel path to fork).
+bool setOpsMatchMap(unsigned threads)
+{
+    for (int op = 0; op < 3; op++)
+    {
+        AVLTree<int, int> a, b;
+        map<int, int> first, second;
+        fillBoth(a, first, 20000, 11, 10);
+        fillBoth(b, second, 20000, 12, 20);
+        map<int, int> expected;
+        if (op == 0)
+        {
+            expected = first;
+            for (map<int, int>::iterator it = second.begin(); it != second.end(); ++it)
+            {
+                expected[it->first] = it->second;
+            }
+            a.unionWith(b, threads);
+        }
+        else if (op == 1)
+        {
+            for (map<int, int>::iterator it = second.begin(); it != second.end(); ++it)
+            {
+                if (first.count(it->first) == 1)
+                {
+                    expected.insert(*it);
+                }
+            }
+            a.intersectWith(b, threads);
+        }
+        else
+        {
+            for (map<int, int>::iterator it = first.begin(); it != first.end(); ++it)
+            {
+                if (second.count(it->first) == 0)
+                {
+                    expected.insert(*it);
+                }
+            }
+            a.subtract(b, threads);
+        }
+        if (!sameAsMap(a, expected) || !b.empty())
+        {
+            return false;
+        }
+        // the emptied operand still works on the shared arena
+        b.insert(std::make_pair(1, 1));
+        a.unionWith(b, threads);
+        expected[1] = 1;
+        if (!sameAsMap(a, expected))
+        {
+            return false;
+        }
+    }
+    AVLTree<int, int> self;
+    map<int, int> expected;
+    fillBoth(self, expected, 100, 13);
+    self.unionWith(self, threads);
+    self.intersectWith(self, threads);
+    if (!sameAsMap(self, expected))
+    {
+        return false;
+    }
+    self.subtract(self, threads);
+    return self.empty();
+}
+
+// Fills the tree and a std::map with the same scattered keys, then checks
+// lower_bound, upper_bound, equal_range, floor, ceiling and range for every
+// probe key against the map, including keys that are absent and keys past
+// either end.
+template<typename Tree>
+bool boundsMatchMap()
+{
+    Tree tree;
+    map<int, int> expected;
+    for (int i = 0; i < 3000; i++)
+    {
+        int key = (i * 7919) % 5000;
+        tree.insert(std::make_pair(key, i));
+        expected[key] = i;
+    }
+    for (int i = 0; i < 1500; i++)
+    {
+        int key = (i * 104729) % 5000;
+        tree.remove(key);
+        expected.erase(key);
+    }
+    for (int probe = -2; probe <= 5001; probe++)
+    {
+        map<int, int>::const_iterator lower = expected.lower_bound(probe);
+        map<int, int>::const_iterator upper = expected.upper_bound(probe);
+        map<int, int>::const_iterator floorIt = upper == expected.begin() ? expected.end() : std::prev(upper);
+        if (keyOrNone(tree, tree.lower_bound(probe)) != keyOrNone(expected, lower) ||
+            keyOrNone(tree, tree.upper_bound(probe)) != keyOrNone(expected, upper) ||
+            keyOrNone(tree, tree.ceiling(probe)) != keyOrNone(expected, lower) ||
+            keyOrNone(tree, tree.floor(probe)) != keyOrNone(expected, floorIt) ||
+            (tree.equal_range(probe).first == tree.equal_range(probe).second) != (lower == upper))
+        {
+            return false;
+        }
+    }
+    for (int lo = -10; lo < 5010; lo += 37)
+    {
+        int hi = lo + 211;
+        map<int, int>::const_iterator exp = expected.lower_bound(lo);
+        map<int, int>::const_iterator stop = expected.lower_bound(hi);
+        for (typename Tree::iterator it = tree.range(lo, hi).begin(); it != tree.range(lo, hi).end(); ++it, ++exp)
+        {
+            if (exp == stop || it->first != exp->first || it->second != exp->second)
+            {
+                return false;
+            }
+        }
+        if (exp != stop || tree.range(hi, lo).begin() != tree.range(hi, lo).end())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A B+tree ordered by std::greater iterates from the largest key down.
+bool bplusHonoursCompare()
+{
+    BPlusTree<int, int, 8, std::greater<int> > tree;
+    for (int i = 0; i < 1000; i++)
+    {
+        tree.insert(std::make_pair((i * 37) % 1000, i));
+    }
+    int last = 1000;
+    for (BPlusTree<int, int, 8, std::greater<int> >::iterator it = tree.begin(); it != tree.end(); ++it)
+    {
+        if (it->first >= last)
+        {
+            return false;
+        }
+        last = it->first;
+    }
+    return last == 0 && tree.size() == 1000 && tree.lower_bound(500)->first == 500
+        && tree.upper_bound(500)->first == 499 && tree.floor(1500) == tree.end();
+}
+
 
 int main(int argc, char *argv[])
 {
@@ -46,5 +1277,41 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
-    return 0;
+    // Shared workload across engines
+    cout << endl;
+    check("AVLTree matches std::map", matchesMap<AVLTree<int,int> >());
+    check("BPlusTree matches std::map", matchesMap<BPlusTree<int,int,8> >());
+    check("BinarySearchTree bounds match std::map", boundsMatchMap<BinarySearchTree<int,int> >());
+    check("AVLTree bounds match std::map", boundsMatchMap<AVLTree<int,int> >());
+    check("BPlusTree bounds match std::map", boundsMatchMap<BPlusTree<int,int,8> >());
+    check("BPlusTree orders by its Compare", bplusHonoursCompare());
+    check("BinarySearchTree assignSorted matches std::map", assignSortedMatchesMap<BinarySearchTree<int,int> >());
+    check("AVLTree assignSorted matches std::map", assignSortedMatchesMap<AVLTree<int,int> >());
+    check("BinarySearchTree insert_range matches std::map", insertRangeMatchesMap<BinarySearchTree<int,int> >());
+    check("AVLTree insert_range matches std::map", insertRangeMatchesMap<AVLTree<int,int> >());
+    check("BinarySearchTree hinted insert matches std::map", hintedInsertMatchesMap<BinarySearchTree<int,int> >());
+    check("AVLTree hinted insert matches std::map", hintedInsertMatchesMap<AVLTree<int,int> >());
+    check("BinarySearchTree reverse walks match std::map", reverseWalksMatchMap<BinarySearchTree<int,int> >());
+    check("AVLTree reverse walks match std::map", reverseWalksMatchMap<AVLTree<int,int> >());
+    check("BinarySearchTree moves match std::map", movesMatchMap<BinarySearchTree<int,int> >());
+    check("AVLTree moves match std::map", movesMatchMap<AVLTree<int,int> >());
+    check("PersistentAVLTree snapshots match std::map", persistentSnapshotsMatchMap());
+    check("ConcurrentAVLTree readers and final contents match std::map", concurrentReadersMatchMap());
+    check("BinarySearchTree assignSorted cleans up on throw", assignSortedCleansUpOnThrow<BinarySearchTree<int, CopyLimited> >());
+    check("AVLTree assignSorted cleans up on throw", assignSortedCleansUpOnThrow<AVLTree<int, CopyLimited> >());
+    check("BinarySearchTree sorted chain survives copy, clear and teardown", sortedChainSurvivesTeardown());
+    check("FrozenTree from freeze() matches std::map", frozenMatchesMap());
+    check("BinarySearchTree emplace family matches std::map", emplaceMatchesMap<BinarySearchTree<int, vector<int> > >());
+    check("AVLTree emplace family matches std::map", emplaceMatchesMap<AVLTree<int, vector<int> > >());
+    check("tree stats count inserts (or stay zero without BST_STATS)", statsCountInserts());
+    check("AVLTree join/unionWith operands keep no shared arena", emptiedOperandsAreIndependent());
+    check("AVLTree validate() catches damage", validateCatchesDamage());
+    check("serialize/deserialize round trips and rejects bad streams", serializeRoundTrips());
+    check("MappedTree from writeMapped() matches std::map", mappedTreeMatchesMap());
+    check("AVLTree split/join match std::map", splitJoinMatchMap());
+    check("AVLTree rank/select/count_range match std::map", orderStatisticsMatchMap());
+    check("AVLTree set operations match std::map (1 thread)", setOpsMatchMap(1));
+    check("AVLTree set operations match std::map (4 threads)", setOpsMatchMap(4));
+
+    return failures == 0 ? 0 : 1;
 }
@@ -2,23 +2,41 @@
 #define BST_H
 
 #include <iostream>
+#include <cstdint>
+#include <cstring>
 #include <exception>
 #include <cstdlib>
 #include <utility>
+#include <type_traits>
+#include <stdexcept>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <tuple>
+#include <map>
+#include <future>
+#include <thread>
+#include "node-arena.h"
+#include "frozenbst.h"
+#include "mappedtree.h"
+#include "tree-stats.h"
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * Nothing here is virtual, so a node carries no vtable pointer and
+ * link access is a plain load. Derived node types (such as AVLNode)
+ * hide the parent/left/right getters with versions that return their
+ * own type, and the owning tree destroys nodes through its static type.
  */
 template <typename Key, typename Value>
 class Node
 {
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    Node(Key&& key, Value&& value, Node<Key, Value>* parent);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -26,14 +44,15 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
+    void setValue(Value&& value);
 
 protected:
     std::pair<const Key, Value> item_;
@@ -61,6 +80,19 @@ Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* par
 
 }
 
+/**
+* Constructor that moves the key and value into the node.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>::Node(Key&& key, Value&& value, Node<Key, Value>* parent) :
+    item_(std::move(key), std::move(value)),
+    parent_(parent),
+    left_(NULL),
+    right_(NULL)
+{
+
+}
+
 /**
 * Destructor, which does not need to do anything since the pointers inside of a node
 * are only used as references to existing nodes. The nodes pointed to by parent/left/right
@@ -118,7 +150,7 @@ Value& Node<Key, Value>::getValue()
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
@@ -127,7 +159,7 @@ Node<Key, Value>* Node<Key, Value>::getParent() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
@@ -136,7 +168,7 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
@@ -180,6 +212,15 @@ void Node<Key, Value>::setValue(const Value& value)
     item_.second = value;
 }
 
+/**
+* A setter that moves the new value in.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setValue(Value&& value)
+{
+    item_.second = std::move(value);
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
@@ -187,30 +228,204 @@ void Node<Key, Value>::setValue(const Value& value)
 */
 
 /**
-* A templated unbalanced binary search tree.
+* Opt-in three-way comparison for a Compare type. The tree descents make one
+* Compare call per level and test for equality once at the bottom. A Compare
+* with a cheap three-way form can instead specialize this to derive from
+* std::true_type and provide
+*
+*   static int compare(const Compare& comp, const Key& a, const Key& b);
+*
+* returning <0, 0 or >0; descents then stop as soon as they hit the key.
 */
-template <typename Key, typename Value>
+template <typename Compare>
+struct ThreeWayCompare : std::false_type
+{
+};
+
+/**
+* std::string::compare already is a three-way comparison.
+*/
+template <>
+struct ThreeWayCompare<std::less<std::string> > : std::true_type
+{
+    static int compare(const std::less<std::string>&, const std::string& a, const std::string& b)
+    {
+        return a.compare(b);
+    }
+};
+
+/**
+* How serialize() writes and deserialize() reads one key or value.
+* Trivially copyable types are stored as their raw bytes, in the layout and
+* byte order of the machine that wrote them; std::string is stored as a
+* 64-bit length followed by its characters. Other types opt in by
+* specializing TreeCodec<T, false> with
+*
+*   static void write(std::ostream& out, const T& item);
+*   static T read(std::istream& in);
+*
+* read() throws std::runtime_error when the stream runs out.
+*/
+template <typename T, bool Raw = std::is_trivially_copyable<T>::value>
+struct TreeCodec;
+
+/**
+* Raw bytes, for trivially copyable types. serialize() and deserialize()
+* copy whole blocks of entries at once when both the key and the value
+* are raw.
+*/
+template <typename T>
+struct TreeCodec<T, true>
+{
+    static const bool raw = true;
+
+    static void toBytes(const T& item, char* bytes)
+    {
+        std::memcpy(bytes, &item, sizeof(T));
+    }
+
+    static T fromBytes(const char* bytes)
+    {
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+        std::memcpy(&storage, bytes, sizeof(T));
+        return *reinterpret_cast<const T*>(&storage);
+    }
+
+    static void write(std::ostream& out, const T& item)
+    {
+        out.write(reinterpret_cast<const char*>(&item), sizeof(T));
+    }
+
+    static T read(std::istream& in)
+    {
+        char bytes[sizeof(T)];
+        if (!in.read(bytes, sizeof(T)))
+        {
+            throw std::runtime_error("deserialize: stream ended early");
+        }
+        return fromBytes(bytes);
+    }
+};
+
+/**
+* A length, then the characters.
+*/
+template <>
+struct TreeCodec<std::string, false>
+{
+    static const bool raw = false;
+
+    static void write(std::ostream& out, const std::string& item)
+    {
+        TreeCodec<std::uint64_t>::write(out, item.size());
+        out.write(item.data(), item.size());
+    }
+
+    static std::string read(std::istream& in)
+    {
+        std::uint64_t length = TreeCodec<std::uint64_t>::read(in);
+        std::string item;
+        // grow with what actually arrives, so a corrupt length cannot
+        // allocate more than the stream holds
+        char chunk[4096];
+        while (length > 0)
+        {
+            std::size_t want = length < sizeof(chunk) ? static_cast<std::size_t>(length) : sizeof(chunk);
+            if (!in.read(chunk, want))
+            {
+                throw std::runtime_error("deserialize: stream ended early");
+            }
+            item.append(chunk, want);
+            length -= want;
+        }
+        return item;
+    }
+};
+
+/**
+* What BinarySearchTree::validate() found: whether every invariant holds and,
+* if not, the first one it saw broken, plus a summary of the tree's shape.
+*/
+struct TreeShape
+{
+    bool valid;
+    std::string problem;                    // empty when valid
+    std::size_t nodes;
+    int height;                             // levels, 0 for an empty tree
+    int maxDepth;                           // edges from the root to the deepest node
+    std::size_t depthSum;                   // sum of all node depths
+    std::map<int, std::size_t> balance;     // right height - left height -> nodes
+
+    TreeShape() : valid(true), nodes(0), height(0), maxDepth(0), depthSum(0)
+    {
+    }
+
+    double averageDepth() const
+    {
+        return nodes == 0 ? 0.0 : static_cast<double>(depthSum) / nodes;
+    }
+};
+
+/**
+* A templated unbalanced binary search tree. Keys are ordered by Compare,
+* which must be a strict weak ordering; keys that are equivalent under it
+* are the same key.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
 class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    explicit BinarySearchTree(const Compare& comp);
+    BinarySearchTree(const BinarySearchTree& other);
+    BinarySearchTree(BinarySearchTree&& other) noexcept;
+    BinarySearchTree& operator=(const BinarySearchTree& other);
+    BinarySearchTree& operator=(BinarySearchTree&& other) noexcept;
     virtual ~BinarySearchTree(); //TODO
+    void copyFrom(const BinarySearchTree& other, unsigned threads = 1);
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
     void clear(); //TODO
     bool isBalanced() const; //TODO
+    TreeShape validate(unsigned threads = 1) const;
     void print() const;
     bool empty() const;
-
-    template<typename PPKey, typename PPValue>
-    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    virtual std::size_t size() const;
+    template<typename InputIt>
+    void assignSorted(InputIt first, InputIt last);
+    template<typename InputIt>
+    void insert_range(InputIt first, InputIt last);
+    FrozenTree<Key, Value, Compare> freeze() const;
+    void serialize(std::ostream& out) const;
+    void writeMapped(std::ostream& out) const;
+    void deserialize(std::istream& in);
+    Compare key_comp() const;
+    static TreeStats stats();
+    static void resetStats();
+
+    template<typename PPKey, typename PPValue, typename PPCompare>
+    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue, PPCompare> & tree);
+protected:
+    // Lets derived trees size the node arena for their own node type.
+    BinarySearchTree(std::size_t nodeSize, std::size_t nodeAlign, const Compare& comp = Compare());
 public:
+    class const_iterator;
+
     /**
     * An internal iterator class for traversing the contents of the BST.
+    * It is bidirectional: end() can be decremented to reach the last entry.
+    * Steps follow the child and parent links, so a full scan crosses every
+    * edge twice and costs O(n) in total.
     */
     class iterator  // TODO
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -218,49 +433,230 @@ public:
 
         bool operator==(const iterator& rhs) const;
         bool operator!=(const iterator& rhs) const;
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
 
         iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        friend class BinarySearchTree<Key, Value, Compare>;
+        friend class const_iterator;
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Compare>* tree);
         Node<Key, Value> *current_;
-        //successor helper funt
-        iterator& successor();
+        const BinarySearchTree<Key, Value, Compare>* tree_;    // for stepping back from end()
+    };
+
+    /**
+    * The read-only counterpart of iterator; an iterator converts to it.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    protected:
+        friend class BinarySearchTree<Key, Value, Compare>;
+        friend class iterator;
+        const_iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Compare>* tree);
+        Node<Key, Value> *current_;
+        const BinarySearchTree<Key, Value, Compare>* tree_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    /**
+    * A pair of iterators that can be walked with a range-for loop.
+    */
+    template<typename It>
+    class basic_range
+    {
+    public:
+        basic_range(It first, It last);
+
+        It begin() const;
+        It end() const;
+
+    private:
+        It first_;
+        It last_;
     };
 
+    typedef basic_range<iterator> iterator_range;
+    typedef basic_range<const_iterator> const_iterator_range;
+
 public:
-    iterator begin() const;
-    iterator end() const;
-    iterator find(const Key& key) const;
+    // Lookups come in pairs: a const tree hands out const_iterators.
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin();
+    const_reverse_iterator rbegin() const;
+    reverse_iterator rend();
+    const_reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
+    iterator find(const Key& key);
+    const_iterator find(const Key& key) const;
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
+    // Move-aware inserts. insert overwrites an existing value, like the
+    // const& overload; emplace and try_emplace leave it alone (as std::map).
+    template<typename P, typename = typename std::enable_if<std::is_constructible<std::pair<Key, Value>, P&&>::value>::type>
+    void insert(P&& keyValuePair);
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args>
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const Key& key, M&& obj);
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(Key&& key, M&& obj);
+
+    // Hinted inserts, for keys that arrive nearly in order. hint is where
+    // the key is expected to go: the entry just after it, or end() to
+    // append. Existing values are overwritten, as by insert.
+    iterator insert(const_iterator hint, const std::pair<const Key, Value>& keyValuePair);
+    template<typename P, typename = typename std::enable_if<std::is_constructible<std::pair<Key, Value>, P&&>::value>::type>
+    iterator insert(const_iterator hint, P&& keyValuePair);
+
+    // Ordered lookups, all O(log n).
+    iterator lower_bound(const Key& key);
+    const_iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key);
+    const_iterator upper_bound(const Key& key) const;
+    std::pair<iterator, iterator> equal_range(const Key& key);
+    std::pair<const_iterator, const_iterator> equal_range(const Key& key) const;
+    iterator floor(const Key& key);
+    const_iterator floor(const Key& key) const;
+    iterator ceiling(const Key& key);
+    const_iterator ceiling(const Key& key) const;
+    iterator_range range(const Key& lo, const Key& hi);
+    const_iterator_range range(const Key& lo, const Key& hi) const;
+
 protected:
+    // Lets derived trees hand out iterators to nodes they located themselves.
+    iterator iteratorAt(Node<Key, Value>* nodePtr);
+    const_iterator iteratorAt(Node<Key, Value>* nodePtr) const;
+
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    Node<Key, Value>* locate(const Key& key, Node<Key, Value>*& parent, bool& left) const;
+    Node<Key, Value>* locate(const Key& key, Node<Key, Value>* start, Node<Key, Value>*& parent, bool& left, std::true_type) const;
+    Node<Key, Value>* locate(const Key& key, Node<Key, Value>* start, Node<Key, Value>*& parent, bool& left, std::false_type) const;
+    Node<Key, Value>* locateNear(const Key& key, Node<Key, Value>* hint, Node<Key, Value>*& parent, bool& left) const;
+    Node<Key, Value>* internalBound(const Key& key, bool strict) const;
+    Node<Key, Value>* internalFloor(const Key& key) const;
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value>* getLargestNode() const;
+    static Node<Key, Value>* successor(Node<Key, Value>* current);
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
 
     // Provided helper functions
-    virtual void printRoot (Node<Key, Value> *r) const;
+    void printRoot (Node<Key, Value> *r) const;  // not virtual, so only trees that print need printable values
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
 
+    // Node allocation hooks. Derived trees override both to build and
+    // destroy their own node type inside the tree's arena. The key and
+    // value are moved into the node.
+    virtual Node<Key, Value>* createNode(Key&& key, Value&& value, Node<Key, Value>* parent);
+    virtual void destroyNode(Node<Key, Value>* nodePtr);
+    NodeArena& nodeArena();
+
+    // Copying and moving. cloneNode copies one node, with any per-node data
+    // of derived trees, into the given arena.
+    void swapContents(BinarySearchTree& other);
+    void cloneFrom(const BinarySearchTree& other, unsigned threads);
+    void cloneSubtree(const Node<Key, Value>* source, Node<Key, Value>* parent, bool left, const std::shared_ptr<NodeArena>& arena, unsigned threads);
+    virtual Node<Key, Value>* cloneNode(const Node<Key, Value>* nodePtr, Node<Key, Value>* parent, NodeArena& arena) const;
+
+    // Single inserts. linkNode hangs a fresh node where locate() said it
+    // belongs; derived trees override it to rebalance.
+    virtual void linkNode(Node<Key, Value>* nodePtr, Node<Key, Value>* parent, bool left);
+    template<typename K, typename... Args>
+    std::pair<iterator, bool> emplaceKey(K&& key, Args&&... args);
+    template<typename K, typename M>
+    std::pair<iterator, bool> assignKey(K&& key, M&& obj);
+    template<typename K, typename M>
+    iterator assignNear(Node<Key, Value>* hint, K&& key, M&& obj);
+
+    // Bulk linking. refreshNode is called once per node, children first, so
+    // derived trees can recompute per-node data such as AVL balances.
+    Node<Key, Value>* linkBalanced(const std::vector<Node<Key, Value>*>& nodes, std::size_t lo, std::size_t hi, Node<Key, Value>* parent, int& height);
+    virtual void refreshNode(Node<Key, Value>* nodePtr, int leftHeight, int rightHeight);
+
     // Add helper functions here
-    void postorderDestroyer(Node<Key, Value>* nodePtr);
-    int countSteps(Node<Key, Value>* nodePtr) const;
-    bool balHelper(Node<Key, Value>* root) const;
+    void destroySubtree(Node<Key, Value>* nodePtr);
+    // Serialization. The true_type overloads handle raw keys and values.
+    static const char serialMagic[4];
+    static const std::uint32_t serialVersion = 1;
+    static const std::size_t serialBlock = 4096;
+    void writeEntries(std::ostream& out, std::true_type) const;
+    void writeEntries(std::ostream& out, std::false_type) const;
+    void readEntries(std::istream& in, std::uint64_t count, std::vector<Node<Key, Value>*>& nodes, std::true_type);
+    void readEntries(std::istream& in, std::uint64_t count, std::vector<Node<Key, Value>*>& nodes, std::false_type);
+    void appendEntry(std::vector<Node<Key, Value>*>& nodes, Key&& key, Value&& value);
+    static void layoutBlocked(std::size_t index, int levels, const std::vector<std::size_t>& left, const std::vector<std::size_t>& right, std::vector<std::size_t>& order);
+    // Single-pass validation. checkNode lets derived trees check their own
+    // per-node data once both subtrees are known, returning a description of
+    // what is wrong or nullptr.
+    int validateSubtree(Node<Key, Value>* nodePtr, const Node<Key, Value>* lo, const Node<Key, Value>* hi, int depth, std::size_t& count, TreeShape& shape, unsigned threads) const;
+    void checkLinks(Node<Key, Value>* nodePtr, const Node<Key, Value>* lo, const Node<Key, Value>* hi, int depth, TreeShape& shape) const;
+    virtual const char* checkNode(const Node<Key, Value>* nodePtr, int leftHeight, int rightHeight, std::size_t leftCount, std::size_t rightCount) const;
     void f2(Node<Key, Value>* nodePtr);
     void f3(Node<Key, Value>* nodePtr);
     void f4(Node<Key, Value>* nodePtr);
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    std::shared_ptr<NodeArena> arena_;     // made by nodeArena() on first use
+    std::size_t nodeSize_;  // slot size and alignment for arena_
+    std::size_t nodeAlign_;
+    std::size_t count_;     // entries, kept by the plain BST operations
+    StatsCompare<Compare> comp_;    // counts its calls when BST_STATS is defined
 };
 
+/**
+* The first bytes of every serialized tree.
+*/
+template<typename Key, typename Value, typename Compare>
+const char BinarySearchTree<Key, Value, Compare>::serialMagic[4] = { 'B', 'S', 'T', 'S' };
+
+template<typename Key, typename Value, typename Compare>
+const std::uint32_t BinarySearchTree<Key, Value, Compare>::serialVersion;
+
+template<typename Key, typename Value, typename Compare>
+const std::size_t BinarySearchTree<Key, Value, Compare>::serialBlock;
+
 /*
 --------------------------------------------------------------
 Begin implementations for the BinarySearchTree::iterator class.
@@ -270,21 +666,21 @@ Begin implementations for the BinarySearchTree::iterator class.
 /**
 * Explicit constructor that initializes an iterator with a given node pointer.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr): current_(ptr) {}
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator(Node<Key,Value> *ptr, const BinarySearchTree<Key, Value, Compare>* tree): current_(ptr), tree_(tree) {}
 
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(): current_(nullptr) {}
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::iterator::iterator(): current_(nullptr), tree_(nullptr) {}
 
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -292,9 +688,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Compare>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -303,509 +699,2441 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator==(const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
-    return (this -> current_ == rhs.current_);
+    return this -> current_ == rhs.current_;
 }
 
 /**
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Compare>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Compare>::iterator::operator!=(const BinarySearchTree<Key, Value, Compare>::iterator& rhs) const
 {
-    return (this -> current_ != rhs.current_);
+    return this -> current_ != rhs.current_;
 }
 
-
 /**
-* finds successor of this ptr
+* Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::successor()
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator++()
 {
-    //case where current is root_ and right subtree is empty
-    if (this -> current_ -> getParent() == nullptr && this -> current_ -> getRight() == nullptr) 
-    {
-        this -> current_ = nullptr;
-        return *this;
-    }
-
-    //case where you can take a step down first
-    if (this -> current_ -> getRight() != nullptr) 
-    {
-        this -> current_ = this -> current_ -> getRight();
-        while (this -> current_ -> getLeft() != nullptr)
-        {
-            this -> current_ = this -> current_ -> getLeft();
-        }
-        return *this;
-    }
-
-    //otherwise, this is the case where you can't take a step down so you have to move up
-    while (this -> current_ != nullptr && this -> current_ -> getParent() != nullptr && this -> current_ -> getParent() -> getLeft() != this -> current_) 
-    {
-        this -> current_ = this -> current_ -> getParent();
-    }
+    current_ = successor(current_);
+    return *this;
+}
 
-    /*
-    if (this -> current_ -> getParent() == nullptr)
-    {
-        this -> current_ = nullptr;
-        return *this;
-    }
-    */
+/**
+* Postfix form of operator++.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::iterator::operator++(int)
+{
+    iterator before(*this);
+    current_ = successor(current_);
+    return before;
+}
 
-    if (this -> current_ == nullptr) //checking if current was actually smallest node in the tree. returning nullptr if so.
-    {
-        this -> current_ = nullptr;
-        return *this;
-    }
-    this -> current_ = this -> current_ -> getParent();
+/**
+* Moves the iterator back one entry; from end() that is the last entry.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator&
+BinarySearchTree<Key, Value, Compare>::iterator::operator--()
+{
+    current_ = current_ == nullptr ? tree_ -> getLargestNode() : predecessor(current_);
     return *this;
 }
 
 /**
-* Advances the iterator's location using an in-order sequencing
+* Postfix form of operator--.
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::iterator::operator--(int)
 {
-    if (this -> current_ -> getParent() == nullptr && this -> current_ -> getLeft() == nullptr && this -> current_ -> getRight() == nullptr)
-    {
-      this -> current_ = nullptr;
-      return *this; //operator++ called on single node tree
-    }
-    return this -> successor();
+    iterator before(*this);
+    --*this;
+    return before;
+}
+
+/**
+* Compares with a const_iterator.
+*/
+template<class Key, class Value, class Compare>
+bool
+BinarySearchTree<Key, Value, Compare>::iterator::operator==(const BinarySearchTree<Key, Value, Compare>::const_iterator& rhs) const
+{
+    return this -> current_ == rhs.current_;
 }
 
+/**
+* Compares with a const_iterator.
+*/
+template<class Key, class Value, class Compare>
+bool
+BinarySearchTree<Key, Value, Compare>::iterator::operator!=(const BinarySearchTree<Key, Value, Compare>::const_iterator& rhs) const
+{
+    return this -> current_ != rhs.current_;
+}
 
 /*
--------------------------------------------------------------
+--------------------------------------------------------------
 End implementations for the BinarySearchTree::iterator class.
--------------------------------------------------------------
+---------------------------------------------------------------
 */
 
 /*
------------------------------------------------------
-Begin implementations for the BinarySearchTree class.
------------------------------------------------------
+--------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+--------------------------------------------------------------------
 */
 
 /**
-* Default constructor for a BinarySearchTree, which sets the root to NULL.
+* Converts an iterator to a const_iterator at the same entry.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree(): root_(nullptr) {} // DOUBLE CHECK HERE
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::const_iterator::const_iterator(const iterator& it): current_(it.current_), tree_(it.tree_) {}
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+/**
+* Explicit constructor that initializes an iterator with a given node pointer.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::const_iterator::const_iterator(Node<Key,Value> *ptr, const BinarySearchTree<Key, Value, Compare>* tree): current_(ptr), tree_(tree) {}
+
+/**
+* A default constructor that initializes the iterator to NULL.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::const_iterator::const_iterator(): current_(nullptr), tree_(nullptr) {}
+
+/**
+* Provides access to the item.
+*/
+template<class Key, class Value, class Compare>
+const std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator*() const
 {
-    clear();
+    return current_->getItem();
 }
 
 /**
- * Returns true if tree is empty
+* Provides access to the address of the item.
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Compare>
+const std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator->() const
 {
-    return root_ == NULL;
+    return &(current_->getItem());
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+/**
+* Checks if 'this' iterator's internals have the same value
+* as 'rhs'
+*/
+template<class Key, class Value, class Compare>
+bool
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator==(const BinarySearchTree<Key, Value, Compare>::const_iterator& rhs) const
 {
-    printRoot(root_);
-    std::cout << "\n";
+    return this -> current_ == rhs.current_;
 }
 
 /**
-* Returns an iterator to the "smallest" item in the tree
+* Checks if 'this' iterator's internals have a different value
+* as 'rhs'
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class Compare>
+bool
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator!=(const BinarySearchTree<Key, Value, Compare>::const_iterator& rhs) const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
-    return begin;
+    return this -> current_ != rhs.current_;
 }
 
 /**
-* Returns an iterator whose value means INVALID
+* Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator&
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator++()
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
-    return end;
+    current_ = successor(current_);
+    return *this;
 }
 
 /**
-* Returns an iterator to the item with the given key, k
-* or the end iterator if k does not exist in the tree
+* Postfix form of operator++.
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator++(int)
 {
-    Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
-    return it;
+    const_iterator before(*this);
+    current_ = successor(current_);
+    return before;
 }
 
 /**
- * @precondition The key exists in the map
- * Returns the value associated with the key
- */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+* Moves the iterator back one entry; from end() that is the last entry.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator&
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator--()
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    current_ = current_ == nullptr ? tree_ -> getLargestNode() : predecessor(current_);
+    return *this;
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+
+/**
+* Postfix form of operator--.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::const_iterator::operator--(int)
 {
-    Node<Key, Value> *curr = internalFind(key);
-    if(curr == NULL) throw std::out_of_range("Invalid key");
-    return curr->getValue();
+    const_iterator before(*this);
+    --*this;
+    return before;
 }
 
+/*
+------------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+------------------------------------------------------------------
+*/
+
 /**
-* An insert method to insert into a Binary Search Tree.
-* The tree will not remain balanced when inserting.
-* Recall: If key is already in the tree, you should 
-* overwrite the current value with the updated value.
+* Constructs the range [first, last).
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<class Key, class Value, class Compare>
+template<typename It>
+BinarySearchTree<Key, Value, Compare>::basic_range<It>::basic_range(It first, It last) :
+    first_(first), last_(last)
 {
-    if (root_ == nullptr)
-    {
-        Node<Key, Value>* n = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, nullptr);
-        root_ = n;
-        return;
-    }
-    Node<Key, Value>* finder = root_;
 
-    while (finder != nullptr)
-    {
-        if (keyValuePair.first == finder->getKey()) //nodes are equal
-        {
-            finder -> setValue(keyValuePair.second);
-            return;
-        }
-        else if (keyValuePair.first < finder->getKey())
-        {
-            if (finder -> getLeft() == nullptr)
-            {
-                Node<Key, Value>* n = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, finder);
-                finder -> setLeft(n);
-                return;
-            }
-            finder = finder -> getLeft();
-        }
-        else if(keyValuePair.first > finder->getKey())
-        {
-            if (finder -> getRight() == nullptr)
-            {
-                Node<Key, Value>* n = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, finder);
-                finder -> setRight(n);
-                return;
-            }
-            finder = finder -> getRight();
-        }
-    }
 }
 
-
 /**
-* A remove method to remove a specific key from a Binary Search Tree.
-* Recall: The writeup specifies that if a node has 2 children you
-* should swap with the predecessor and then remove.
+* Returns the first iterator of the range.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::f2(Node<Key, Value>* nodePtr)
+template<class Key, class Value, class Compare>
+template<typename It>
+It BinarySearchTree<Key, Value, Compare>::basic_range<It>::begin() const
 {
-        while (nodePtr->getLeft() != nullptr && nodePtr->getRight() != nullptr)
-        {
-          nodeSwap(nodePtr, predecessor(nodePtr));
-        }
-        if (nodePtr->getLeft() != nullptr || nodePtr->getRight() != nullptr)
-        {
-          f4(nodePtr);
-          return;
-        }
-        else
-        {
-          f3(nodePtr);
-          return;
-        }
+    return first_;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::f3(Node<Key, Value>* nodePtr)
+/**
+* Returns the past-the-end iterator of the range.
+*/
+template<class Key, class Value, class Compare>
+template<typename It>
+It BinarySearchTree<Key, Value, Compare>::basic_range<It>::end() const
+{
+    return last_;
+}
+
+
+/*
+-----------------------------------------------------
+Begin implementations for the BinarySearchTree class.
+-----------------------------------------------------
+*/
+
+/**
+* Default constructor for a BinarySearchTree, which sets the root to NULL.
+* The node arena is not made until the first node is.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree():
+    root_(nullptr),
+    arena_(),
+    nodeSize_(sizeof(Node<Key, Value>)),
+    nodeAlign_(alignof(Node<Key, Value>)),
+    count_(0),
+    comp_()
+{
+
+}
+
+/**
+* Constructs an empty tree ordered by the given comparator.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(const Compare& comp):
+    root_(nullptr),
+    arena_(),
+    nodeSize_(sizeof(Node<Key, Value>)),
+    nodeAlign_(alignof(Node<Key, Value>)),
+    count_(0),
+    comp_(comp)
+{
+
+}
+
+/**
+* Constructor used by derived trees whose nodes are larger than Node.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(std::size_t nodeSize, std::size_t nodeAlign, const Compare& comp):
+    root_(nullptr),
+    arena_(),
+    nodeSize_(nodeSize),
+    nodeAlign_(nodeAlign),
+    count_(0),
+    comp_(comp)
+{
+
+}
+
+/**
+* Copy constructor: an O(n) structural copy of other (see copyFrom).
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(const BinarySearchTree& other):
+    BinarySearchTree(other.comp_)
+{
+    cloneFrom(other, 1);
+}
+
+/**
+* Move constructor: takes other's nodes and arena in O(1) without
+* allocating, leaving other empty with no arena until it next needs one.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>::BinarySearchTree(BinarySearchTree&& other) noexcept:
+    root_(other.root_),
+    arena_(std::move(other.arena_)),
+    nodeSize_(other.nodeSize_),
+    nodeAlign_(other.nodeAlign_),
+    count_(other.count_),
+    comp_(other.comp_)
+{
+    other.root_ = nullptr;
+    other.count_ = 0;
+}
+
+/**
+* Copy assignment. The copy is made first, so this tree is unchanged if
+* copying throws.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>& BinarySearchTree<Key, Value, Compare>::operator=(const BinarySearchTree& other)
+{
+    if (this != &other)
+    {
+        BinarySearchTree copy(other);
+        swapContents(copy);
+    }
+    return *this;
+}
+
+/**
+* Move assignment: frees this tree's nodes and takes other's nodes and
+* arena in their place, without allocating. other is left empty with no
+* arena until it next needs one.
+*/
+template<class Key, class Value, class Compare>
+BinarySearchTree<Key, Value, Compare>& BinarySearchTree<Key, Value, Compare>::operator=(BinarySearchTree&& other) noexcept
+{
+    if (this != &other)
+    {
+        clear();
+        root_ = other.root_;
+        arena_ = std::move(other.arena_);
+        count_ = other.count_;
+        comp_ = other.comp_;
+        other.root_ = nullptr;
+        other.count_ = 0;
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Compare>
+BinarySearchTree<Key, Value, Compare>::~BinarySearchTree()
+{
+    clear();
+}
+
+/**
+* Replaces the contents of this tree with a copy of other that has the same
+* shape, node for node, instead of inserting other's entries one by one.
+* With threads > 1 (0 means one per hardware thread) the subtrees of a
+* large tree are copied concurrently, each into its own arena, and the
+* arenas are merged at the end. other must not change meanwhile.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::copyFrom(const BinarySearchTree& other, unsigned threads)
+{
+    if (this == &other)
+    {
+        return;
+    }
+    clear();
+    comp_ = other.comp_;
+    cloneFrom(other, threads);
+}
+
+/**
+* Exchanges the nodes, arena and comparator of two trees in O(1).
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::swapContents(BinarySearchTree& other)
+{
+    std::swap(root_, other.root_);
+    std::swap(arena_, other.arena_);
+    std::swap(count_, other.count_);
+    std::swap(comp_, other.comp_);
+}
+
+/**
+* Copies other into this tree, which must be empty. If a copy throws, the
+* nodes copied so far are freed and the tree is left empty.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::cloneFrom(const BinarySearchTree& other, unsigned threads)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (other.size() < (std::size_t(1) << 16))
+    {
+        threads = 1;
+    }
+    nodeArena();
+    try
+    {
+        cloneSubtree(other.root_, nullptr, false, arena_, threads);
+    }
+    catch (...)
+    {
+        destroySubtree(root_);
+        root_ = nullptr;
+        count_ = 0;
+        throw;
+    }
+    count_ = other.count_;
+}
+
+/**
+* Copies the subtree at source and hangs the copy below parent (on the left
+* or right), or at the root when parent is null, allocating from arena.
+* Every node is linked in as soon as it exists, so whatever was copied
+* before an exception is reachable from the root and can be freed.
+*
+* While threads > 1, the left subtree is copied by another thread into an
+* arena of its own, which is merged into arena once both halves are done.
+* Below that the copy is made with an explicit stack, so degenerate trees
+* cannot overflow the call stack.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::cloneSubtree(const Node<Key, Value>* source, Node<Key, Value>* parent, bool left, const std::shared_ptr<NodeArena>& arena, unsigned threads)
+{
+    if (source == nullptr)
+    {
+        return;
+    }
+    Node<Key, Value>* top = cloneNode(source, parent, *arena);
+    if (parent == nullptr)
+    {
+        root_ = top;
+    }
+    else if (left)
+    {
+        parent -> setLeft(top);
+    }
+    else
+    {
+        parent -> setRight(top);
+    }
+
+    if (threads > 1 && source -> getLeft() != nullptr && source -> getRight() != nullptr)
+    {
+        std::shared_ptr<NodeArena> leftArena = std::make_shared<NodeArena>(arena -> slotSize(), arena -> slotAlign());
+        unsigned leftThreads = threads / 2;
+        std::future<void> pending = std::async(std::launch::async, [&]() {
+            cloneSubtree(source -> getLeft(), top, true, leftArena, leftThreads);
+        });
+        std::exception_ptr error;
+        try
+        {
+            cloneSubtree(source -> getRight(), top, false, arena, threads - leftThreads);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        try
+        {
+            pending.get();
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+        NodeArena::merge(arena, leftArena);
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+        return;
+    }
+
+    // (source node, its copy) pairs whose children are still to be copied
+    std::vector<std::pair<const Node<Key, Value>*, Node<Key, Value>*> > stack;
+    stack.push_back(std::make_pair(source, top));
+    while (!stack.empty())
+    {
+        const Node<Key, Value>* from = stack.back().first;
+        Node<Key, Value>* to = stack.back().second;
+        stack.pop_back();
+        if (from -> getRight() != nullptr)
+        {
+            Node<Key, Value>* child = cloneNode(from -> getRight(), to, *arena);
+            to -> setRight(child);
+            stack.push_back(std::make_pair(from -> getRight(), child));
+        }
+        if (from -> getLeft() != nullptr)
+        {
+            Node<Key, Value>* child = cloneNode(from -> getLeft(), to, *arena);
+            to -> setLeft(child);
+            stack.push_back(std::make_pair(from -> getLeft(), child));
+        }
+    }
+}
+
+/**
+* Builds a copy of nodePtr's key and value in a slot of arena, with no
+* children yet.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::cloneNode(const Node<Key, Value>* nodePtr, Node<Key, Value>* parent, NodeArena& arena) const
+{
+    void* slot = arena.allocate();
+    try
+    {
+        return new (slot) Node<Key, Value>(nodePtr -> getKey(), nodePtr -> getValue(), parent);
+    }
+    catch (...)
+    {
+        arena.deallocate(slot);
+        throw;
+    }
+}
+
+/**
+ * Returns true if tree is empty
+*/
+template<class Key, class Value, class Compare>
+bool BinarySearchTree<Key, Value, Compare>::empty() const
+{
+    return root_ == NULL;
+}
+
+/**
+* Returns the number of entries in O(1). Trees that restructure themselves
+* without going through insert/remove (AVLTree) override this.
+*/
+template<class Key, class Value, class Compare>
+std::size_t BinarySearchTree<Key, Value, Compare>::size() const
+{
+    return count_;
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::print() const
+{
+    printRoot(root_);
+    std::cout << "\n";
+}
+
+/**
+* Returns an iterator to the "smallest" item in the tree
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::begin()
+{
+    return iterator(getSmallestNode(), this);
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::begin() const
+{
+    return const_iterator(getSmallestNode(), this);
+}
+
+/**
+* Returns an iterator whose value means INVALID
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::end()
+{
+    return iterator(nullptr, this);
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::end() const
+{
+    return const_iterator(nullptr, this);
+}
+
+/**
+* begin() as a const_iterator, even on a non-const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::cbegin() const
+{
+    return begin();
+}
+
+/**
+* end() as a const_iterator, even on a non-const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::cend() const
+{
+    return end();
+}
+
+/**
+* Returns a reverse iterator to the "largest" item in the tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, Compare>::rbegin()
+{
+    return reverse_iterator(end());
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare>::rbegin() const
+{
+    return const_reverse_iterator(end());
+}
+
+/**
+* Returns the reverse iterator past the smallest item.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::reverse_iterator
+BinarySearchTree<Key, Value, Compare>::rend()
+{
+    return reverse_iterator(begin());
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare>::rend() const
+{
+    return const_reverse_iterator(begin());
+}
+
+/**
+* rbegin() as a const_reverse_iterator, even on a non-const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare>::crbegin() const
+{
+    return rbegin();
+}
+
+/**
+* rend() as a const_reverse_iterator, even on a non-const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare>::crend() const
+{
+    return rend();
+}
+
+/**
+* Returns an iterator pointing at nodePtr (end() for NULL).
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::iteratorAt(Node<Key, Value>* nodePtr)
+{
+    return iterator(nodePtr, this);
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::iteratorAt(Node<Key, Value>* nodePtr) const
+{
+    return const_iterator(nodePtr, this);
+}
+
+/**
+* Returns an iterator to the item with the given key, k
+* or the end iterator if k does not exist in the tree
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::find(const Key & k)
+{
+    return iterator(internalFind(k), this);
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::find(const Key & k) const
+{
+    return const_iterator(internalFind(k), this);
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than key,
+* or end() if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const Key& key)
+{
+    return iterator(internalBound(key, false), this);
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return const_iterator(internalBound(key, false), this);
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than key,
+* or end() if there is none.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const Key& key)
+{
+    return iterator(internalBound(key, true), this);
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return const_iterator(internalBound(key, true), this);
+}
+
+/**
+* Returns the items whose key equals key as [lower_bound, upper_bound);
+* the range holds one item or none.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, typename BinarySearchTree<Key, Value, Compare>::iterator>
+BinarySearchTree<Key, Value, Compare>::equal_range(const Key& key)
+{
+    Node<Key, Value>* first = internalBound(key, false);
+    Node<Key, Value>* last = first;
+    if (first != nullptr && !comp_(key, first->getKey()))
+    {
+        last = successor(first);
+    }
+    return std::make_pair(iterator(first, this), iterator(last, this));
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::const_iterator, typename BinarySearchTree<Key, Value, Compare>::const_iterator>
+BinarySearchTree<Key, Value, Compare>::equal_range(const Key& key) const
+{
+    std::pair<iterator, iterator> found = const_cast<BinarySearchTree<Key, Value, Compare>*>(this) -> equal_range(key);
+    return std::make_pair(const_iterator(found.first), const_iterator(found.second));
+}
+
+/**
+* Returns an iterator to the item with the greatest key not greater than
+* key, or end() if every key is greater.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::floor(const Key& key)
+{
+    return iterator(internalFloor(key), this);
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::floor(const Key& key) const
+{
+    return const_iterator(internalFloor(key), this);
+}
+
+/**
+* Returns an iterator to the item with the smallest key not less than key,
+* or end() if every key is less. The same as lower_bound.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::ceiling(const Key& key)
+{
+    return iterator(internalBound(key, false), this);
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator
+BinarySearchTree<Key, Value, Compare>::ceiling(const Key& key) const
+{
+    return const_iterator(internalBound(key, false), this);
+}
+
+/**
+* Returns the items with keys in [lo, hi) for use in a range-for loop.
+* Finding the ends costs O(log n); the scan itself visits only the range.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator_range
+BinarySearchTree<Key, Value, Compare>::range(const Key& lo, const Key& hi)
+{
+    if (!comp_(lo, hi))
+    {
+        return iterator_range(end(), end());
+    }
+    return iterator_range(lower_bound(lo), lower_bound(hi));
+}
+
+/**
+* As above, for a const tree.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::const_iterator_range
+BinarySearchTree<Key, Value, Compare>::range(const Key& lo, const Key& hi) const
+{
+    if (!comp_(lo, hi))
+    {
+        return const_iterator_range(end(), end());
+    }
+    return const_iterator_range(lower_bound(lo), lower_bound(hi));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value, class Compare>
+Value& BinarySearchTree<Key, Value, Compare>::operator[](const Key& key)
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+template<class Key, class Value, class Compare>
+Value const & BinarySearchTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    Node<Key, Value> *curr = internalFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+/**
+* An insert method to insert into a Binary Search Tree.
+* The tree will not remain balanced when inserting.
+* Recall: If key is already in the tree, you should 
+* overwrite the current value with the updated value.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    assignKey(keyValuePair.first, keyValuePair.second);
+}
+
+/**
+* Inserts or overwrites like the const& overload, but takes any pair and
+* forwards its members, so the key and value of an rvalue pair (such as
+* std::make_pair(k, v)) are moved in instead of copied.
+*/
+template<class Key, class Value, class Compare>
+template<typename P, typename>
+void BinarySearchTree<Key, Value, Compare>::insert(P&& keyValuePair)
+{
+    assignKey(std::get<0>(std::forward<P>(keyValuePair)), std::get<1>(std::forward<P>(keyValuePair)));
+}
+
+/**
+* Builds a key/value pair from args and inserts it if its key is not in
+* the tree yet. Returns the entry with that key and whether it was added.
+* The pair is built before the lookup, so it is thrown away if the key
+* exists; try_emplace avoids that.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::emplace(Args&&... args)
+{
+    std::pair<Key, Value> item(std::forward<Args>(args)...);
+    return emplaceKey(std::move(item.first), std::move(item.second));
+}
+
+/**
+* Inserts key with a value built from args if key is not in the tree yet;
+* otherwise neither the key nor args are touched.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::try_emplace(const Key& key, Args&&... args)
+{
+    return emplaceKey(key, std::forward<Args>(args)...);
+}
+
+/**
+* As above, moving key into the new node.
+*/
+template<class Key, class Value, class Compare>
+template<typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::try_emplace(Key&& key, Args&&... args)
+{
+    return emplaceKey(std::move(key), std::forward<Args>(args)...);
+}
+
+/**
+* Inserts key with value obj, or assigns obj to the existing value.
+* Returns the entry and whether it was newly added.
+*/
+template<class Key, class Value, class Compare>
+template<typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::insert_or_assign(const Key& key, M&& obj)
+{
+    return assignKey(key, std::forward<M>(obj));
+}
+
+/**
+* As above, moving key into the new node.
+*/
+template<class Key, class Value, class Compare>
+template<typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::insert_or_assign(Key&& key, M&& obj)
+{
+    return assignKey(std::move(key), std::forward<M>(obj));
+}
+
+/**
+* The body of emplace and try_emplace: only builds the value once the key
+* is known to be missing.
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::emplaceKey(K&& key, Args&&... args)
+{
+    Node<Key, Value>* parent;
+    bool left;
+    Node<Key, Value>* found = locate(key, parent, left);
+    if (found != nullptr)
+    {
+        return std::make_pair(iterator(found, this), false);
+    }
+    Node<Key, Value>* n = createNode(Key(std::forward<K>(key)), Value(std::forward<Args>(args)...), parent);
+    linkNode(n, parent, left);
+    return std::make_pair(iterator(n, this), true);
+}
+
+/**
+* The body of insert and insert_or_assign: assigns obj over an existing
+* value (moving it when it is an rvalue) or links a new node.
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare>::iterator, bool>
+BinarySearchTree<Key, Value, Compare>::assignKey(K&& key, M&& obj)
+{
+    Node<Key, Value>* parent;
+    bool left;
+    Node<Key, Value>* found = locate(key, parent, left);
+    if (found != nullptr) //nodes are equal
+    {
+        found -> getValue() = std::forward<M>(obj);
+        return std::make_pair(iterator(found, this), false);
+    }
+    Node<Key, Value>* n = createNode(Key(std::forward<K>(key)), Value(std::forward<M>(obj)), parent);
+    linkNode(n, parent, left);
+    return std::make_pair(iterator(n, this), true);
+}
+
+/**
+* Inserts or overwrites like insert, starting the search at hint instead of
+* the root. When the key belongs right next to hint (just before it, or
+* just after it when hint is the previous key) this costs one or two
+* comparisons; otherwise the search climbs from hint only until the key is
+* within range and descends from there. Returns the entry for the key.
+*/
+template<class Key, class Value, class Compare>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::insert(const_iterator hint, const std::pair<const Key, Value>& keyValuePair)
+{
+    return assignNear(hint.current_, keyValuePair.first, keyValuePair.second);
+}
+
+/**
+* As above, forwarding the members of keyValuePair so an rvalue pair is
+* moved in.
+*/
+template<class Key, class Value, class Compare>
+template<typename P, typename>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::insert(const_iterator hint, P&& keyValuePair)
+{
+    return assignNear(hint.current_, std::get<0>(std::forward<P>(keyValuePair)), std::get<1>(std::forward<P>(keyValuePair)));
+}
+
+/**
+* assignKey with the search started from hint (see locateNear).
+*/
+template<class Key, class Value, class Compare>
+template<typename K, typename M>
+typename BinarySearchTree<Key, Value, Compare>::iterator
+BinarySearchTree<Key, Value, Compare>::assignNear(Node<Key, Value>* hint, K&& key, M&& obj)
+{
+    Node<Key, Value>* parent;
+    bool left;
+    Node<Key, Value>* found = locateNear(key, hint, parent, left);
+    if (found != nullptr)
+    {
+        found -> getValue() = std::forward<M>(obj);
+        return iterator(found, this);
+    }
+    Node<Key, Value>* n = createNode(Key(std::forward<K>(key)), Value(std::forward<M>(obj)), parent);
+    linkNode(n, parent, left);
+    return iterator(n, this);
+}
+
+/**
+* Hangs a freshly created node off parent (or makes it the root when parent
+* is NULL). A plain BST does nothing more.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::linkNode(Node<Key, Value>* nodePtr, Node<Key, Value>* parent, bool left)
+{
+    count_++;
+    if (parent == nullptr)
+    {
+        root_ = nodePtr;
+    }
+    else if (left)
+    {
+        parent -> setLeft(nodePtr);
+    }
+    else
+    {
+        parent -> setRight(nodePtr);
+    }
+}
+
+
+/**
+* A remove method to remove a specific key from a Binary Search Tree.
+* Recall: The writeup specifies that if a node has 2 children you
+* should swap with the predecessor and then remove.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::f2(Node<Key, Value>* nodePtr)
+{
+        while (nodePtr->getLeft() != nullptr && nodePtr->getRight() != nullptr)
+        {
+          nodeSwap(nodePtr, predecessor(nodePtr));
+        }
+        if (nodePtr->getLeft() != nullptr || nodePtr->getRight() != nullptr)
+        {
+          f4(nodePtr);
+          return;
+        }
+        else
+        {
+          f3(nodePtr);
+          return;
+        }
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::f3(Node<Key, Value>* nodePtr)
+{
+        if (nodePtr -> getParent() -> getLeft() == nodePtr)
+        {
+            nodePtr -> getParent() -> setLeft(nullptr);
+        }
+        else if (nodePtr -> getParent() -> getRight() == nodePtr)
+        {
+            nodePtr -> getParent() -> setRight(nullptr);
+        }
+        destroyNode(nodePtr);
+        return;
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::f4(Node<Key, Value>* nodePtr)
+{
+    Node<Key, Value>* child;
+      if (nodePtr -> getLeft() == nullptr)
+      {
+        child = nodePtr -> getRight();
+        nodePtr -> getRight() -> setParent(nodePtr -> getParent());
+      }
+      else
+      {
+        child = nodePtr -> getLeft();
+        nodePtr -> getLeft() -> setParent(nodePtr -> getParent());
+      }
+
+      if (nodePtr -> getParent() -> getRight() == nodePtr) // is a right child
+      {
+        nodePtr -> getParent() -> setRight(child); //set parent's child
+      }
+      else // is a left child
+      {
+        nodePtr -> getParent() -> setLeft(child); //set parent's child
+      }
+      destroyNode(nodePtr); //DELETE!
+}
+
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::remove(const Key& key) 
+{
+    Node<Key, Value>* nodePtr = internalFind(key);
+
+    /*
+    Case 1: Node DNE in given tree.
+    */
+    if (nodePtr == nullptr)
+    {
+      return;
+    }
+    count_--;
+
+    /*
+    Case 1.5: Deleting root_ with either NO children or ONE child
+    */
+    if (nodePtr -> getParent() == nullptr)
+    {
+        if (nodePtr->getLeft() == nullptr && nodePtr->getRight() != nullptr) //only a right node
+        { 
+          root_ = nodePtr -> getRight();
+          root_ -> setParent(nullptr);
+          destroyNode(nodePtr);
+          return;
+        }
+      else if (nodePtr->getLeft() != nullptr && nodePtr->getRight() == nullptr) //only a left node
+        { 
+          root_ = nodePtr -> getLeft();
+          root_ -> setParent(nullptr);
+          destroyNode(nodePtr);
+          return;
+        }
+        else if (nodePtr -> getLeft() == nullptr && nodePtr -> getRight() == nullptr) //neither left or right node
+        {
+          destroyNode(nodePtr);
+          root_ = nullptr;
+          return;
+        }
+    }
+    /*
+    Case 2: Node has two children.
+    */
+    if (nodePtr->getLeft() != nullptr && nodePtr->getRight() != nullptr)
+    {
+      f2(nodePtr);
+      return;
+    }
+    /*
+    Case 3: Node has no children (non root_ case)
+    */
+    if (nodePtr->getLeft() == nullptr && nodePtr->getRight() == nullptr)
+    {
+      f3(nodePtr);
+      return;
+    }
+    /*
+    Case 4: Node has one child (non root_ case)
+    */
+   if (nodePtr->getLeft() == nullptr || nodePtr->getRight() == nullptr)
+   {
+    f4(nodePtr);
+    return;
+   }
+}
+
+
+
+/**
+* Returns the node after current in key order, or NULL if current is the
+* last. Walks down to the leftmost node of the right subtree, or up until
+* it arrives from a left child.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::successor(Node<Key, Value>* current)
+{
+    Node<Key, Value>* next = current -> getRight();
+    if (next != nullptr)
+    {
+        while (next -> getLeft() != nullptr)
+        {
+            next = next -> getLeft();
+        }
+        return next;
+    }
+    next = current -> getParent();
+    while (next != nullptr && next -> getRight() == current)
+    {
+        current = next;
+        next = next -> getParent();
+    }
+    return next;
+}
+
+template<class Key, class Value, class Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::predecessor(Node<Key, Value>* current)
+{
+    //case where current is root_ and left subtree is empty
+    if (current -> getParent() == nullptr && current -> getLeft() == nullptr) 
+    {
+        return nullptr;
+    }
+
+    //case where you can take a step down first
+    if (current -> getLeft() != nullptr) 
+    {
+        current = current -> getLeft();
+        while (current -> getRight() != nullptr)
+        {
+          current = current -> getRight();
+        }
+        return current;
+    }
+
+    //otherwise, this is the case where you can't take a step down so you have to move up
+    while (current -> getParent() != nullptr && current -> getParent() -> getRight() != current) 
+    {
+        current = current -> getParent();
+    }
+
+    if (current -> getParent() == nullptr) //checking if current was actually smallest node in the tree. returning nullptr if so.
+    {
+        return nullptr;
+    }
+    current = current -> getParent();
+    return current;
+}
+
+
+/**
+* Builds a node in a slot taken from the tree's arena.
+*/
+template<class Key, class Value, class Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::createNode(Key&& key, Value&& value, Node<Key, Value>* parent)
 {
-        if (nodePtr -> getParent() -> getLeft() == nodePtr)
+    NodeArena& arena = nodeArena();
+    void* slot = arena.allocate();
+    try
+    {
+        return new (slot) Node<Key, Value>(std::move(key), std::move(value), parent);
+    }
+    catch (...)
+    {
+        arena.deallocate(slot);
+        throw;
+    }
+}
+
+/**
+* Destroys a node and returns its slot to the arena for reuse.
+*/
+template<class Key, class Value, class Compare>
+void BinarySearchTree<Key, Value, Compare>::destroyNode(Node<Key, Value>* nodePtr)
+{
+    nodePtr->~Node();
+    nodeArena().deallocate(nodePtr);
+}
+
+/**
+* The arena that currently owns this tree's nodes (following any merges),
+* made here the first time the tree needs one.
+*/
+template<class Key, class Value, class Compare>
+NodeArena& BinarySearchTree<Key, Value, Compare>::nodeArena()
+{
+    if (!arena_)
+    {
+        arena_ = std::make_shared<NodeArena>(nodeSize_, nodeAlign_);
+    }
+    return NodeArena::resolve(arena_);
+}
+
+/**
+* Replaces the contents of the tree with the pairs in [first, last), which
+* must be sorted by key, and links them into a perfectly balanced shape in
+* O(n) time. Runs of equal keys collapse to one entry holding the last value,
+* matching insert(). A key smaller than its predecessor throws
+* std::invalid_argument and leaves the tree empty, as does any exception
+* from copying an entry; the nodes built so far are freed.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt>
+void BinarySearchTree<Key, Value, Compare>::assignSorted(InputIt first, InputIt last)
+{
+    clear();
+    std::vector<Node<Key, Value>*> nodes;
+    if (std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<InputIt>::iterator_category>::value)
+    {
+        nodes.reserve(std::distance(first, last));
+    }
+    try
+    {
+        for (; first != last; ++first)
         {
-            nodePtr -> getParent() -> setLeft(nullptr);
+            const Key& key = first->first;
+            if (!nodes.empty() && !comp_(nodes.back()->getKey(), key))
+            {
+                if (comp_(key, nodes.back()->getKey()))
+                {
+                    throw std::invalid_argument("assignSorted: keys are not sorted");
+                }
+                nodes.back()->setValue(first->second);
+                continue;
+            }
+            // the slot is added first so a node is never built without one
+            nodes.push_back(nullptr);
+            nodes.back() = createNode(Key(key), Value(first->second), nullptr);
         }
-        else if (nodePtr -> getParent() -> getRight() == nodePtr)
+    }
+    catch (...)
+    {
+        for (std::size_t i = 0; i < nodes.size(); i++)
         {
-            nodePtr -> getParent() -> setRight(nullptr);
+            if (nodes[i] != nullptr)
+            {
+                destroyNode(nodes[i]);
+            }
+        }
+        throw;
+    }
+    int height;
+    root_ = linkBalanced(nodes, 0, nodes.size(), nullptr, height);
+    count_ = nodes.size();
+}
+
+/**
+* Returns a read-only, cache-friendly copy of the current contents. Later
+* changes to the tree do not affect it.
+*/
+template<typename Key, typename Value, typename Compare>
+FrozenTree<Key, Value, Compare> BinarySearchTree<Key, Value, Compare>::freeze() const
+{
+    if (root_ == nullptr)
+    {
+        return FrozenTree<Key, Value, Compare>(comp_);
+    }
+    return FrozenTree<Key, Value, Compare>(begin(), end(), comp_);
+}
+
+/**
+* Writes the contents to out in a versioned binary format (see TreeCodec
+* for how keys and values are encoded): a header holding a magic number,
+* the format version, the key and value sizes for raw types, and the entry
+* count, followed by the entries in key order. When both the key and the
+* value are raw the entries are packed into blocks and written a block at
+* a time. Throws std::runtime_error if out fails.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::serialize(std::ostream& out) const
+{
+    typedef TreeCodec<Key> KeyCodec;
+    typedef TreeCodec<Value> ValueCodec;
+    out.write(serialMagic, sizeof(serialMagic));
+    TreeCodec<std::uint32_t>::write(out, serialVersion);
+    TreeCodec<std::uint32_t>::write(out, KeyCodec::raw ? sizeof(Key) : 0);
+    TreeCodec<std::uint32_t>::write(out, ValueCodec::raw ? sizeof(Value) : 0);
+    TreeCodec<std::uint64_t>::write(out, size());
+    writeEntries(out, std::integral_constant<bool, KeyCodec::raw && ValueCodec::raw>());
+    if (!out)
+    {
+        throw std::runtime_error("serialize: write failed");
+    }
+}
+
+/**
+* Replaces the contents of the tree with what serialize() wrote to in. The
+* entries arrive in key order, so the nodes are built straight from the
+* stream and linked into a balanced tree in O(n), with no descents. A
+* stream from another format version, other key or value types, or that is
+* truncated or out of order throws std::runtime_error and leaves the tree
+* empty.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::deserialize(std::istream& in)
+{
+    typedef TreeCodec<Key> KeyCodec;
+    typedef TreeCodec<Value> ValueCodec;
+    clear();
+    char magic[sizeof(serialMagic)];
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, serialMagic, sizeof(magic)) != 0)
+    {
+        throw std::runtime_error("deserialize: not a serialized tree");
+    }
+    if (TreeCodec<std::uint32_t>::read(in) != serialVersion)
+    {
+        throw std::runtime_error("deserialize: unsupported format version");
+    }
+    std::uint32_t keySize = TreeCodec<std::uint32_t>::read(in);
+    std::uint32_t valueSize = TreeCodec<std::uint32_t>::read(in);
+    if (keySize != (KeyCodec::raw ? sizeof(Key) : 0) || valueSize != (ValueCodec::raw ? sizeof(Value) : 0))
+    {
+        throw std::runtime_error("deserialize: key or value type does not match");
+    }
+    std::uint64_t count = TreeCodec<std::uint64_t>::read(in);
+
+    std::vector<Node<Key, Value>*> nodes;
+    try
+    {
+        readEntries(in, count, nodes, std::integral_constant<bool, KeyCodec::raw && ValueCodec::raw>());
+    }
+    catch (...)
+    {
+        for (std::size_t i = 0; i < nodes.size(); i++)
+        {
+            destroyNode(nodes[i]);
+        }
+        throw;
+    }
+    int height;
+    root_ = linkBalanced(nodes, 0, nodes.size(), nullptr, height);
+    count_ = nodes.size();
+}
+
+/**
+* serialize() for raw keys and values: entries are packed key then value,
+* with no padding, into blocks of serialBlock entries.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::writeEntries(std::ostream& out, std::true_type) const
+{
+    const std::size_t entryBytes = sizeof(Key) + sizeof(Value);
+    std::vector<char> block(serialBlock * entryBytes);
+    std::size_t used = 0;
+    for (Node<Key, Value>* node = getSmallestNode(); node != nullptr; node = successor(node))
+    {
+        TreeCodec<Key>::toBytes(node -> getKey(), &block[used]);
+        TreeCodec<Value>::toBytes(node -> getValue(), &block[used + sizeof(Key)]);
+        used += entryBytes;
+        if (used == block.size())
+        {
+            out.write(&block[0], used);
+            used = 0;
+        }
+    }
+    out.write(&block[0], used);
+}
+
+/**
+* serialize() for everything else: each key and value through its codec.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::writeEntries(std::ostream& out, std::false_type) const
+{
+    for (Node<Key, Value>* node = getSmallestNode(); node != nullptr; node = successor(node))
+    {
+        TreeCodec<Key>::write(out, node -> getKey());
+        TreeCodec<Value>::write(out, node -> getValue());
+    }
+}
+
+/**
+* deserialize() for raw keys and values, a block at a time. New nodes are
+* appended to nodes as they are built, so the caller can free them if
+* this throws.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::readEntries(std::istream& in, std::uint64_t count, std::vector<Node<Key, Value>*>& nodes, std::true_type)
+{
+    const std::size_t entryBytes = sizeof(Key) + sizeof(Value);
+    std::vector<char> block(serialBlock * entryBytes);
+    while (count > 0)
+    {
+        std::size_t entries = count < serialBlock ? static_cast<std::size_t>(count) : serialBlock;
+        if (!in.read(&block[0], entries * entryBytes))
+        {
+            throw std::runtime_error("deserialize: stream ended early");
+        }
+        for (std::size_t i = 0; i < entries; i++)
+        {
+            const char* entry = &block[i * entryBytes];
+            appendEntry(nodes, TreeCodec<Key>::fromBytes(entry), TreeCodec<Value>::fromBytes(entry + sizeof(Key)));
+        }
+        count -= entries;
+    }
+}
+
+/**
+* deserialize() for everything else, an entry at a time.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::readEntries(std::istream& in, std::uint64_t count, std::vector<Node<Key, Value>*>& nodes, std::false_type)
+{
+    for (; count > 0; count--)
+    {
+        Key key = TreeCodec<Key>::read(in);
+        Value value = TreeCodec<Value>::read(in);
+        appendEntry(nodes, std::move(key), std::move(value));
+    }
+}
+
+/**
+* Builds the node for the next deserialized entry, whose key must come
+* strictly after the previous one.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::appendEntry(std::vector<Node<Key, Value>*>& nodes, Key&& key, Value&& value)
+{
+    if (!nodes.empty() && !comp_(nodes.back()->getKey(), key))
+    {
+        throw std::runtime_error("deserialize: keys are out of order");
+    }
+    Node<Key, Value>* n = createNode(std::move(key), std::move(value), nullptr);
+    try
+    {
+        nodes.push_back(n);
+    }
+    catch (...)
+    {
+        destroyNode(n);
+        throw;
+    }
+}
+
+/**
+* Writes the tree in the file format MappedTree serves from: a
+* MappedTreeHeader padded to MappedTreeHeader::headerBytes, then one
+* MappedNode per entry whose links are offsets relative to the node. The
+* tree keeps its shape; only the order of the nodes in the file changes,
+* to van Emde Boas order, so that each page holds whole pieces of search
+* paths. Keys and values must be trivially copyable. Throws
+* std::runtime_error if out fails.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::writeMapped(std::ostream& out) const
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "writeMapped needs trivially copyable keys and values");
+    typedef MappedNode<Key, Value> Mapped;
+
+    // Number the nodes in preorder and record the shape by those numbers,
+    // so the layout and the links below need no pointer lookups.
+    const std::size_t none = static_cast<std::size_t>(-1);
+    std::vector<const Node<Key, Value>*> nodes;
+    std::vector<std::size_t> left;
+    std::vector<std::size_t> right;
+    std::vector<std::size_t> parent;
+    int height = 0;
+    // (node, its parent's number, its level)
+    std::vector<std::tuple<const Node<Key, Value>*, std::size_t, int> > stack;
+    if (root_ != nullptr)
+    {
+        stack.push_back(std::make_tuple(root_, none, 1));
+    }
+    while (!stack.empty())
+    {
+        const Node<Key, Value>* nodePtr = std::get<0>(stack.back());
+        std::size_t up = std::get<1>(stack.back());
+        int level = std::get<2>(stack.back());
+        stack.pop_back();
+        std::size_t index = nodes.size();
+        nodes.push_back(nodePtr);
+        left.push_back(none);
+        right.push_back(none);
+        parent.push_back(up);
+        if (up != none)
+        {
+            (nodes[up] -> getLeft() == nodePtr ? left[up] : right[up]) = index;
+        }
+        height = std::max(height, level);
+        if (nodePtr -> getRight() != nullptr)
+        {
+            stack.push_back(std::make_tuple(nodePtr -> getRight(), index, level + 1));
+        }
+        if (nodePtr -> getLeft() != nullptr)
+        {
+            stack.push_back(std::make_tuple(nodePtr -> getLeft(), index, level + 1));
+        }
+    }
+
+    std::vector<std::size_t> order;
+    order.reserve(nodes.size());
+    if (!nodes.empty())
+    {
+        layoutBlocked(0, height, left, right, order);
+    }
+    std::vector<std::int64_t> position(nodes.size());
+    for (std::size_t i = 0; i < order.size(); i++)
+    {
+        position[order[i]] = static_cast<std::int64_t>(i);
+    }
+
+    char header[MappedTreeHeader::headerBytes] = {};
+    MappedTreeHeader fields;
+    std::memcpy(fields.magic, "BSTM", 4);
+    fields.version = MappedTreeHeader::currentVersion;
+    fields.keySize = sizeof(Key);
+    fields.valueSize = sizeof(Value);
+    fields.nodeSize = sizeof(Mapped);
+    fields.reserved = 0;
+    fields.count = order.size();
+    fields.root = order.empty() ? 0 : MappedTreeHeader::headerBytes + position[0] * sizeof(Mapped);
+    std::memcpy(header, &fields, sizeof(fields));
+    out.write(header, sizeof(header));
+
+    std::vector<char> block(serialBlock * sizeof(Mapped));
+    std::size_t used = 0;
+    for (std::size_t i = 0; i < order.size(); i++)
+    {
+        std::size_t index = order[i];
+        std::int64_t links[3] = { 0, 0, 0 };
+        std::size_t targets[3] = { left[index], right[index], parent[index] };
+        for (int j = 0; j < 3; j++)
+        {
+            if (targets[j] != none)
+            {
+                links[j] = (position[targets[j]] - static_cast<std::int64_t>(i)) * static_cast<std::int64_t>(sizeof(Mapped));
+            }
+        }
+        // zero the slot first so padding bytes are not left uninitialized
+        std::memset(&block[used], 0, sizeof(Mapped));
+        new (&block[used]) Mapped{ nodes[index] -> getItem(), links[0], links[1], links[2] };
+        used += sizeof(Mapped);
+        if (used == block.size())
+        {
+            out.write(&block[0], used);
+            used = 0;
         }
-        delete nodePtr;
+    }
+    out.write(&block[0], used);
+    if (!out)
+    {
+        throw std::runtime_error("writeMapped: write failed");
+    }
+}
+
+/**
+* Appends the top levels levels of the subtree at index to order in van
+* Emde Boas order: the upper half of those levels, laid out the same way,
+* then each subtree hanging below it, left to right. Nodes are numbered as
+* in writeMapped, with left and right giving each node's children (or -1).
+* Recursion depth is O(log levels); the nodes at a given depth are found
+* with an explicit stack.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::layoutBlocked(std::size_t index, int levels, const std::vector<std::size_t>& left, const std::vector<std::size_t>& right, std::vector<std::size_t>& order)
+{
+    const std::size_t none = static_cast<std::size_t>(-1);
+    if (levels == 1)
+    {
+        order.push_back(index);
         return;
+    }
+    int top = levels / 2;
+    layoutBlocked(index, top, left, right, order);
+
+    // the nodes top levels below index, left to right
+    std::vector<std::size_t> below;
+    std::vector<std::pair<std::size_t, int> > stack;
+    stack.push_back(std::make_pair(index, 0));
+    while (!stack.empty())
+    {
+        std::size_t current = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+        if (depth == top)
+        {
+            below.push_back(current);
+            continue;
+        }
+        if (right[current] != none)
+        {
+            stack.push_back(std::make_pair(right[current], depth + 1));
+        }
+        if (left[current] != none)
+        {
+            stack.push_back(std::make_pair(left[current], depth + 1));
+        }
+    }
+    for (std::size_t i = 0; i < below.size(); i++)
+    {
+        layoutBlocked(below[i], levels - top, left, right, order);
+    }
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::f4(Node<Key, Value>* nodePtr)
+/**
+* Returns a copy of the comparator that orders the keys.
+*/
+template<typename Key, typename Value, typename Compare>
+Compare BinarySearchTree<Key, Value, Compare>::key_comp() const
 {
-    Node<Key, Value>* child;
-      if (nodePtr -> getLeft() == nullptr)
-      {
-        child = nodePtr -> getRight();
-        nodePtr -> getRight() -> setParent(nodePtr -> getParent());
-      }
-      else
-      {
-        child = nodePtr -> getLeft();
-        nodePtr -> getLeft() -> setParent(nodePtr -> getParent());
-      }
+    return comp_;
+}
 
-      if (nodePtr -> getParent() -> getRight() == nodePtr) // is a right child
-      {
-        nodePtr -> getParent() -> setRight(child); //set parent's child
-      }
-      else // is a left child
-      {
-        nodePtr -> getParent() -> setLeft(child); //set parent's child
-      }
-      delete nodePtr; //DELETE!
+/**
+* The structural counters of every tree in the process, summed over all
+* threads; see tree-stats.h. All zero unless built with BST_STATS.
+*/
+template<typename Key, typename Value, typename Compare>
+TreeStats BinarySearchTree<Key, Value, Compare>::stats()
+{
+    return TreeStats::snapshot();
+}
+
+/**
+* Zeroes the structural counters.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::resetStats()
+{
+    TreeStats::reset();
+}
+
+/**
+* Inserts a batch of pairs in any order. The batch is sorted first (stably,
+* so among equal keys the last one wins, as with repeated insert()). Small
+* batches are then inserted in key order, which keeps consecutive descents
+* on the same path; large ones are merged with the existing in-order node
+* sequence and the whole tree is relinked in O(n + m), reusing every
+* existing node.
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt>
+void BinarySearchTree<Key, Value, Compare>::insert_range(InputIt first, InputIt last)
+{
+    std::vector<std::pair<Key, Value> > batch;
+    for (; first != last; ++first)
+    {
+        batch.push_back(*first);
+    }
+    std::stable_sort(batch.begin(), batch.end(),
+        [this](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) { return comp_(a.first, b.first); });
+
+    // collapse runs of equal keys onto their last element
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < batch.size(); i++)
+    {
+        if (kept > 0 && !comp_(batch[kept - 1].first, batch[i].first))
+        {
+            batch[kept - 1].second = std::move(batch[i].second);
+            continue;
+        }
+        if (kept != i)
+        {
+            batch[kept] = std::move(batch[i]);
+        }
+        kept++;
+    }
+    batch.resize(kept);
+
+    // A descent costs about log2(n) steps and relinking one step per node, so
+    // relink only while n <= m * log2(n). The walk stops as soon as the node
+    // count rules that out, which keeps small batches from touching the whole tree.
+    std::vector<Node<Key, Value>*> existing;
+    std::size_t logN = 1;
+    bool relink = true;
+    for (iterator it = (root_ == nullptr ? end() : begin()); it != end(); ++it)
+    {
+        existing.push_back(it.current_);
+        if ((std::size_t(1) << logN) <= existing.size())
+        {
+            logN++;
+        }
+        if (existing.size() > batch.size() * logN)
+        {
+            relink = false;
+            break;
+        }
+    }
+    if (!relink)
+    {
+        for (std::size_t i = 0; i < batch.size(); i++)
+        {
+            insert(std::move(batch[i]));
+        }
+        return;
+    }
+
+    // build the nodes for new keys up front so a failed allocation leaves the
+    // tree untouched; batch entries for existing keys are remembered in hits
+    std::vector<Node<Key, Value>*> fresh;
+    std::vector<std::pair<Node<Key, Value>*, std::size_t> > hits;
+    try
+    {
+        std::size_t e = 0;
+        for (std::size_t i = 0; i < batch.size(); i++)
+        {
+            while (e < existing.size() && comp_(existing[e]->getKey(), batch[i].first))
+            {
+                e++;
+            }
+            if (e == existing.size() || comp_(batch[i].first, existing[e]->getKey()))
+            {
+                fresh.push_back(createNode(std::move(batch[i].first), std::move(batch[i].second), nullptr));
+            }
+            else
+            {
+                hits.push_back(std::make_pair(existing[e], i));
+            }
+        }
+    }
+    catch (...)
+    {
+        for (std::size_t i = 0; i < fresh.size(); i++)
+        {
+            destroyNode(fresh[i]);
+        }
+        throw;
+    }
+    for (std::size_t i = 0; i < hits.size(); i++)
+    {
+        hits[i].first->setValue(std::move(batch[hits[i].second].second));
+    }
+
+    // existing and fresh are both sorted and share no keys
+    std::vector<Node<Key, Value>*> merged;
+    merged.reserve(existing.size() + fresh.size());
+    std::size_t e = 0, f = 0;
+    while (e < existing.size() || f < fresh.size())
+    {
+        if (f == fresh.size() || (e < existing.size() && comp_(existing[e]->getKey(), fresh[f]->getKey())))
+        {
+            merged.push_back(existing[e++]);
+        }
+        else
+        {
+            merged.push_back(fresh[f++]);
+        }
+    }
+
+    int height;
+    root_ = linkBalanced(merged, 0, merged.size(), nullptr, height);
+    count_ = merged.size();
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key) 
+/**
+* Links nodes[lo, hi), which are in key order, into a balanced subtree under
+* parent and returns its root. The middle element becomes the root so the two
+* halves differ in size by at most one; height receives the subtree height.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::linkBalanced(const std::vector<Node<Key, Value>*>& nodes, std::size_t lo, std::size_t hi, Node<Key, Value>* parent, int& height)
 {
-    Node<Key, Value>* nodePtr = internalFind(key);
-
-    /*
-    Case 1: Node DNE in given tree.
-    */
-    if (nodePtr == nullptr)
+    if (lo == hi)
     {
-      return;
+        height = 0;
+        return nullptr;
     }
+    std::size_t mid = lo + (hi - lo) / 2;
+    Node<Key, Value>* nodePtr = nodes[mid];
+    int leftHeight, rightHeight;
+    nodePtr->setParent(parent);
+    nodePtr->setLeft(linkBalanced(nodes, lo, mid, nodePtr, leftHeight));
+    nodePtr->setRight(linkBalanced(nodes, mid + 1, hi, nodePtr, rightHeight));
+    refreshNode(nodePtr, leftHeight, rightHeight);
+    height = std::max(leftHeight, rightHeight) + 1;
+    return nodePtr;
+}
 
-    /*
-    Case 1.5: Deleting root_ with either NO children or ONE child
-    */
-    if (nodePtr -> getParent() == nullptr)
+/**
+* A plain BST keeps no per-node shape data, so there is nothing to refresh.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::refreshNode(Node<Key, Value>*, int, int)
+{
+
+}
+
+/**
+* Destroys every node of the subtree at nodePtr in O(1) extra space, so a
+* degenerate tree of any depth can be torn down without running out of
+* stack. A node with a left child is rotated right until it has none, and
+* is then destroyed and its right subtree taken next; each rotation moves
+* one node onto the right spine for good, so there are fewer than n of them.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::destroySubtree(Node<Key, Value>* nodePtr)
+{
+    while (nodePtr != nullptr)
     {
-        if (nodePtr->getLeft() == nullptr && nodePtr->getRight() != nullptr) //only a right node
-        { 
-          root_ = nodePtr -> getRight();
-          root_ -> setParent(nullptr);
-          delete nodePtr;
-          return;
-        }
-      else if (nodePtr->getLeft() != nullptr && nodePtr->getRight() == nullptr) //only a left node
-        { 
-          root_ = nodePtr -> getLeft();
-          root_ -> setParent(nullptr);
-          delete nodePtr;
-          return;
+        Node<Key, Value>* left = nodePtr -> getLeft();
+        if (left != nullptr)
+        {
+            nodePtr -> setLeft(left -> getRight());
+            left -> setRight(nodePtr);
+            nodePtr = left;
         }
-        else if (nodePtr -> getLeft() == nullptr && nodePtr -> getRight() == nullptr) //neither left or right node
+        else
         {
-          delete nodePtr;
-          root_ = nullptr;
-          return;
+            Node<Key, Value>* right = nodePtr -> getRight();
+            destroyNode(nodePtr);
+            nodePtr = right;
         }
     }
-    /*
-    Case 2: Node has two children.
-    */
-    if (nodePtr->getLeft() != nullptr && nodePtr->getRight() != nullptr)
+}
+
+/**
+* A method to remove all contents of the tree and
+* reset the values in the tree for use again.
+*
+* Nodes holding trivially destructible keys and values need no per-node
+* teardown, so their slabs are dropped in bulk without walking the tree.
+* That is only possible while no other tree shares the arena. A tree that
+* has no arena yet has no nodes either, and is left without one.
+*/
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::clear()
+{
+    if (!arena_)
     {
-      f2(nodePtr);
-      return;
+        return;
     }
-    /*
-    Case 3: Node has no children (non root_ case)
-    */
-    if (nodePtr->getLeft() == nullptr && nodePtr->getRight() == nullptr)
+    NodeArena& arena = nodeArena();
+    bool owner = arena_.use_count() == 1;
+    bool bulk = NodeArena::pooled && owner
+        && std::is_trivially_destructible<Key>::value
+        && std::is_trivially_destructible<Value>::value;
+    if (!bulk)
     {
-      f3(nodePtr);
-      return;
+        destroySubtree(root_);
     }
-    /*
-    Case 4: Node has one child (non root_ case)
-    */
-   if (nodePtr->getLeft() == nullptr || nodePtr->getRight() == nullptr)
-   {
-    f4(nodePtr);
-    return;
-   }
+    if (owner)
+    {
+        arena.release();
+    }
+    root_ = nullptr;
+    count_ = 0;
 }
 
 
+/**
+* A helper function to find the smallest node in the tree.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Compare>::getSmallestNode() const
+{
+    Node<Key, Value>* finder = root_;
+    while (finder != nullptr && finder -> getLeft() != nullptr)
+    {
+        finder = finder -> getLeft();
+    }
+    return finder;
+}
 
-template<class Key, class Value>
+/**
+* Returns the node with the largest key, or NULL for an empty tree.
+*/
+template<typename Key, typename Value, typename Compare>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+BinarySearchTree<Key, Value, Compare>::getLargestNode() const
 {
-    //case where current is root_ and left subtree is empty
-    if (current -> getParent() == nullptr && current -> getLeft() == nullptr) 
+    Node<Key, Value>* finder = root_;
+    while (finder != nullptr && finder -> getRight() != nullptr)
     {
-        return nullptr;
+        finder = finder -> getRight();
     }
+    return finder;
+}
 
-    //case where you can take a step down first
-    if (current -> getLeft() != nullptr) 
+/**
+* Helper function to find a node with given key, k and
+* return a pointer to it or NULL if no item with that key
+* exists
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalFind(const Key& key) const
+{
+    Node<Key, Value>* parent;
+    bool left;
+    return locate(key, parent, left);
+}
+
+/**
+* Walks down from the root looking for key and returns its node, or NULL.
+* parent receives the last node visited and left which side of it the walk
+* would continue on, which is where a new node for key belongs.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::locate(const Key& key, Node<Key, Value>*& parent, bool& left) const
+{
+    return locate(key, root_, parent, left, ThreeWayCompare<Compare>());
+}
+
+/**
+* The descent for comparators with a three-way form: one compare() per level,
+* stopping at an equal key. start is root_ or, for locateNear, a node whose
+* subtree is known to span key.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::locate(const Key& key, Node<Key, Value>* start, Node<Key, Value>*& parent, bool& left, std::true_type) const
+{
+    Node<Key, Value>* finder = start;
+    parent = nullptr;
+    left = false;
+    BST_STATS_ADD(StatDescents, 1);
+    while (finder != nullptr)
     {
-        current = current -> getLeft();
-        while (current -> getRight() != nullptr)
+        BST_STATS_ADD(StatNodesVisited, 1);
+        BST_STATS_ADD(StatComparisons, 1);
+        int order = ThreeWayCompare<Compare>::compare(comp_, key, finder->getKey());
+        if (order == 0)
         {
-          current = current -> getRight();
+            return finder;
         }
-        return current;
+        parent = finder;
+        left = order < 0;
+        finder = left ? finder -> getLeft() : finder -> getRight();
     }
+    return nullptr;
+}
 
-    //otherwise, this is the case where you can't take a step down so you have to move up
-    while (current -> getParent() -> getRight() != current && current != nullptr) 
+/**
+* The descent for plain comparators: one comp_ call per level, remembering
+* the last node not less than key, which is the only one that can equal it.
+*/
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::locate(const Key& key, Node<Key, Value>* start, Node<Key, Value>*& parent, bool& left, std::false_type) const
+{
+    Node<Key, Value>* finder = start;
+    Node<Key, Value>* candidate = nullptr;
+    parent = nullptr;
+    left = false;
+    BST_STATS_ADD(StatDescents, 1);
+    while (finder != nullptr)
     {
-        current = current -> getParent();
+        BST_STATS_ADD(StatNodesVisited, 1);
+        parent = finder;
+        left = !comp_(finder->getKey(), key);
+        if (left)
+        {
+            candidate = finder;
+            finder = finder -> getLeft();
+        }
+        else
+        {
+            finder = finder -> getRight();
+        }
     }
-
-    if (current == nullptr) //checking if current was actually smallest node in the tree. returning nullptr if so.
+    if (candidate != nullptr && !comp_(key, candidate->getKey()))
     {
-        return nullptr;
+        return candidate;
     }
-    current = current -> getParent();
-    return current;
+    return nullptr;
 }
 
-
 /**
-* A method to remove all contents of the tree and
-* reset the values in the tree for use again.
+* locate() for a key expected next to hint (NULL standing for end()). The
+* gap just before hint, and just after it, is checked first; failing that,
+* the walk climbs from hint until it reaches a node whose subtree must hold
+* key and descends from there, so its cost grows with the distance from
+* hint rather than with the size of the tree.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::postorderDestroyer(Node<Key, Value>* nodePtr)
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::locateNear(const Key& key, Node<Key, Value>* hint, Node<Key, Value>*& parent, bool& left) const
 {
-    if (nodePtr != nullptr) {
-      postorderDestroyer(nodePtr->getLeft());
-      postorderDestroyer(nodePtr->getRight());
-      delete nodePtr;
-   }
-}
+    parent = nullptr;
+    left = false;
+    if (root_ == nullptr)
+    {
+        return nullptr;
+    }
+    bool before = true;
+    if (hint != nullptr)
+    {
+        before = comp_(key, hint -> getKey());
+        if (!before && !comp_(hint -> getKey(), key))
+        {
+            return hint;
+        }
+    }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
-{
-    postorderDestroyer(root_);
-    root_ = nullptr;
-}
+    // neighbour: the entry on the far side of the gap next to hint
+    Node<Key, Value>* neighbour = hint;
+    if (before)
+    {
+        if (hint == nullptr)
+        {
+            neighbour = root_;
+            while (neighbour -> getRight() != nullptr)
+            {
+                neighbour = neighbour -> getRight();
+            }
+        }
+        else
+        {
+            neighbour = predecessor(hint);
+        }
+        if (neighbour == nullptr || comp_(neighbour -> getKey(), key))
+        {
+            // the new node goes on hint's empty left or the neighbour's empty right
+            left = hint != nullptr && hint -> getLeft() == nullptr;
+            parent = left ? hint : neighbour;
+            return nullptr;
+        }
+    }
+    else
+    {
+        neighbour = successor(hint);
+        if (neighbour == nullptr || comp_(key, neighbour -> getKey()))
+        {
+            left = hint -> getRight() != nullptr;
+            parent = left ? neighbour : hint;
+            return nullptr;
+        }
+    }
+    if (!comp_(key, neighbour -> getKey()) && !comp_(neighbour -> getKey(), key))
+    {
+        return neighbour;
+    }
 
+    // key lies beyond neighbour, on the side away from hint: climb until
+    // an ancestor bounds the subtree on that side with key inside it
+    bool below = comp_(key, neighbour -> getKey());
+    Node<Key, Value>* top = neighbour;
+    while (top -> getParent() != nullptr)
+    {
+        Node<Key, Value>* up = top -> getParent();
+        if ((up -> getLeft() == top) != below)
+        {
+            bool inside = below ? comp_(up -> getKey(), key) : comp_(key, up -> getKey());
+            if (inside)
+            {
+                break;
+            }
+            if (!comp_(key, up -> getKey()) && !comp_(up -> getKey(), key))
+            {
+                return up;
+            }
+        }
+        top = up;
+    }
+    return locate(key, top, parent, left, ThreeWayCompare<Compare>());
+}
 
 /**
-* A helper function to find the smallest node in the tree.
+* The internalFind descent, remembering the last node where it turned left:
+* the first node whose key is greater than key (strict) or not less than
+* key, or NULL if there is none.
 */
-template<typename Key, typename Value>
-Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalBound(const Key& key, bool strict) const
 {
     Node<Key, Value>* finder = root_;
-    while (finder -> getLeft() != nullptr)
+    Node<Key, Value>* candidate = nullptr;
+    BST_STATS_ADD(StatDescents, 1);
+    while (finder != nullptr)
     {
-        finder = finder -> getLeft();
+        BST_STATS_ADD(StatNodesVisited, 1);
+        if (strict ? comp_(key, finder->getKey()) : !comp_(finder->getKey(), key))
+        {
+            candidate = finder;
+            finder = finder -> getLeft();
+        }
+        else
+        {
+            finder = finder -> getRight();
+        }
     }
-    return finder;
+    return candidate;
 }
 
 /**
-* Helper function to find a node with given key, k and
-* return a pointer to it or NULL if no item with that key
-* exists
+* The mirror of internalBound: the last node whose key is not greater than
+* key, or NULL if there is none.
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Compare>::internalFloor(const Key& key) const
 {
     Node<Key, Value>* finder = root_;
-    while (finder != nullptr && finder -> getKey() != key)
+    Node<Key, Value>* candidate = nullptr;
+    BST_STATS_ADD(StatDescents, 1);
+    while (finder != nullptr)
     {
-        if (key < finder->getItem().first)
+        BST_STATS_ADD(StatNodesVisited, 1);
+        if (comp_(key, finder->getKey()))
         {
-          finder = finder -> getLeft();
+            finder = finder -> getLeft();
         }
-        else if(key > finder->getItem().first)
+        else
         {
-          finder = finder -> getRight();
+            candidate = finder;
+            finder = finder -> getRight();
         }
     }
-    return finder;
+    return candidate;
+}
+
+/**
+ * Return true iff the BST is balanced: the subtrees of every node differ in
+ * height by at most one. Runs in O(n), off the same walk as validate().
+ */
+template<typename Key, typename Value, typename Compare>
+bool BinarySearchTree<Key, Value, Compare>::isBalanced() const
+{
+    TreeShape shape = validate();
+    return shape.balance.empty() || (shape.balance.begin() -> first >= -1 && shape.balance.rbegin() -> first <= 1);
 }
 
-template<class Key, class Value>
-int BinarySearchTree<Key, Value>::countSteps(Node<Key, Value>* nodePtr) const //countSteps takes a root and returns the num of steps 
-//that can be taken down the tree, to the furthest leaf node
+/**
+ * Checks every invariant of the tree in one O(n) pass: keys in order under
+ * Compare, parent and child pointers agreeing, the entry count matching
+ * size(), plus whatever derived trees check in checkNode() (balances,
+ * subtree sizes, the height bound). The shape summary is filled in even
+ * when a check fails.
+ *
+ * With threads > 1 (0 means one per hardware thread) the top of a large
+ * tree is split between that many threads, each walking its own subtrees.
+ * The tree must not be modified while it is being validated.
+ */
+template<typename Key, typename Value, typename Compare>
+TreeShape BinarySearchTree<Key, Value, Compare>::validate(unsigned threads) const
 {
-    if (nodePtr == nullptr)
+    TreeShape shape;
+    if (threads == 0)
     {
-        return 0;
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (size() < (std::size_t(1) << 16))
+    {
+        threads = 1;
+    }
+    if (root_ != nullptr && root_ -> getParent() != nullptr)
+    {
+        shape.valid = false;
+        shape.problem = "root has a parent";
+    }
+    std::size_t count = 0;
+    shape.height = validateSubtree(root_, nullptr, nullptr, 0, count, shape, threads);
+    if (shape.valid && count != size())
+    {
+        shape.valid = false;
+        shape.problem = "node count does not match size()";
     }
-    int leftSteps = countSteps(nodePtr -> getLeft());
-    int rightSteps = countSteps(nodePtr -> getRight());
-    return std::max(leftSteps, rightSteps) + 1; //"max" is taken in case either leftsteps or rightsteps reaches the base case AND to use the variable that is storing the prev countSteps return val
+    return shape;
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::balHelper(Node<Key, Value>* root) const
+/**
+ * Validates the subtree at nodePtr, whose keys must lie strictly between lo
+ * and hi (either may be null), adding it to shape. Returns the subtree's
+ * height in levels and sets count to its number of nodes.
+ *
+ * While threads > 1 the two subtrees are walked concurrently into separate
+ * shapes that are folded back in afterwards; below that the walk is an
+ * explicit postorder stack, so degenerate (list-shaped) trees cannot
+ * overflow the call stack.
+ */
+template<typename Key, typename Value, typename Compare>
+int BinarySearchTree<Key, Value, Compare>::validateSubtree(Node<Key, Value>* nodePtr, const Node<Key, Value>* lo, const Node<Key, Value>* hi, int depth, std::size_t& count, TreeShape& shape, unsigned threads) const
 {
-    if (root == nullptr) //iff we've reached all root nodes without violating balancing property, return true
+    if (nodePtr == nullptr)
     {
-        return true;
+        count = 0;
+        return 0;
+    }
+    if (threads > 1 && nodePtr -> getLeft() != nullptr && nodePtr -> getRight() != nullptr)
+    {
+        checkLinks(nodePtr, lo, hi, depth, shape);
+        TreeShape leftShape;
+        std::size_t leftCount = 0;
+        std::size_t rightCount = 0;
+        unsigned leftThreads = threads / 2;
+        std::future<int> pending = std::async(std::launch::async, [&]() {
+            return validateSubtree(nodePtr -> getLeft(), lo, nodePtr, depth + 1, leftCount, leftShape, leftThreads);
+        });
+        TreeShape rightShape;
+        int rightHeight = validateSubtree(nodePtr -> getRight(), nodePtr, hi, depth + 1, rightCount, rightShape, threads - leftThreads);
+        int leftHeight = pending.get();
+
+        const TreeShape* parts[2] = { &leftShape, &rightShape };
+        for (int i = 0; i < 2; i++)
+        {
+            if (shape.valid && !parts[i] -> valid)
+            {
+                shape.valid = false;
+                shape.problem = parts[i] -> problem;
+            }
+            shape.nodes += parts[i] -> nodes;
+            shape.depthSum += parts[i] -> depthSum;
+            shape.maxDepth = std::max(shape.maxDepth, parts[i] -> maxDepth);
+            for (std::map<int, std::size_t>::const_iterator it = parts[i] -> balance.begin(); it != parts[i] -> balance.end(); ++it)
+            {
+                shape.balance[it -> first] += it -> second;
+            }
+        }
+        ++shape.balance[rightHeight - leftHeight];
+        const char* problem = checkNode(nodePtr, leftHeight, rightHeight, leftCount, rightCount);
+        if (problem != nullptr && shape.valid)
+        {
+            shape.valid = false;
+            shape.problem = problem;
+        }
+        count = 1 + leftCount + rightCount;
+        return 1 + std::max(leftHeight, rightHeight);
     }
 
-    if (!balHelper(root -> getLeft())) return false;
-    if (!balHelper(root -> getRight())) return false;
-
-    int leftCount = countSteps(root->getLeft()); //depth of subtree rooted at root_->getLeft()
-    int rightCount = countSteps(root->getRight()); //depth of subtree rooted at root_->getRight()
-    int diff = std::abs(rightCount - leftCount); //difference between trees
+    struct Frame
+    {
+        Node<Key, Value>* node;
+        const Node<Key, Value>* lo;
+        const Node<Key, Value>* hi;
+        int depth;
+        int stage;              // 0: not visited, 1: left done, 2: both done
+        int leftHeight;
+        std::size_t leftCount;
+    };
+    std::vector<Frame> stack;
+    Frame first = { nodePtr, lo, hi, depth, 0, 0, 0 };
+    stack.push_back(first);
+    int height = 0;             // of the subtree that was just finished
+    std::size_t finished = 0;
+    while (!stack.empty())
+    {
+        Frame& f = stack.back();
+        if (f.stage == 0)
+        {
+            checkLinks(f.node, f.lo, f.hi, f.depth, shape);
+            f.stage = 1;
+            if (f.node -> getLeft() != nullptr)
+            {
+                Frame child = { f.node -> getLeft(), f.lo, f.node, f.depth + 1, 0, 0, 0 };
+                stack.push_back(child);
+                continue;
+            }
+            height = 0;
+            finished = 0;
+        }
+        if (f.stage == 1)
+        {
+            f.leftHeight = height;
+            f.leftCount = finished;
+            f.stage = 2;
+            if (f.node -> getRight() != nullptr)
+            {
+                Frame child = { f.node -> getRight(), f.node, f.hi, f.depth + 1, 0, 0, 0 };
+                stack.push_back(child);
+                continue;
+            }
+            height = 0;
+            finished = 0;
+        }
+        ++shape.balance[height - f.leftHeight];
+        const char* problem = checkNode(f.node, f.leftHeight, height, f.leftCount, finished);
+        if (problem != nullptr && shape.valid)
+        {
+            shape.valid = false;
+            shape.problem = problem;
+        }
+        height = 1 + std::max(f.leftHeight, height);
+        finished = 1 + f.leftCount + finished;
+        stack.pop_back();
+    }
+    count = finished;
+    return height;
+}
 
-    return diff <= 1;
+/**
+ * The per-node part of validation that needs no subtree results: the key
+ * lies between lo and hi, the children point back at this node, and the
+ * node's depth is counted into shape.
+ */
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::checkLinks(Node<Key, Value>* nodePtr, const Node<Key, Value>* lo, const Node<Key, Value>* hi, int depth, TreeShape& shape) const
+{
+    ++shape.nodes;
+    shape.depthSum += depth;
+    shape.maxDepth = std::max(shape.maxDepth, depth);
+    if (!shape.valid)
+    {
+        return;
+    }
+    if ((lo != nullptr && !comp_(lo -> getKey(), nodePtr -> getKey())) ||
+        (hi != nullptr && !comp_(nodePtr -> getKey(), hi -> getKey())))
+    {
+        shape.valid = false;
+        shape.problem = "keys out of order";
+    }
+    else if ((nodePtr -> getLeft() != nullptr && nodePtr -> getLeft() -> getParent() != nodePtr) ||
+             (nodePtr -> getRight() != nullptr && nodePtr -> getRight() -> getParent() != nodePtr))
+    {
+        shape.valid = false;
+        shape.problem = "child does not point back at its parent";
+    }
 }
 
 /**
- * Return true iff the BST is balanced.
+ * A plain BST keeps no per-node data, so there is nothing more to check.
  */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+template<typename Key, typename Value, typename Compare>
+const char* BinarySearchTree<Key, Value, Compare>::checkNode(const Node<Key, Value>*, int, int, std::size_t, std::size_t) const
 {
-  Node<Key, Value>* rootPointer = root_;
-  bool isBal = balHelper(rootPointer);
-  return isBal;
+    return nullptr;
 }
 
 
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+template<typename Key, typename Value, typename Compare>
+void BinarySearchTree<Key, Value, Compare>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
     }
+    BST_STATS_ADD(StatNodeSwaps, 1);
     Node<Key, Value>* n1p = n1->getParent();
     Node<Key, Value>* n1r = n1->getRight();
     Node<Key, Value>* n1lt = n1->getLeft();
@@ -0,0 +1,848 @@
+#ifndef CONCURRENTAVL_H
+#define CONCURRENTAVL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+#include "node-arena.h"
+#include "epoch-domain.h"
+
+/**
+* An AVL tree that any number of reader threads can search and iterate while
+* a writer updates it, without readers ever taking a lock.
+*
+* Published nodes are never changed. A write copies the nodes on the path it
+* changes (path copying), rebalances the copies, and publishes the new root
+* with a single atomic store, so a reader always walks one consistent
+* version. The nodes a write replaces, including the ones that remove,
+* rotateLeft and rotateRight take out of the tree, are retired to an
+* EpochDomain and freed once no reader pinned before the write can still be
+* looking at them.
+*
+* Readers open a ReadView (or call find), which pins the domain for its
+* lifetime; keep views short, since a view that stays open holds back the
+* reclamation of everything unlinked after it was taken. Writers are
+* serialized by a mutex. Nodes are copied, so Key and Value must be
+* copyable, and a write costs O(log n) node copies.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class ConcurrentAVLTree
+{
+private:
+    struct CNode;
+
+public:
+    // Deeper than any AVL tree that fits in memory.
+    static const int maxHeight = 96;
+
+    /**
+    * A forward iterator over a ReadView, in key order. It keeps the path
+    * from the root in a fixed array, since nodes have no parent pointers.
+    */
+    class const_iterator
+    {
+    public:
+        const_iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+
+    private:
+        friend class ConcurrentAVLTree<Key, Value, Compare>;
+        void pushLeft(const CNode* node);
+
+        const CNode* stack_[maxHeight];
+        int depth_;
+    };
+
+    /**
+    * A pinned, consistent version of the tree. Everything read through it
+    * stays valid, and unchanged, until it is destroyed.
+    */
+    class ReadView
+    {
+    public:
+        ReadView(ReadView&& other);
+        ~ReadView();
+
+        const Value* find(const Key& key) const;
+        const_iterator begin() const;
+        const_iterator end() const;
+
+    private:
+        friend class ConcurrentAVLTree<Key, Value, Compare>;
+        explicit ReadView(const ConcurrentAVLTree<Key, Value, Compare>* tree);
+        // Not copyable: each view owns one pin.
+        ReadView(const ReadView&);
+        ReadView& operator=(const ReadView&);
+
+        const ConcurrentAVLTree<Key, Value, Compare>* tree_;
+        unsigned slot_;
+        const CNode* root_;
+    };
+
+    explicit ConcurrentAVLTree(const Compare& comp = Compare());
+    ~ConcurrentAVLTree();
+
+    // Writers. Serialized against each other, never against readers.
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    void reclaim();
+    std::size_t retiredCount() const;
+
+    // Readers. Lock-free; safe from any thread at any time.
+    ReadView read() const;
+    bool find(const Key& key, Value& value) const;
+    std::size_t size() const;
+    bool empty() const;
+
+private:
+    // Not copyable: readers hold pointers into the tree.
+    ConcurrentAVLTree(const ConcurrentAVLTree&);
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&);
+
+    struct CNode
+    {
+        CNode(const Key& key, const Value& value, std::uint64_t stamp);
+        CNode(const CNode& other, std::uint64_t stamp);
+
+        std::pair<const Key, Value> item_;
+        CNode* left_;
+        CNode* right_;
+        int height_;
+        std::uint64_t stamp_;   // the write that created it; that write may still change it
+    };
+
+    static int height(const CNode* node);
+    static void fixHeight(CNode* node);
+
+    CNode* makeNode(const Key& key, const Value& value);
+    CNode* own(CNode* node);
+    void retire(CNode* node);
+    void destroyNode(CNode* node);
+    void commit(CNode* root);
+    void rollback();
+    void reclaimLocked();
+
+    CNode* insertAt(CNode* node, const std::pair<const Key, Value>& keyValuePair, bool& added);
+    CNode* removeAt(CNode* node, const Key& key, bool& removed);
+    CNode* removeMin(CNode* node, CNode*& min);
+    CNode* rebalance(CNode* node);
+    CNode* rotateLeft(CNode* node);
+    CNode* rotateRight(CNode* node);
+
+    std::atomic<CNode*> root_;
+    std::atomic<std::size_t> count_;
+    mutable EpochDomain domain_;
+    Compare comp_;
+
+    // Writer-only state, guarded by writer_.
+    mutable std::mutex writer_;
+    NodeArena arena_;
+    std::uint64_t stamp_;
+    std::vector<CNode*> fresh_;                                 // created by the current write
+    std::vector<CNode*> pending_;                               // unlinked by the current write
+    std::vector<std::pair<std::uint64_t, CNode*> > retired_;    // (epoch, node), oldest first
+    std::size_t nextReclaim_;
+};
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  -----------------------------------------------------
+*/
+
+/**
+* Builds a node holding a copy of key and value.
+*/
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::CNode::CNode(const Key& key, const Value& value, std::uint64_t stamp) :
+    item_(key, value), left_(nullptr), right_(nullptr), height_(1), stamp_(stamp)
+{
+
+}
+
+/**
+* Builds a writable copy of a published node, children included.
+*/
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::CNode::CNode(const CNode& other, std::uint64_t stamp) :
+    item_(other.item_), left_(other.left_), right_(other.right_), height_(other.height_), stamp_(stamp)
+{
+
+}
+
+/**
+* An end iterator.
+*/
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::const_iterator::const_iterator() :
+    depth_(0)
+{
+
+}
+
+/**
+* Pushes node and its chain of left children, so the smallest of them ends
+* up on top.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::const_iterator::pushLeft(const CNode* node)
+{
+    while (node != nullptr)
+    {
+        stack_[depth_++] = node;
+        node = node -> left_;
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value>& ConcurrentAVLTree<Key, Value, Compare>::const_iterator::operator*() const
+{
+    return stack_[depth_ - 1] -> item_;
+}
+
+template<typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value>* ConcurrentAVLTree<Key, Value, Compare>::const_iterator::operator->() const
+{
+    return &(stack_[depth_ - 1] -> item_);
+}
+
+/**
+* Two iterators are equal when they are on the same node, or both at end.
+*/
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    if (depth_ == 0 || rhs.depth_ == 0)
+    {
+        return depth_ == rhs.depth_;
+    }
+    return stack_[depth_ - 1] == rhs.stack_[rhs.depth_ - 1];
+}
+
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Steps to the in-order successor: the smallest node of the right subtree,
+* or else the nearest ancestor still waiting on the stack.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::const_iterator&
+ConcurrentAVLTree<Key, Value, Compare>::const_iterator::operator++()
+{
+    const CNode* node = stack_[--depth_];
+    pushLeft(node -> right_);
+    return *this;
+}
+
+/**
+* Pins the tree's epoch domain and takes the current root. The pin comes
+* first, so the writer cannot free anything this root reaches.
+*/
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ReadView::ReadView(const ConcurrentAVLTree<Key, Value, Compare>* tree) :
+    tree_(tree),
+    slot_(tree -> domain_.pin()),
+    root_(tree -> root_.load(std::memory_order_seq_cst))
+{
+
+}
+
+/**
+* Takes over other's pin.
+*/
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ReadView::ReadView(ReadView&& other) :
+    tree_(other.tree_),
+    slot_(other.slot_),
+    root_(other.root_)
+{
+    other.tree_ = nullptr;
+}
+
+/**
+* Unpins, letting the writer free what this view could still see.
+*/
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ReadView::~ReadView()
+{
+    if (tree_ != nullptr)
+    {
+        tree_ -> domain_.unpin(slot_);
+    }
+}
+
+/**
+* Returns the value stored under key in this version, or nullptr.
+*/
+template<typename Key, typename Value, typename Compare>
+const Value* ConcurrentAVLTree<Key, Value, Compare>::ReadView::find(const Key& key) const
+{
+    const CNode* node = root_;
+    while (node != nullptr)
+    {
+        if (tree_ -> comp_(key, node -> item_.first))
+        {
+            node = node -> left_;
+        }
+        else if (tree_ -> comp_(node -> item_.first, key))
+        {
+            node = node -> right_;
+        }
+        else
+        {
+            return &(node -> item_.second);
+        }
+    }
+    return nullptr;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::const_iterator
+ConcurrentAVLTree<Key, Value, Compare>::ReadView::begin() const
+{
+    const_iterator it;
+    it.pushLeft(root_);
+    return it;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::const_iterator
+ConcurrentAVLTree<Key, Value, Compare>::ReadView::end() const
+{
+    return const_iterator();
+}
+
+/**
+* Constructs an empty tree.
+*/
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree(const Compare& comp) :
+    root_(nullptr),
+    count_(0),
+    comp_(comp),
+    arena_(sizeof(CNode), alignof(CNode)),
+    stamp_(0),
+    nextReclaim_(1024)
+{
+
+}
+
+/**
+* Frees the tree and everything still waiting to be reclaimed. No reader may
+* be using the tree any more.
+*/
+template<typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::~ConcurrentAVLTree()
+{
+    // Nobody else can see the nodes now, so the tree may be taken apart by
+    // rotating it into a list, as BinarySearchTree::destroySubtree does.
+    CNode* node = root_.load(std::memory_order_relaxed);
+    while (node != nullptr)
+    {
+        CNode* left = node -> left_;
+        if (left != nullptr)
+        {
+            node -> left_ = left -> right_;
+            left -> right_ = node;
+            node = left;
+        }
+        else
+        {
+            CNode* right = node -> right_;
+            destroyNode(node);
+            node = right;
+        }
+    }
+    for (std::size_t i = 0; i < retired_.size(); i++)
+    {
+        destroyNode(retired_[i].second);
+    }
+}
+
+/**
+* Adds keyValuePair, or replaces the value stored under its key.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::lock_guard<std::mutex> lock(writer_);
+    ++stamp_;
+    bool added = false;
+    try
+    {
+        commit(insertAt(root_.load(std::memory_order_relaxed), keyValuePair, added));
+    }
+    catch (...)
+    {
+        rollback();
+        throw;
+    }
+    if (added)
+    {
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+* Removes key, if present.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    std::lock_guard<std::mutex> lock(writer_);
+    ++stamp_;
+    bool removed = false;
+    try
+    {
+        CNode* root = removeAt(root_.load(std::memory_order_relaxed), key, removed);
+        if (!removed)
+        {
+            return;
+        }
+        commit(root);
+    }
+    catch (...)
+    {
+        rollback();
+        throw;
+    }
+    count_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/**
+* Empties the tree. Readers holding a view keep seeing the old contents
+* until they let go of it.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::clear()
+{
+    std::lock_guard<std::mutex> lock(writer_);
+    std::vector<CNode*> stack;
+    CNode* root = root_.load(std::memory_order_relaxed);
+    if (root != nullptr)
+    {
+        stack.push_back(root);
+    }
+    try
+    {
+        while (!stack.empty())
+        {
+            CNode* node = stack.back();
+            stack.pop_back();
+            if (node -> left_ != nullptr)
+            {
+                stack.push_back(node -> left_);
+            }
+            if (node -> right_ != nullptr)
+            {
+                stack.push_back(node -> right_);
+            }
+            retire(node);
+        }
+        commit(nullptr);
+    }
+    catch (...)
+    {
+        rollback();
+        throw;
+    }
+    count_.store(0, std::memory_order_relaxed);
+}
+
+/**
+* Frees every retired node that no reader can still reach. Writes call this
+* on their own as the retired list grows; calling it directly is only
+* needed to give memory back after the last write.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::reclaim()
+{
+    std::lock_guard<std::mutex> lock(writer_);
+    reclaimLocked();
+}
+
+/**
+* The number of unlinked nodes not yet freed.
+*/
+template<typename Key, typename Value, typename Compare>
+std::size_t ConcurrentAVLTree<Key, Value, Compare>::retiredCount() const
+{
+    std::lock_guard<std::mutex> lock(writer_);
+    return retired_.size();
+}
+
+/**
+* Opens a consistent, pinned view of the tree as it is now.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::ReadView ConcurrentAVLTree<Key, Value, Compare>::read() const
+{
+    return ReadView(this);
+}
+
+/**
+* Copies the value stored under key into value and returns true, or returns
+* false if the key is absent.
+*/
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::find(const Key& key, Value& value) const
+{
+    ReadView view(this);
+    const Value* found = view.find(key);
+    if (found == nullptr)
+    {
+        return false;
+    }
+    value = *found;
+    return true;
+}
+
+/**
+* The number of entries after the last completed write.
+*/
+template<typename Key, typename Value, typename Compare>
+std::size_t ConcurrentAVLTree<Key, Value, Compare>::size() const
+{
+    return count_.load(std::memory_order_relaxed);
+}
+
+template<typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::empty() const
+{
+    return size() == 0;
+}
+
+template<typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::height(const CNode* node)
+{
+    return node == nullptr ? 0 : node -> height_;
+}
+
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::fixHeight(CNode* node)
+{
+    node -> height_ = 1 + std::max(height(node -> left_), height(node -> right_));
+}
+
+/**
+* Builds a node for the current write in the writer's arena.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::CNode*
+ConcurrentAVLTree<Key, Value, Compare>::makeNode(const Key& key, const Value& value)
+{
+    fresh_.reserve(fresh_.size() + 1);
+    void* slot = arena_.allocate();
+    CNode* node;
+    try
+    {
+        node = new (slot) CNode(key, value, stamp_);
+    }
+    catch (...)
+    {
+        arena_.deallocate(slot);
+        throw;
+    }
+    fresh_.push_back(node);
+    return node;
+}
+
+/**
+* Returns a version of node that the current write may change: node itself
+* if this write created it, otherwise a copy, with node retired.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::CNode*
+ConcurrentAVLTree<Key, Value, Compare>::own(CNode* node)
+{
+    if (node -> stamp_ == stamp_)
+    {
+        return node;
+    }
+    fresh_.reserve(fresh_.size() + 1);
+    void* slot = arena_.allocate();
+    CNode* copy;
+    try
+    {
+        copy = new (slot) CNode(*node, stamp_);
+    }
+    catch (...)
+    {
+        arena_.deallocate(slot);
+        throw;
+    }
+    fresh_.push_back(copy);
+    retire(node);
+    return copy;
+}
+
+/**
+* Records that the current write unlinks a published node.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::retire(CNode* node)
+{
+    pending_.push_back(node);
+}
+
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::destroyNode(CNode* node)
+{
+    node -> ~CNode();
+    arena_.deallocate(node);
+}
+
+/**
+* Publishes root and hands the nodes the write unlinked to reclamation,
+* tagged with the current epoch.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::commit(CNode* root)
+{
+    retired_.reserve(retired_.size() + pending_.size());
+    root_.store(root, std::memory_order_seq_cst);
+    std::uint64_t epoch = domain_.epoch();
+    for (std::size_t i = 0; i < pending_.size(); i++)
+    {
+        retired_.push_back(std::make_pair(epoch, pending_[i]));
+    }
+    pending_.clear();
+    fresh_.clear();
+    if (retired_.size() >= nextReclaim_)
+    {
+        reclaimLocked();
+    }
+}
+
+/**
+* Undoes a write that threw before publishing: its new nodes were never
+* seen, and the ones it meant to unlink are still in the tree.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::rollback()
+{
+    for (std::size_t i = 0; i < fresh_.size(); i++)
+    {
+        destroyNode(fresh_[i]);
+    }
+    fresh_.clear();
+    pending_.clear();
+}
+
+/**
+* Starts a new epoch, then frees the retired nodes older than every pinned
+* reader. If readers hold too much back, the next attempt waits until the
+* list has doubled, so the scan stays amortized O(1) per write.
+*/
+template<typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::reclaimLocked()
+{
+    domain_.advance();
+    std::uint64_t safe = domain_.safeEpoch();
+    std::size_t freed = 0;
+    while (freed < retired_.size() && retired_[freed].first < safe)
+    {
+        destroyNode(retired_[freed].second);
+        ++freed;
+    }
+    retired_.erase(retired_.begin(), retired_.begin() + freed);
+    nextReclaim_ = std::max<std::size_t>(1024, 2 * retired_.size());
+}
+
+/**
+* Returns the subtree at node with keyValuePair added. Only the path down to
+* the key is copied.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::CNode*
+ConcurrentAVLTree<Key, Value, Compare>::insertAt(CNode* node, const std::pair<const Key, Value>& keyValuePair, bool& added)
+{
+    if (node == nullptr)
+    {
+        added = true;
+        return makeNode(keyValuePair.first, keyValuePair.second);
+    }
+    if (comp_(keyValuePair.first, node -> item_.first))
+    {
+        CNode* child = insertAt(node -> left_, keyValuePair, added);
+        node = own(node);
+        node -> left_ = child;
+        return rebalance(node);
+    }
+    if (comp_(node -> item_.first, keyValuePair.first))
+    {
+        CNode* child = insertAt(node -> right_, keyValuePair, added);
+        node = own(node);
+        node -> right_ = child;
+        return rebalance(node);
+    }
+    // The key is already here: a new node with the new value takes its place.
+    CNode* replacement = makeNode(keyValuePair.first, keyValuePair.second);
+    replacement -> left_ = node -> left_;
+    replacement -> right_ = node -> right_;
+    replacement -> height_ = node -> height_;
+    retire(node);
+    return replacement;
+}
+
+/**
+* Returns the subtree at node without key. Nothing is copied when the key is
+* absent.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::CNode*
+ConcurrentAVLTree<Key, Value, Compare>::removeAt(CNode* node, const Key& key, bool& removed)
+{
+    if (node == nullptr)
+    {
+        return nullptr;
+    }
+    if (comp_(key, node -> item_.first))
+    {
+        CNode* child = removeAt(node -> left_, key, removed);
+        if (!removed)
+        {
+            return node;
+        }
+        node = own(node);
+        node -> left_ = child;
+        return rebalance(node);
+    }
+    if (comp_(node -> item_.first, key))
+    {
+        CNode* child = removeAt(node -> right_, key, removed);
+        if (!removed)
+        {
+            return node;
+        }
+        node = own(node);
+        node -> right_ = child;
+        return rebalance(node);
+    }
+    removed = true;
+    retire(node);
+    if (node -> left_ == nullptr)
+    {
+        return node -> right_;
+    }
+    if (node -> right_ == nullptr)
+    {
+        return node -> left_;
+    }
+    // Two children: the successor, copied, takes the removed node's place.
+    CNode* successor;
+    CNode* right = removeMin(node -> right_, successor);
+    successor = own(successor);
+    successor -> left_ = node -> left_;
+    successor -> right_ = right;
+    return rebalance(successor);
+}
+
+/**
+* Returns the subtree at node without its smallest node, which is handed
+* back through min.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::CNode*
+ConcurrentAVLTree<Key, Value, Compare>::removeMin(CNode* node, CNode*& min)
+{
+    if (node -> left_ == nullptr)
+    {
+        min = node;
+        return node -> right_;
+    }
+    CNode* child = removeMin(node -> left_, min);
+    node = own(node);
+    node -> left_ = child;
+    return rebalance(node);
+}
+
+/**
+* Restores the AVL property at a node the current write owns, whose subtrees
+* differ in height by at most two, and returns the subtree's new root.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::CNode*
+ConcurrentAVLTree<Key, Value, Compare>::rebalance(CNode* node)
+{
+    int leftHeight = height(node -> left_);
+    int rightHeight = height(node -> right_);
+    if (leftHeight > rightHeight + 1)
+    {
+        CNode* left = node -> left_;
+        if (height(left -> left_) < height(left -> right_)) //zig-zag
+        {
+            node -> left_ = rotateLeft(own(left));
+        }
+        return rotateRight(node);
+    }
+    if (rightHeight > leftHeight + 1)
+    {
+        CNode* right = node -> right_;
+        if (height(right -> right_) < height(right -> left_)) //zig-zag
+        {
+            node -> right_ = rotateRight(own(right));
+        }
+        return rotateLeft(node);
+    }
+    node -> height_ = 1 + std::max(leftHeight, rightHeight);
+    return node;
+}
+
+/**
+* Rotates an owned node left. Its right child moves up and is copied first
+* unless this write already owns it.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::CNode*
+ConcurrentAVLTree<Key, Value, Compare>::rotateLeft(CNode* node)
+{
+    CNode* newParent = own(node -> right_);
+    node -> right_ = newParent -> left_;
+    newParent -> left_ = node;
+    fixHeight(node);
+    fixHeight(newParent);
+    return newParent;
+}
+
+/**
+* Rotates an owned node right. Its left child moves up and is copied first
+* unless this write already owns it.
+*/
+template<typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::CNode*
+ConcurrentAVLTree<Key, Value, Compare>::rotateRight(CNode* node)
+{
+    CNode* newParent = own(node -> left_);
+    node -> left_ = newParent -> right_;
+    newParent -> right_ = node;
+    fixHeight(node);
+    fixHeight(newParent);
+    return newParent;
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  ---------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef EPOCH_DOMAIN_H
+#define EPOCH_DOMAIN_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+/**
+ * Epoch-based reclamation for structures with lock-free readers and a
+ * single writer.
+ *
+ * A reader pins the domain for as long as it holds pointers into the
+ * structure: pin() records the current epoch in a reader slot and unpin()
+ * clears it again. Neither ever waits; a pin is one compare-and-swap on a
+ * slot that, thanks to a per-thread starting point, is almost always the
+ * thread's own cache line.
+ *
+ * The writer tags everything it unlinks with the epoch at the time (see
+ * epoch()) and, once the unlinking has been published, calls advance()
+ * and then safeEpoch(): anything tagged with an older epoch than that can
+ * no longer be reached by any reader and may be freed. Readers that find
+ * every slot taken fall back to a shared counter that holds reclamation
+ * back completely until they unpin.
+ */
+class EpochDomain
+{
+public:
+    static const unsigned slotCount = 128;
+
+    EpochDomain();
+
+    unsigned pin();
+    void unpin(unsigned slot);
+
+    std::uint64_t epoch() const;
+    void advance();
+    std::uint64_t safeEpoch() const;
+
+private:
+    // Not copyable: readers hold slot indices into this object.
+    EpochDomain(const EpochDomain&);
+    EpochDomain& operator=(const EpochDomain&);
+
+    // One cache line per reader slot; 0 means the slot is free.
+    struct Slot
+    {
+        alignas(64) std::atomic<std::uint64_t> epoch;
+    };
+
+    static unsigned& slotHint();
+
+    Slot slots_[slotCount];
+    alignas(64) std::atomic<std::uint64_t> epoch_;
+    alignas(64) std::atomic<std::size_t> overflow_;
+};
+
+/*
+  --------------------------------------------
+  Begin implementations for the EpochDomain class.
+  --------------------------------------------
+*/
+
+/**
+* Constructs a domain with no readers. Epochs start at 1 so that 0 can mark
+* a free slot.
+*/
+inline EpochDomain::EpochDomain() :
+    epoch_(1),
+    overflow_(0)
+{
+    for (unsigned i = 0; i < slotCount; i++)
+    {
+        slots_[i].epoch.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+* The slot each thread tries first: the one it used last, or one picked
+* from its thread id the first time.
+*/
+inline unsigned& EpochDomain::slotHint()
+{
+    static thread_local unsigned hint = static_cast<unsigned>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return hint;
+}
+
+/**
+* Marks the calling reader as active in the current epoch and returns the
+* token to hand to unpin(). Loads of the protected structure must come
+* after this call.
+*/
+inline unsigned EpochDomain::pin()
+{
+    unsigned& hint = slotHint();
+    std::uint64_t now = epoch_.load(std::memory_order_seq_cst);
+    for (unsigned i = 0; i < slotCount; i++)
+    {
+        unsigned slot = (hint + i) % slotCount;
+        std::uint64_t expected = 0;
+        if (slots_[slot].epoch.load(std::memory_order_relaxed) == 0 &&
+            slots_[slot].epoch.compare_exchange_strong(expected, now, std::memory_order_seq_cst))
+        {
+            hint = slot;
+            return slot;
+        }
+    }
+    overflow_.fetch_add(1, std::memory_order_seq_cst);
+    return slotCount;
+}
+
+/**
+* Ends the read section started by the pin() that returned slot.
+*/
+inline void EpochDomain::unpin(unsigned slot)
+{
+    if (slot == slotCount)
+    {
+        overflow_.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+    slots_[slot].epoch.store(0, std::memory_order_release);
+}
+
+/**
+* The epoch to tag unlinked objects with.
+*/
+inline std::uint64_t EpochDomain::epoch() const
+{
+    return epoch_.load(std::memory_order_relaxed);
+}
+
+/**
+* Starts a new epoch. Called by the writer after publishing, so that
+* readers pinning from now on are known not to see what was unlinked.
+*/
+inline void EpochDomain::advance()
+{
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+}
+
+/**
+* The oldest epoch a pinned reader may still be in. Objects tagged with an
+* epoch below it are unreachable.
+*/
+inline std::uint64_t EpochDomain::safeEpoch() const
+{
+    if (overflow_.load(std::memory_order_seq_cst) != 0)
+    {
+        return 0;
+    }
+    std::uint64_t oldest = epoch_.load(std::memory_order_seq_cst);
+    for (unsigned i = 0; i < slotCount; i++)
+    {
+        std::uint64_t pinned = slots_[i].epoch.load(std::memory_order_seq_cst);
+        if (pinned != 0 && pinned < oldest)
+        {
+            oldest = pinned;
+        }
+    }
+    return oldest;
+}
+
+/*
+  ------------------------------------------
+  End implementations for the EpochDomain class.
+  ------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,139 @@
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "equal-paths.h"
+#include "equal-paths-depth.h"
+
+using namespace std;
+
+// Scaling benchmark for equalPaths. Build with `make bench` and pass a
+// section name (e.g. ./equal-paths-bench chain) to run only that section.
+
+typedef chrono::steady_clock Clock;
+
+/**
+* Nanoseconds per node since start.
+*/
+double nsPerNode(Clock::time_point start, size_t nodes)
+{
+    chrono::duration<double, nano> elapsed = Clock::now() - start;
+    return elapsed.count() / (nodes == 0 ? 1 : nodes);
+}
+
+/**
+* The recursive check equalPaths used to do, kept as a reference: a height
+* computation under every node, then recursion into both children.
+*/
+int referenceSteps(Node* root)
+{
+    if (root == nullptr)
+    {
+        return 0;
+    }
+    return max(referenceSteps(root -> left), referenceSteps(root -> right)) + 1;
+}
+
+bool referenceEqualPaths(Node* root)
+{
+    if (root == nullptr)
+    {
+        return true;
+    }
+    int leftCount = referenceSteps(root -> left);
+    int rightCount = referenceSteps(root -> right);
+    if (leftCount != rightCount && leftCount > 0 && rightCount > 0)
+    {
+        return false;
+    }
+    return referenceEqualPaths(root -> left) && referenceEqualPaths(root -> right);
+}
+
+/**
+* Links nodes[0..n) into a complete binary tree in heap order, so every leaf
+* is on the last level when n is one less than a power of two.
+*/
+Node* completeTree(vector<Node>& nodes, size_t n)
+{
+    nodes.assign(n, Node(0));
+    for (size_t i = 0; i < n; i++)
+    {
+        nodes[i].key = static_cast<int>(i);
+        nodes[i].left = 2 * i + 1 < n ? &nodes[2 * i + 1] : nullptr;
+        nodes[i].right = 2 * i + 2 < n ? &nodes[2 * i + 2] : nullptr;
+    }
+    return n == 0 ? nullptr : &nodes[0];
+}
+
+/**
+* Links nodes[0..n) into a single left-leaning chain, the shape sorted input
+* gives an unbalanced BST.
+*/
+Node* chainTree(vector<Node>& nodes, size_t n)
+{
+    nodes.assign(n, Node(0));
+    for (size_t i = 0; i < n; i++)
+    {
+        nodes[i].key = static_cast<int>(i);
+        nodes[i].left = i + 1 < n ? &nodes[i + 1] : nullptr;
+    }
+    return n == 0 ? nullptr : &nodes[0];
+}
+
+void benchComplete()
+{
+    vector<Node> nodes;
+    for (int levels = 10; levels <= 22; levels += 4)
+    {
+        size_t n = (size_t(1) << levels) - 1;
+        Node* root = completeTree(nodes, n);
+        int leafDepth = 0;
+        Clock::time_point start = Clock::now();
+        bool equal = equalPaths(root, leafDepth);
+        double iterativeNs = nsPerNode(start, n);
+        start = Clock::now();
+        bool reference = referenceEqualPaths(root);
+        double referenceNs = nsPerNode(start, n);
+        cout << "complete n=" << n << " iterative_ns_per_node=" << iterativeNs
+             << " recursive_ns_per_node=" << referenceNs << " equal=" << equal
+             << " agree=" << (equal == reference) << " leaf_depth=" << leafDepth << endl;
+    }
+}
+
+void benchChain()
+{
+    vector<Node> nodes;
+    for (size_t n = 1000; n <= 10000000; n *= 10)
+    {
+        Node* root = chainTree(nodes, n);
+        int leafDepth = 0;
+        Clock::time_point start = Clock::now();
+        bool equal = equalPaths(root, leafDepth);
+        double iterativeNs = nsPerNode(start, n);
+        cout << "chain n=" << n << " iterative_ns_per_node=" << iterativeNs;
+        // the recursive version is quadratic here and runs out of stack long
+        // before the largest chains
+        if (n <= 10000)
+        {
+            start = Clock::now();
+            bool reference = referenceEqualPaths(root);
+            cout << " recursive_ns_per_node=" << nsPerNode(start, n) << " agree=" << (equal == reference);
+        }
+        cout << " equal=" << equal << " leaf_depth=" << leafDepth << endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* only = argc > 1 ? argv[1] : NULL;
+    if (only == NULL || strcmp(only, "complete") == 0)
+    {
+        benchComplete();
+    }
+    if (only == NULL || strcmp(only, "chain") == 0)
+    {
+        benchChain();
+    }
+    return 0;
+}
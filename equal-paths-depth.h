@@ -0,0 +1,20 @@
+#ifndef EQUAL_PATHS_DEPTH_H
+#define EQUAL_PATHS_DEPTH_H
+
+#include "equal-paths.h"
+
+/**
+ * @brief Returns the same answer as equalPaths(root), and also reports the
+ *        common leaf depth
+ *
+ *        Every node is visited once, and an explicit stack is used instead of
+ *        recursion, so the check is linear and works on trees of any depth
+ *        (e.g. the long chains that skewed input produces).
+ *
+ * @param root Pointer to the root of the tree to check for equal paths
+ * @param leafDepth Set to the number of edges between the root and every
+ *        leaf, or -1 if the tree is empty or the paths differ
+ */
+bool equalPaths(Node * root, int & leafDepth);
+
+#endif
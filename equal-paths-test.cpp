@@ -1,8 +1,12 @@
 #include <iostream>
 #include <cstdlib>
+#include <vector>
 #include "equal-paths.h"
+#include "equal-paths-depth.h"
 using namespace std;
 
+int failures = 0;
+
 
 Node* a;
 Node* b;
@@ -55,22 +59,100 @@ void test5(const char* msg)
   cout << msg << ": " <<   equalPaths(a) << endl;
 }
 
+// Prints the answer and leaf depth of equalPaths(root, leafDepth) and
+// counts a failure if either differs from what is expected.
+void checkDepth(const char* msg, Node* root, bool expected, int expectedDepth)
+{
+  int leafDepth = 12345;
+  bool result = equalPaths(root, leafDepth);
+  cout << msg << ": " << result << " leafDepth=" << leafDepth << endl;
+  if (result != expected || leafDepth != expectedDepth || equalPaths(root) != expected)
+  {
+    cout << msg << " FAILED: expected " << expected << " leafDepth=" << expectedDepth << endl;
+    failures++;
+  }
+}
+
+void test6(const char* msg)
+{
+  checkDepth(msg, NULL, true, -1);
+}
+
+void test7(const char* msg)
+{
+  setNode(a,1,b,NULL);
+  setNode(b,2,NULL,c);
+  setNode(c,3,d,NULL);
+  setNode(d,4,NULL,NULL);
+  checkDepth(msg, a, true, 3);
+}
+
+void test8(const char* msg)
+{
+  setNode(a,1,b,c);
+  setNode(b,2,d,NULL);
+  setNode(c,3,NULL,NULL);
+  setNode(d,4,NULL,NULL);
+  checkDepth(msg, a, false, -1);
+}
+
+void test9(const char* msg)
+{
+  setNode(a,1,b,c);
+  setNode(b,2,d,NULL);
+  setNode(c,3,NULL,e);
+  setNode(d,4,NULL,NULL);
+  setNode(e,5,NULL,NULL);
+  checkDepth(msg, a, true, 2);
+}
+
+void test10(const char* msg)
+{
+  // deep enough to overflow the call stack if the walk recursed
+  const int n = 1000000;
+  vector<Node> chain;
+  chain.reserve(n);
+  for (int i = 0; i < n; i++)
+  {
+    chain.push_back(Node(i));
+  }
+  for (int i = 0; i + 1 < n; i++)
+  {
+    if (i % 2 == 0) chain[i].left = &chain[i + 1];
+    else chain[i].right = &chain[i + 1];
+  }
+  checkDepth(msg, &chain[0], true, n - 1);
+
+  // a second leaf hung off the free side of a node near the end
+  Node extra(-1);
+  chain[n - 4].right = &extra;
+  checkDepth(msg, &chain[0], false, -1);
+}
+
 int main()
 {
   a = new Node(1);
   b = new Node(2);
   c = new Node(3);
   d = new Node(4);
+  e = new Node(5);
 
   test1("Test1");
   test2("Test2");
   test3("Test3");
   test4("Test4");
   test5("Test5");
+  test6("Test6 empty");
+  test7("Test7 one-child chain");
+  test8("Test8 unequal leaves");
+  test9("Test9 equal leaves on both sides");
+  test10("Test10 long chain");
  
   delete a;
   delete b;
   delete c;
   delete d;
+  delete e;
+  return failures == 0 ? 0 : 1;
 }
 
@@ -1,44 +1,64 @@
 #ifndef RECCHECK
 //if you want to add any #includes like <iostream> you must do them here (before the next endif)
 #include <iostream>
+#include <utility>
+#include <vector>
 #endif
 
 #include "equal-paths.h"
+#include "equal-paths-depth.h"
 
 using namespace std;
 
 
 // You may add any prototypes of helper functions here
 
-int countSteps(Node * root) //countSteps takes a root and returns the num of steps 
-//that can be taken down the tree, to the furthest leaf node
+
+bool equalPaths(Node * root) //main function
 {
-    if (root == nullptr)
-    {
-        return 0;
-    }
-    int leftSteps = countSteps(root -> left);
-    int rightSteps = countSteps(root -> right);
-    return max(leftSteps, rightSteps) + 1; //"max" is taken in case either leftsteps or rightsteps reaches the base case AND to use the variable that is storing the prev countSteps return val
+    int leafDepth;
+    return equalPaths(root, leafDepth);
 }
 
 
-bool equalPaths(Node * root) //main function
+bool equalPaths(Node * root, int & leafDepth)
+//every root-to-leaf path has the same length iff every leaf sits at the same depth, so a single
+//depth-first walk that compares each leaf against the first one is enough. the walk keeps its own
+//stack of (node, depth) pairs so that a degenerate chain cannot overflow the call stack.
 {
+    leafDepth = -1;
     if (root == nullptr)
     {
         return true;
     }
-    int leftCount = countSteps(root->left);
-    int rightCount = countSteps(root->right);
-
-    if ( (leftCount != rightCount) && (leftCount > 0) && (rightCount > 0))
-    //if the num of steps to leaf nodes at any given subtree in the tree aren't equal, the entire funt returns false.
-    //also, if either leftCount or rightCount = 0, then either 1 or no paths exist from a node, meaning the subtree rooted at the given node is balanced.
+    vector<pair<Node*, int> > stack;
+    stack.push_back(make_pair(root, 0));
+    while (!stack.empty())
     {
-        return false;
+        Node* node = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+        if (node -> left == nullptr && node -> right == nullptr) //leaf: it must match the first leaf we saw
+        {
+            if (leafDepth == -1)
+            {
+                leafDepth = depth;
+            }
+            else if (depth != leafDepth)
+            {
+                leafDepth = -1;
+                return false;
+            }
+            continue;
+        }
+        if (node -> right != nullptr)
+        {
+            stack.push_back(make_pair(node -> right, depth + 1));
+        }
+        if (node -> left != nullptr)
+        {
+            stack.push_back(make_pair(node -> left, depth + 1));
+        }
     }
-
-    return equalPaths(root->left) && equalPaths(root->right); //finally, we check the rest of all of the subtrees. if this hits base case, we get true.
+    return true;
 }
-
@@ -0,0 +1,218 @@
+#ifndef FROZENBST_H
+#define FROZENBST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+* A read-only snapshot of a search tree, as returned by
+* BinarySearchTree::freeze().
+*
+* The keys are stored in Eytzinger (BFS) order: the root at index 1 and the
+* children of index k at 2k and 2k+1. A lookup walks that implicit tree with
+* no pointers and no data-dependent branches, and the top levels it visits
+* share a handful of cache lines. The entries themselves are kept in a
+* separate sorted array, which is what iteration walks.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class FrozenTree
+{
+public:
+    typedef typename std::vector<std::pair<Key, Value> >::const_iterator iterator;
+
+    explicit FrozenTree(const Compare& comp = Compare());
+    template<typename InputIt>
+    FrozenTree(InputIt first, InputIt last, const Compare& comp = Compare());
+
+    std::size_t size() const;
+    bool empty() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    const Value& operator[](const Key& key) const;
+
+private:
+    void layout(std::size_t k, std::size_t& next);
+
+    std::vector<std::pair<Key, Value> > items_;   // sorted by key
+    std::vector<Key> keys_;                       // Eytzinger order; keys_[0] is padding
+    std::vector<std::size_t> rank_;               // rank_[k] = index in items_ of keys_[k]
+    Compare comp_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the FrozenTree class.
+  ---------------------------------------------
+*/
+
+/**
+* Constructs an empty snapshot.
+*/
+template<typename Key, typename Value, typename Compare>
+FrozenTree<Key, Value, Compare>::FrozenTree(const Compare& comp) :
+    comp_(comp)
+{
+
+}
+
+/**
+* Constructs a snapshot of [first, last), which must be sorted by key with
+* no duplicates (as produced by iterating a BinarySearchTree).
+*/
+template<typename Key, typename Value, typename Compare>
+template<typename InputIt>
+FrozenTree<Key, Value, Compare>::FrozenTree(InputIt first, InputIt last, const Compare& comp) :
+    comp_(comp)
+{
+    for (; first != last; ++first)
+    {
+        items_.push_back(*first);
+    }
+    if (items_.empty())
+    {
+        return;
+    }
+    rank_.resize(items_.size() + 1);
+    std::size_t next = 0;
+    layout(1, next);
+
+    keys_.reserve(items_.size() + 1);
+    keys_.push_back(items_[0].first);
+    for (std::size_t k = 1; k <= items_.size(); k++)
+    {
+        keys_.push_back(items_[rank_[k]].first);
+    }
+}
+
+/**
+* Assigns sorted positions to the Eytzinger subtree rooted at k with an
+* in-order walk; next is the next unassigned sorted index.
+*/
+template<typename Key, typename Value, typename Compare>
+void FrozenTree<Key, Value, Compare>::layout(std::size_t k, std::size_t& next)
+{
+    if (k > items_.size())
+    {
+        return;
+    }
+    layout(2 * k, next);
+    rank_[k] = next++;
+    layout(2 * k + 1, next);
+}
+
+/**
+* The number of entries in the snapshot.
+*/
+template<typename Key, typename Value, typename Compare>
+std::size_t FrozenTree<Key, Value, Compare>::size() const
+{
+    return items_.size();
+}
+
+/**
+* Returns true if the snapshot holds no entries.
+*/
+template<typename Key, typename Value, typename Compare>
+bool FrozenTree<Key, Value, Compare>::empty() const
+{
+    return items_.empty();
+}
+
+/**
+* Returns an iterator to the smallest entry.
+*/
+template<typename Key, typename Value, typename Compare>
+typename FrozenTree<Key, Value, Compare>::iterator FrozenTree<Key, Value, Compare>::begin() const
+{
+    return items_.begin();
+}
+
+/**
+* Returns the past-the-end iterator.
+*/
+template<typename Key, typename Value, typename Compare>
+typename FrozenTree<Key, Value, Compare>::iterator FrozenTree<Key, Value, Compare>::end() const
+{
+    return items_.end();
+}
+
+/**
+* Returns an iterator to the first entry whose key is not less than key,
+* or end() if there is none.
+*
+* Each step picks a child with arithmetic instead of a branch, so the loop
+* always runs floor(log2(n)) + 1 times. The descendants a few levels down
+* are contiguous in this layout, so the cache line holding them is prefetched
+* while the current level is compared. When the walk falls off the bottom,
+* the answer is the last node where we went left, which is recovered by
+* stripping the trailing 1 bits (right turns) and then the 0 bit (that left
+* turn) from k: one count-trailing-zeros where the compiler has it, a shift
+* loop elsewhere. The prefetch address can lie past the end of keys_, so it
+* is formed as an integer rather than by pointer arithmetic.
+*/
+template<typename Key, typename Value, typename Compare>
+typename FrozenTree<Key, Value, Compare>::iterator FrozenTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    const std::size_t n = items_.size();
+    const Key* keys = keys_.data();
+    const std::size_t ahead = sizeof(Key) >= 64 ? 1 : 64 / sizeof(Key);
+    std::size_t k = 1;
+    while (k <= n)
+    {
+#if defined(__GNUC__)
+        __builtin_prefetch(reinterpret_cast<const void*>(reinterpret_cast<std::uintptr_t>(keys) + k * ahead * sizeof(Key)));
+#endif
+        k = 2 * k + comp_(keys[k], key);
+    }
+#if defined(__GNUC__)
+    k >>= __builtin_ctzll(~static_cast<unsigned long long>(k)) + 1;
+#else
+    while (k & 1)
+    {
+        k >>= 1;
+    }
+    k >>= 1;
+#endif
+    return k == 0 ? items_.end() : items_.begin() + rank_[k];
+}
+
+/**
+* Returns an iterator to the entry with the given key, or end().
+*/
+template<typename Key, typename Value, typename Compare>
+typename FrozenTree<Key, Value, Compare>::iterator FrozenTree<Key, Value, Compare>::find(const Key& key) const
+{
+    iterator it = lower_bound(key);
+    if (it != items_.end() && comp_(key, it->first))
+    {
+        return items_.end();
+    }
+    return it;
+}
+
+/**
+* @precondition The key exists in the snapshot
+* Returns the value associated with the key
+*/
+template<typename Key, typename Value, typename Compare>
+const Value& FrozenTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == items_.end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/*
+  -------------------------------------------
+  End implementations for the FrozenTree class.
+  -------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,584 @@
+#ifndef MAPPEDTREE_H
+#define MAPPEDTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+* The fixed-size header at the start of a mapped tree file, as written by
+* BinarySearchTree::writeMapped(). The nodes follow at byte headerBytes.
+*/
+struct MappedTreeHeader
+{
+    static const std::size_t headerBytes = 64;
+    static const std::uint32_t currentVersion = 1;
+
+    char magic[4];              // "BSTM"
+    std::uint32_t version;      // a different byte order reads as another version
+    std::uint32_t keySize;
+    std::uint32_t valueSize;
+    std::uint32_t nodeSize;
+    std::uint32_t reserved;
+    std::uint64_t count;
+    std::uint64_t root;         // file offset of the root node, 0 when empty
+};
+
+/**
+* One node of a mapped tree file. Links are byte offsets from the node
+* itself to the node they point at, 0 meaning none, so the file means the
+* same wherever it is mapped.
+*/
+template <typename Key, typename Value>
+struct MappedNode
+{
+    std::pair<const Key, Value> item;
+    std::int64_t left;
+    std::int64_t right;
+    std::int64_t parent;
+
+    const MappedNode* getLeft() const;
+    const MappedNode* getRight() const;
+    const MappedNode* getParent() const;
+
+    static const MappedNode* follow(const MappedNode* node, std::int64_t offset);
+};
+
+/**
+* A read-only search tree served straight from a file written by
+* BinarySearchTree::writeMapped(), without deserializing it.
+*
+* Opening maps the file and checks its header, and nothing more, so the
+* first query can run at once whatever the size of the tree. The mapping
+* is advised as randomly accessed, so a page is only read in when a query
+* or iteration touches it. The writer stores the nodes in van Emde Boas
+* order (each half of the levels of a subtree stored contiguously, with
+* the same rule applied inside each part), so a descent touches
+* O(log n / log B) pages for B nodes per page rather than one per level.
+*
+* Keys and values must be trivially copyable and are read in the layout
+* and byte order of the machine that wrote the file. The header is
+* checked; the links inside the file are trusted.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class MappedTree
+{
+public:
+    typedef MappedNode<Key, Value> NodeType;
+
+    explicit MappedTree(const std::string& path, const Compare& comp = Compare());
+    ~MappedTree();
+
+    /**
+    * A bidirectional iterator over the entries in key order, with the
+    * same semantics as BinarySearchTree::const_iterator: end() can be
+    * decremented to reach the last entry.
+    */
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    private:
+        friend class MappedTree<Key, Value, Compare>;
+        iterator(const NodeType* node, const MappedTree<Key, Value, Compare>* tree);
+        const NodeType* current_;
+        const MappedTree<Key, Value, Compare>* tree_;
+    };
+    typedef iterator const_iterator;
+
+    std::size_t size() const;
+    bool empty() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lower_bound(const Key& key) const;
+    iterator upper_bound(const Key& key) const;
+    const Value& operator[](const Key& key) const;
+
+private:
+    // Not copyable: owns the mapping.
+    MappedTree(const MappedTree&);
+    MappedTree& operator=(const MappedTree&);
+
+    const NodeType* bound(const Key& key, bool strict) const;
+    const NodeType* smallest() const;
+    const NodeType* largest() const;
+    static const NodeType* successor(const NodeType* node);
+    static const NodeType* predecessor(const NodeType* node);
+
+    void* mapping_;
+    std::size_t length_;
+    const NodeType* root_;
+    std::size_t count_;
+    Compare comp_;
+};
+
+/*
+  ---------------------------------------------
+  Begin implementations for the MappedNode class.
+  ---------------------------------------------
+*/
+
+/**
+* The node offset bytes away from node, or NULL for offset 0.
+*/
+template<typename Key, typename Value>
+const MappedNode<Key, Value>* MappedNode<Key, Value>::follow(const MappedNode* node, std::int64_t offset)
+{
+    if (offset == 0)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<const MappedNode*>(reinterpret_cast<const char*>(node) + offset);
+}
+
+/**
+* A getter for the left child.
+*/
+template<typename Key, typename Value>
+const MappedNode<Key, Value>* MappedNode<Key, Value>::getLeft() const
+{
+    return follow(this, left);
+}
+
+/**
+* A getter for the right child.
+*/
+template<typename Key, typename Value>
+const MappedNode<Key, Value>* MappedNode<Key, Value>::getRight() const
+{
+    return follow(this, right);
+}
+
+/**
+* A getter for the parent.
+*/
+template<typename Key, typename Value>
+const MappedNode<Key, Value>* MappedNode<Key, Value>::getParent() const
+{
+    return follow(this, parent);
+}
+
+/*
+  -------------------------------------------
+  End implementations for the MappedNode class.
+  -------------------------------------------
+*/
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the MappedTree::iterator class.
+  -----------------------------------------------------
+*/
+
+/**
+* A default constructor that initializes the iterator to NULL.
+*/
+template<typename Key, typename Value, typename Compare>
+MappedTree<Key, Value, Compare>::iterator::iterator() :
+    current_(nullptr),
+    tree_(nullptr)
+{
+
+}
+
+/**
+* Constructs an iterator at node (end() for NULL) of tree.
+*/
+template<typename Key, typename Value, typename Compare>
+MappedTree<Key, Value, Compare>::iterator::iterator(const NodeType* node, const MappedTree<Key, Value, Compare>* tree) :
+    current_(node),
+    tree_(tree)
+{
+
+}
+
+/**
+* Provides access to the item.
+*/
+template<typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value>& MappedTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return current_->item;
+}
+
+/**
+* Provides access to the address of the item.
+*/
+template<typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value>* MappedTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &current_->item;
+}
+
+/**
+* Checks if both iterators are at the same entry.
+*/
+template<typename Key, typename Value, typename Compare>
+bool MappedTree<Key, Value, Compare>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+/**
+* Checks if the iterators are at different entries.
+*/
+template<typename Key, typename Value, typename Compare>
+bool MappedTree<Key, Value, Compare>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+/**
+* Advances to the next entry in key order.
+*/
+template<typename Key, typename Value, typename Compare>
+typename MappedTree<Key, Value, Compare>::iterator& MappedTree<Key, Value, Compare>::iterator::operator++()
+{
+    current_ = successor(current_);
+    return *this;
+}
+
+/**
+* Postfix form of operator++.
+*/
+template<typename Key, typename Value, typename Compare>
+typename MappedTree<Key, Value, Compare>::iterator MappedTree<Key, Value, Compare>::iterator::operator++(int)
+{
+    iterator before(*this);
+    current_ = successor(current_);
+    return before;
+}
+
+/**
+* Moves back one entry; from end() that is the last entry.
+*/
+template<typename Key, typename Value, typename Compare>
+typename MappedTree<Key, Value, Compare>::iterator& MappedTree<Key, Value, Compare>::iterator::operator--()
+{
+    current_ = current_ == nullptr ? tree_ -> largest() : predecessor(current_);
+    return *this;
+}
+
+/**
+* Postfix form of operator--.
+*/
+template<typename Key, typename Value, typename Compare>
+typename MappedTree<Key, Value, Compare>::iterator MappedTree<Key, Value, Compare>::iterator::operator--(int)
+{
+    iterator before(*this);
+    --*this;
+    return before;
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the MappedTree::iterator class.
+  ---------------------------------------------------
+*/
+
+/*
+  ---------------------------------------------
+  Begin implementations for the MappedTree class.
+  ---------------------------------------------
+*/
+
+/**
+* Maps the tree file at path read-only and checks its header. Throws
+* std::runtime_error if the file cannot be mapped or was written for
+* another format version or other key, value or node sizes.
+*/
+template<typename Key, typename Value, typename Compare>
+MappedTree<Key, Value, Compare>::MappedTree(const std::string& path, const Compare& comp) :
+    mapping_(nullptr),
+    length_(0),
+    root_(nullptr),
+    count_(0),
+    comp_(comp)
+{
+    static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                  "MappedTree needs trivially copyable keys and values");
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("MappedTree: cannot open " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < MappedTreeHeader::headerBytes)
+    {
+        ::close(fd);
+        throw std::runtime_error("MappedTree: not a mapped tree file: " + path);
+    }
+    length_ = static_cast<std::size_t>(info.st_size);
+    void* mapping = ::mmap(nullptr, length_, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("MappedTree: cannot map " + path);
+    }
+    mapping_ = mapping;
+    ::madvise(mapping_, length_, MADV_RANDOM);
+
+    MappedTreeHeader header;
+    std::memcpy(&header, mapping_, sizeof(header));
+    const char* problem = nullptr;
+    if (std::memcmp(header.magic, "BSTM", 4) != 0)
+    {
+        problem = "not a mapped tree file";
+    }
+    else if (header.version != MappedTreeHeader::currentVersion)
+    {
+        problem = "unsupported format version";
+    }
+    else if (header.keySize != sizeof(Key) || header.valueSize != sizeof(Value) || header.nodeSize != sizeof(NodeType))
+    {
+        problem = "key or value type does not match";
+    }
+    else if (header.count > (length_ - MappedTreeHeader::headerBytes) / sizeof(NodeType) ||
+             (header.count == 0) != (header.root == 0) ||
+             (header.root != 0 && (header.root < MappedTreeHeader::headerBytes ||
+                                   (header.root - MappedTreeHeader::headerBytes) % sizeof(NodeType) != 0 ||
+                                   header.root - MappedTreeHeader::headerBytes >= header.count * sizeof(NodeType))))
+    {
+        problem = "file is truncated or corrupt";
+    }
+    if (problem != nullptr)
+    {
+        ::munmap(mapping_, length_);
+        throw std::runtime_error(std::string("MappedTree: ") + problem + ": " + path);
+    }
+    count_ = static_cast<std::size_t>(header.count);
+    if (header.root != 0)
+    {
+        root_ = reinterpret_cast<const NodeType*>(static_cast<const char*>(mapping_) + header.root);
+    }
+}
+
+/**
+* Unmaps the file.
+*/
+template<typename Key, typename Value, typename Compare>
+MappedTree<Key, Value, Compare>::~MappedTree()
+{
+    ::munmap(mapping_, length_);
+}
+
+/**
+* The number of entries in the file.
+*/
+template<typename Key, typename Value, typename Compare>
+std::size_t MappedTree<Key, Value, Compare>::size() const
+{
+    return count_;
+}
+
+/**
+* Returns true if the file holds no entries.
+*/
+template<typename Key, typename Value, typename Compare>
+bool MappedTree<Key, Value, Compare>::empty() const
+{
+    return count_ == 0;
+}
+
+/**
+* Returns an iterator to the smallest entry.
+*/
+template<typename Key, typename Value, typename Compare>
+typename MappedTree<Key, Value, Compare>::iterator MappedTree<Key, Value, Compare>::begin() const
+{
+    return iterator(smallest(), this);
+}
+
+/**
+* Returns the past-the-end iterator.
+*/
+template<typename Key, typename Value, typename Compare>
+typename MappedTree<Key, Value, Compare>::iterator MappedTree<Key, Value, Compare>::end() const
+{
+    return iterator(nullptr, this);
+}
+
+/**
+* Returns an iterator to the entry with the given key, or end().
+*/
+template<typename Key, typename Value, typename Compare>
+typename MappedTree<Key, Value, Compare>::iterator MappedTree<Key, Value, Compare>::find(const Key& key) const
+{
+    const NodeType* node = bound(key, false);
+    if (node != nullptr && comp_(key, node->item.first))
+    {
+        node = nullptr;
+    }
+    return iterator(node, this);
+}
+
+/**
+* Returns an iterator to the first entry whose key is not less than key,
+* or end() if there is none.
+*/
+template<typename Key, typename Value, typename Compare>
+typename MappedTree<Key, Value, Compare>::iterator MappedTree<Key, Value, Compare>::lower_bound(const Key& key) const
+{
+    return iterator(bound(key, false), this);
+}
+
+/**
+* Returns an iterator to the first entry whose key is greater than key,
+* or end() if there is none.
+*/
+template<typename Key, typename Value, typename Compare>
+typename MappedTree<Key, Value, Compare>::iterator MappedTree<Key, Value, Compare>::upper_bound(const Key& key) const
+{
+    return iterator(bound(key, true), this);
+}
+
+/**
+* @precondition The key exists in the file
+* Returns the value associated with the key
+*/
+template<typename Key, typename Value, typename Compare>
+const Value& MappedTree<Key, Value, Compare>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if (it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+* The descent behind lower_bound and upper_bound: the last node where the
+* walk turned left is the first key greater than key (strict) or not less
+* than it.
+*/
+template<typename Key, typename Value, typename Compare>
+const typename MappedTree<Key, Value, Compare>::NodeType* MappedTree<Key, Value, Compare>::bound(const Key& key, bool strict) const
+{
+    const NodeType* finder = root_;
+    const NodeType* candidate = nullptr;
+    while (finder != nullptr)
+    {
+        if (strict ? comp_(key, finder->item.first) : !comp_(finder->item.first, key))
+        {
+            candidate = finder;
+            finder = finder -> getLeft();
+        }
+        else
+        {
+            finder = finder -> getRight();
+        }
+    }
+    return candidate;
+}
+
+/**
+* The node with the smallest key, or NULL when empty.
+*/
+template<typename Key, typename Value, typename Compare>
+const typename MappedTree<Key, Value, Compare>::NodeType* MappedTree<Key, Value, Compare>::smallest() const
+{
+    const NodeType* finder = root_;
+    while (finder != nullptr && finder -> getLeft() != nullptr)
+    {
+        finder = finder -> getLeft();
+    }
+    return finder;
+}
+
+/**
+* The node with the largest key, or NULL when empty.
+*/
+template<typename Key, typename Value, typename Compare>
+const typename MappedTree<Key, Value, Compare>::NodeType* MappedTree<Key, Value, Compare>::largest() const
+{
+    const NodeType* finder = root_;
+    while (finder != nullptr && finder -> getRight() != nullptr)
+    {
+        finder = finder -> getRight();
+    }
+    return finder;
+}
+
+/**
+* The node after node in key order, or NULL if it is the last.
+*/
+template<typename Key, typename Value, typename Compare>
+const typename MappedTree<Key, Value, Compare>::NodeType* MappedTree<Key, Value, Compare>::successor(const NodeType* node)
+{
+    const NodeType* next = node -> getRight();
+    if (next != nullptr)
+    {
+        while (next -> getLeft() != nullptr)
+        {
+            next = next -> getLeft();
+        }
+        return next;
+    }
+    next = node -> getParent();
+    while (next != nullptr && next -> getRight() == node)
+    {
+        node = next;
+        next = next -> getParent();
+    }
+    return next;
+}
+
+/**
+* The node before node in key order, or NULL if it is the first.
+*/
+template<typename Key, typename Value, typename Compare>
+const typename MappedTree<Key, Value, Compare>::NodeType* MappedTree<Key, Value, Compare>::predecessor(const NodeType* node)
+{
+    const NodeType* prev = node -> getLeft();
+    if (prev != nullptr)
+    {
+        while (prev -> getRight() != nullptr)
+        {
+            prev = prev -> getRight();
+        }
+        return prev;
+    }
+    prev = node -> getParent();
+    while (prev != nullptr && prev -> getLeft() == node)
+    {
+        node = prev;
+        prev = prev -> getParent();
+    }
+    return prev;
+}
+
+/*
+  -------------------------------------------
+  End implementations for the MappedTree class.
+  -------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,312 @@
+#ifndef NODE_ARENA_H
+#define NODE_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include "tree-stats.h"
+
+/**
+ * A slab allocator for fixed-size tree nodes.
+ *
+ * Slots are carved out of large slabs so that nodes inserted together end up
+ * next to each other in memory. Slots handed back with deallocate() go on a
+ * free list and are reused by the next allocate(), and release() drops every
+ * slab at once so a tree can be torn down without visiting its nodes.
+ *
+ * Trees that exchange nodes (split/join) share one arena through a
+ * shared_ptr, and two arenas can be merged so that nodes from both can be
+ * freed through either. Trees sharing an arena must not be modified
+ * concurrently.
+ *
+ * Defining BST_HEAP_NODES turns the arena into a thin wrapper around
+ * ::operator new / ::operator delete (one heap block per node), which is
+ * useful for benchmarking and for running under leak checkers.
+ *
+ * With BST_STATS defined, every slot handed out or back counts as a node
+ * allocation or free, and release() counts the slots it drops unreturned.
+ */
+class NodeArena
+{
+public:
+    // true when nodes live in slabs, false when every node is its own heap block
+#ifdef BST_HEAP_NODES
+    static const bool pooled = false;
+#else
+    static const bool pooled = true;
+#endif
+
+    NodeArena(std::size_t slotSize, std::size_t slotAlign, std::size_t slotsPerSlab = 512);
+    ~NodeArena();
+
+    void* allocate();
+    void deallocate(void* slot);
+    void release();
+
+    std::size_t slotSize() const;
+    std::size_t slotAlign() const;
+    std::size_t slabCount() const;
+
+    static void merge(const std::shared_ptr<NodeArena>& into, const std::shared_ptr<NodeArena>& from);
+    static NodeArena& resolve(std::shared_ptr<NodeArena>& arena);
+
+private:
+    // Not copyable: slabs have exactly one owner.
+    NodeArena(const NodeArena&);
+    NodeArena& operator=(const NodeArena&);
+
+    struct FreeSlot { FreeSlot* next; };
+    struct Slab { Slab* next; };
+
+    static std::size_t roundUp(std::size_t n, std::size_t align);
+    void grow();
+
+    std::size_t slotSize_;
+    std::size_t slotAlign_;
+    std::size_t headerSize_;
+    std::size_t slotsPerSlab_;
+    std::size_t slabCount_;
+    Slab* slabs_;
+    char* bump_;      // next never-used slot in the newest slab
+    char* bumpEnd_;   // one past the last slot of the newest slab
+    FreeSlot* free_;
+    Slab* lastSlab_;              // oldest slab, so slab lists splice in O(1)
+    FreeSlot* lastFree_;          // tail of the free list, for the same reason
+    std::shared_ptr<NodeArena> mergedInto_;
+#ifdef BST_STATS
+    std::size_t live_;            // slots handed out and not yet returned
+#endif
+};
+
+/*
+  --------------------------------------------
+  Begin implementations for the NodeArena class.
+  --------------------------------------------
+*/
+
+/**
+* Constructs an empty arena handing out slots of (at least) slotSize bytes
+* aligned to slotAlign. No memory is requested until the first allocate().
+*/
+inline NodeArena::NodeArena(std::size_t slotSize, std::size_t slotAlign, std::size_t slotsPerSlab) :
+    slotSize_(roundUp(slotSize < sizeof(FreeSlot) ? sizeof(FreeSlot) : slotSize, slotAlign)),
+    slotAlign_(slotAlign),
+    headerSize_(roundUp(sizeof(Slab), slotAlign)),
+    slotsPerSlab_(slotsPerSlab == 0 ? 1 : slotsPerSlab),
+    slabCount_(0),
+    slabs_(nullptr),
+    bump_(nullptr),
+    bumpEnd_(nullptr),
+    free_(nullptr),
+    lastSlab_(nullptr),
+    lastFree_(nullptr)
+{
+#ifdef BST_STATS
+    live_ = 0;
+#endif
+}
+
+/**
+* Frees every slab. Objects still living in the slots are not destroyed;
+* that is the owning tree's job.
+*/
+inline NodeArena::~NodeArena()
+{
+    release();
+}
+
+/**
+* Rounds n up to the next multiple of align.
+*/
+inline std::size_t NodeArena::roundUp(std::size_t n, std::size_t align)
+{
+    return (n + align - 1) / align * align;
+}
+
+/**
+* Requests a new slab and makes it the bump region.
+*/
+inline void NodeArena::grow()
+{
+    char* raw = static_cast<char*>(::operator new(headerSize_ + slotSize_ * slotsPerSlab_));
+    Slab* slab = reinterpret_cast<Slab*>(raw);
+    slab->next = slabs_;
+    slabs_ = slab;
+    if (lastSlab_ == nullptr)
+    {
+        lastSlab_ = slab;
+    }
+    ++slabCount_;
+    bump_ = raw + headerSize_;
+    bumpEnd_ = bump_ + slotSize_ * slotsPerSlab_;
+}
+
+/**
+* Returns uninitialized storage for one node. Recycled slots are preferred
+* over fresh ones so that remove/insert churn does not grow the arena.
+*/
+inline void* NodeArena::allocate()
+{
+#ifdef BST_STATS
+    ++live_;
+    BST_STATS_ADD(StatAllocations, 1);
+#endif
+    if (!pooled)
+    {
+        return ::operator new(slotSize_);
+    }
+    if (free_ != nullptr)
+    {
+        FreeSlot* slot = free_;
+        free_ = slot->next;
+        if (free_ == nullptr)
+        {
+            lastFree_ = nullptr;
+        }
+        return slot;
+    }
+    if (bump_ == bumpEnd_)
+    {
+        grow();
+    }
+    void* slot = bump_;
+    bump_ += slotSize_;
+    return slot;
+}
+
+/**
+* Hands a slot back to the arena. The object in it must already be destroyed.
+*/
+inline void NodeArena::deallocate(void* slot)
+{
+#ifdef BST_STATS
+    --live_;
+    BST_STATS_ADD(StatFrees, 1);
+#endif
+    if (!pooled)
+    {
+        ::operator delete(slot);
+        return;
+    }
+    FreeSlot* freed = static_cast<FreeSlot*>(slot);
+    freed->next = free_;
+    free_ = freed;
+    if (lastFree_ == nullptr)
+    {
+        lastFree_ = freed;
+    }
+}
+
+/**
+* Drops every slab in one sweep, invalidating all outstanding slots.
+* The cost depends on the number of slabs, not the number of nodes.
+*/
+inline void NodeArena::release()
+{
+#ifdef BST_STATS
+    BST_STATS_ADD(StatFrees, live_);
+    live_ = 0;
+#endif
+    while (slabs_ != nullptr)
+    {
+        Slab* next = slabs_->next;
+        ::operator delete(slabs_);
+        slabs_ = next;
+    }
+    slabCount_ = 0;
+    bump_ = bumpEnd_ = nullptr;
+    free_ = nullptr;
+    lastSlab_ = nullptr;
+    lastFree_ = nullptr;
+}
+
+/**
+* The size in bytes of each slot, after padding for alignment.
+*/
+inline std::size_t NodeArena::slotSize() const
+{
+    return slotSize_;
+}
+
+/**
+* The alignment of each slot, so that a matching arena can be made.
+*/
+inline std::size_t NodeArena::slotAlign() const
+{
+    return slotAlign_;
+}
+
+/**
+* The number of slabs currently held by the arena.
+*/
+inline std::size_t NodeArena::slabCount() const
+{
+    return slabCount_;
+}
+
+/**
+* Moves every slab and free slot of from into into, in O(1), and leaves from
+* forwarding to into so that trees still holding from keep working once they
+* resolve() it. The unused tail of from's newest slab is not carried over.
+* Both arenas must hold slots of the same size and neither may already have
+* been merged away.
+*/
+inline void NodeArena::merge(const std::shared_ptr<NodeArena>& into, const std::shared_ptr<NodeArena>& from)
+{
+    if (into == from)
+    {
+        return;
+    }
+    if (from->slabs_ != nullptr)
+    {
+        from->lastSlab_->next = into->slabs_;
+        into->slabs_ = from->slabs_;
+        if (into->lastSlab_ == nullptr)
+        {
+            into->lastSlab_ = from->lastSlab_;
+            into->bump_ = from->bump_;
+            into->bumpEnd_ = from->bumpEnd_;
+        }
+        into->slabCount_ += from->slabCount_;
+    }
+    if (from->free_ != nullptr)
+    {
+        from->lastFree_->next = into->free_;
+        into->free_ = from->free_;
+        if (into->lastFree_ == nullptr)
+        {
+            into->lastFree_ = from->lastFree_;
+        }
+    }
+    from->slabs_ = from->lastSlab_ = nullptr;
+    from->free_ = from->lastFree_ = nullptr;
+    from->bump_ = from->bumpEnd_ = nullptr;
+    from->slabCount_ = 0;
+    from->mergedInto_ = into;
+#ifdef BST_STATS
+    into->live_ += from->live_;
+    from->live_ = 0;
+#endif
+}
+
+/**
+* Follows merges from arena to the arena that now owns its slabs, updating
+* the caller's pointer along the way, and returns it.
+*/
+inline NodeArena& NodeArena::resolve(std::shared_ptr<NodeArena>& arena)
+{
+    while (arena->mergedInto_)
+    {
+        std::shared_ptr<NodeArena> next = arena->mergedInto_;
+        arena = next;
+    }
+    return *arena;
+}
+
+/*
+  ------------------------------------------
+  End implementations for the NodeArena class.
+  ------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,686 @@
+#ifndef PERSISTENTAVL_H
+#define PERSISTENTAVL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/**
+* An AVL tree whose versions share structure, so that a snapshot of it costs
+* O(1) no matter how large it is.
+*
+* Nodes are reference counted and may belong to any number of trees. A
+* snapshot (or a copy) of a tree is just another reference to its root.
+* insert and remove copy the nodes on their root-to-leaf path that some other
+* version still uses and share every other subtree; nodes used by this tree
+* alone are updated in place, so a tree nobody has snapshotted costs about
+* the same to update as an AVLTree. A node is freed when the last version
+* using it lets go.
+*
+* Since a node can have many parents, nodes keep no parent pointers and
+* iterators carry the path from the root instead. Writing to a tree
+* invalidates its iterators but never those of its snapshots, which is what
+* lets a long scan run over a snapshot while writes continue. Each tree
+* object is used by one thread at a time; different versions may be used
+* from different threads, because node counts are atomic and nodes are
+* freed with delete rather than into a per-tree arena.
+*/
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class PersistentAVLTree
+{
+private:
+    struct PNode;
+
+public:
+    // Deeper than any AVL tree that fits in memory.
+    static const int maxHeight = 96;
+
+    /**
+    * A forward iterator in key order that keeps its path from the root in a
+    * fixed array.
+    */
+    class const_iterator
+    {
+    public:
+        const_iterator();
+
+        const std::pair<const Key, Value>& operator*() const;
+        const std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+
+    private:
+        friend class PersistentAVLTree<Key, Value, Compare>;
+        void pushLeft(const PNode* node);
+
+        const PNode* stack_[maxHeight];
+        int depth_;
+    };
+
+    explicit PersistentAVLTree(const Compare& comp = Compare());
+    PersistentAVLTree(const PersistentAVLTree& other);
+    PersistentAVLTree(PersistentAVLTree&& other);
+    PersistentAVLTree& operator=(const PersistentAVLTree& other);
+    PersistentAVLTree& operator=(PersistentAVLTree&& other);
+    ~PersistentAVLTree();
+
+    PersistentAVLTree snapshot() const;
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator find(const Key& key) const;
+    std::size_t size() const;
+    bool empty() const;
+
+    std::size_t copyCount() const;
+    static std::size_t nodeBytes();
+
+private:
+    struct PNode
+    {
+        PNode(const Key& key, const Value& value);
+        explicit PNode(const PNode& other);
+
+        std::pair<const Key, Value> item_;
+        PNode* left_;
+        PNode* right_;
+        int height_;
+        std::atomic<std::size_t> refs_;     // parents and trees pointing here
+    };
+
+    static int height(const PNode* node);
+    static void fixHeight(PNode* node);
+    static PNode* acquire(PNode* node);
+    static void release(PNode* node);
+
+    // Writes work on the link (slot) that points at a node, so that a copy
+    // is linked in before the original is released and an exception
+    // part-way through leaves a valid tree.
+    void own(PNode*& slot);
+    void insertAt(PNode*& slot, const std::pair<const Key, Value>& keyValuePair);
+    void removeAt(PNode*& slot, const Key& key);
+    PNode* detachMin(PNode*& slot, int& steps);
+    void rebalancePath(PNode*& slot, int steps);
+    void rebalance(PNode*& slot);
+    void rotateLeft(PNode*& slot);
+    void rotateRight(PNode*& slot);
+
+    PNode* root_;           // one reference, owned by this tree
+    std::size_t count_;
+    std::size_t copies_;    // nodes this tree's writes had to copy
+    Compare comp_;
+};
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  ------------------------------------------------------
+*/
+
+/**
+* Builds a node holding a copy of key and value, referenced once.
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PNode::PNode(const Key& key, const Value& value) :
+    item_(key, value), left_(nullptr), right_(nullptr), height_(1), refs_(1)
+{
+
+}
+
+/**
+* Builds an unshared copy of a node. The children are shared with the
+* original, so the caller must acquire them.
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PNode::PNode(const PNode& other) :
+    item_(other.item_), left_(other.left_), right_(other.right_), height_(other.height_), refs_(1)
+{
+
+}
+
+/**
+* An end iterator.
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::const_iterator::const_iterator() :
+    depth_(0)
+{
+
+}
+
+/**
+* Pushes node and its chain of left children, so the smallest of them ends
+* up on top.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::const_iterator::pushLeft(const PNode* node)
+{
+    while (node != nullptr)
+    {
+        stack_[depth_++] = node;
+        node = node -> left_;
+    }
+}
+
+template<typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value>& PersistentAVLTree<Key, Value, Compare>::const_iterator::operator*() const
+{
+    return stack_[depth_ - 1] -> item_;
+}
+
+template<typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value>* PersistentAVLTree<Key, Value, Compare>::const_iterator::operator->() const
+{
+    return &(stack_[depth_ - 1] -> item_);
+}
+
+/**
+* Two iterators are equal when they are on the same node, or both at end.
+*/
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    if (depth_ == 0 || rhs.depth_ == 0)
+    {
+        return depth_ == rhs.depth_;
+    }
+    return stack_[depth_ - 1] == rhs.stack_[rhs.depth_ - 1];
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Steps to the in-order successor: the smallest node of the right subtree,
+* or else the nearest ancestor still waiting on the stack.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator&
+PersistentAVLTree<Key, Value, Compare>::const_iterator::operator++()
+{
+    const PNode* node = stack_[--depth_];
+    pushLeft(node -> right_);
+    return *this;
+}
+
+/**
+* Constructs an empty tree.
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const Compare& comp) :
+    root_(nullptr),
+    count_(0),
+    copies_(0),
+    comp_(comp)
+{
+
+}
+
+/**
+* Shares other's nodes; O(1).
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const PersistentAVLTree& other) :
+    root_(acquire(other.root_)),
+    count_(other.count_),
+    copies_(0),
+    comp_(other.comp_)
+{
+
+}
+
+/**
+* Takes over other's reference to its root, leaving other empty.
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(PersistentAVLTree&& other) :
+    root_(other.root_),
+    count_(other.count_),
+    copies_(other.copies_),
+    comp_(other.comp_)
+{
+    other.root_ = nullptr;
+    other.count_ = 0;
+}
+
+/**
+* Shares other's nodes in place of this tree's; O(1), like the copy
+* constructor. This is a new version, so its copy count starts again at 0.
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>& PersistentAVLTree<Key, Value, Compare>::operator=(const PersistentAVLTree& other)
+{
+    PNode* root = acquire(other.root_);
+    release(root_);
+    root_ = root;
+    count_ = other.count_;
+    copies_ = 0;
+    comp_ = other.comp_;
+    return *this;
+}
+
+/**
+* Drops this tree's reference and takes over other's, along with its copy
+* count, leaving other empty.
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>& PersistentAVLTree<Key, Value, Compare>::operator=(PersistentAVLTree&& other)
+{
+    if (this != &other)
+    {
+        release(root_);
+        root_ = other.root_;
+        count_ = other.count_;
+        copies_ = other.copies_;
+        comp_ = other.comp_;
+        other.root_ = nullptr;
+        other.count_ = 0;
+    }
+    return *this;
+}
+
+/**
+* Drops this tree's reference; nodes no other version uses are freed.
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::~PersistentAVLTree()
+{
+    release(root_);
+}
+
+/**
+* A point-in-time copy of the tree in O(1). Later writes to either tree
+* do not show up in the other.
+*/
+template<typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare> PersistentAVLTree<Key, Value, Compare>::snapshot() const
+{
+    return PersistentAVLTree(*this);
+}
+
+/**
+* Adds keyValuePair, or replaces the value stored under its key.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    insertAt(root_, keyValuePair);
+}
+
+/**
+* Removes key, if present. Nothing is copied when it is absent.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::remove(const Key& key)
+{
+    if (find(key) == end())
+    {
+        return;
+    }
+    removeAt(root_, key);
+}
+
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::clear()
+{
+    release(root_);
+    root_ = nullptr;
+    count_ = 0;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator PersistentAVLTree<Key, Value, Compare>::begin() const
+{
+    const_iterator it;
+    it.pushLeft(root_);
+    return it;
+}
+
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator PersistentAVLTree<Key, Value, Compare>::end() const
+{
+    return const_iterator();
+}
+
+/**
+* Returns an iterator to key, or end(). The iterator's path is the search
+* path, with the nodes it went right from left out, as they are already
+* behind it in key order.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::const_iterator PersistentAVLTree<Key, Value, Compare>::find(const Key& key) const
+{
+    const_iterator it;
+    const PNode* node = root_;
+    while (node != nullptr)
+    {
+        if (comp_(key, node -> item_.first))
+        {
+            it.stack_[it.depth_++] = node;
+            node = node -> left_;
+        }
+        else if (comp_(node -> item_.first, key))
+        {
+            node = node -> right_;
+        }
+        else
+        {
+            it.stack_[it.depth_++] = node;
+            return it;
+        }
+    }
+    return end();
+}
+
+template<typename Key, typename Value, typename Compare>
+std::size_t PersistentAVLTree<Key, Value, Compare>::size() const
+{
+    return count_;
+}
+
+template<typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::empty() const
+{
+    return count_ == 0;
+}
+
+/**
+* The number of nodes writes through this tree copied because another
+* version shared them; multiplied by nodeBytes() this is the memory that
+* keeping snapshots around has cost.
+*/
+template<typename Key, typename Value, typename Compare>
+std::size_t PersistentAVLTree<Key, Value, Compare>::copyCount() const
+{
+    return copies_;
+}
+
+/**
+* The size of one node.
+*/
+template<typename Key, typename Value, typename Compare>
+std::size_t PersistentAVLTree<Key, Value, Compare>::nodeBytes()
+{
+    return sizeof(PNode);
+}
+
+template<typename Key, typename Value, typename Compare>
+int PersistentAVLTree<Key, Value, Compare>::height(const PNode* node)
+{
+    return node == nullptr ? 0 : node -> height_;
+}
+
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::fixHeight(PNode* node)
+{
+    node -> height_ = 1 + std::max(height(node -> left_), height(node -> right_));
+}
+
+/**
+* Adds a reference to node, which may be null, and returns it.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PNode*
+PersistentAVLTree<Key, Value, Compare>::acquire(PNode* node)
+{
+    if (node != nullptr)
+    {
+        node -> refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return node;
+}
+
+/**
+* Drops a reference to node, freeing it and then, the same way, its
+* children once nothing else refers to it. Uses a worklist rather than
+* recursion, since dropping the last version frees the whole tree.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::release(PNode* node)
+{
+    std::vector<PNode*> work;
+    while (node != nullptr)
+    {
+        if (node -> refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            if (node -> left_ != nullptr)
+            {
+                work.push_back(node -> left_);
+            }
+            if (node -> right_ != nullptr)
+            {
+                work.push_back(node -> right_);
+            }
+            delete node;
+        }
+        if (work.empty())
+        {
+            break;
+        }
+        node = work.back();
+        work.pop_back();
+    }
+}
+
+/**
+* Makes the node in slot one that the current write may change: the node
+* itself when nothing else refers to it, otherwise an unshared copy that
+* replaces it in slot.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::own(PNode*& slot)
+{
+    if (slot -> refs_.load(std::memory_order_acquire) == 1)
+    {
+        return;
+    }
+    PNode* copy = new PNode(*slot);
+    acquire(copy -> left_);
+    acquire(copy -> right_);
+    PNode* shared = slot;
+    slot = copy;
+    release(shared);
+    ++copies_;
+}
+
+/**
+* Adds keyValuePair to the subtree in slot, or replaces the value under its
+* key.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::insertAt(PNode*& slot, const std::pair<const Key, Value>& keyValuePair)
+{
+    if (slot == nullptr)
+    {
+        slot = new PNode(keyValuePair.first, keyValuePair.second);
+        ++count_;
+        return;
+    }
+    own(slot);
+    PNode* node = slot;
+    if (comp_(keyValuePair.first, node -> item_.first))
+    {
+        insertAt(node -> left_, keyValuePair);
+        rebalance(slot);
+    }
+    else if (comp_(node -> item_.first, keyValuePair.first))
+    {
+        insertAt(node -> right_, keyValuePair);
+        rebalance(slot);
+    }
+    else
+    {
+        node -> item_.second = keyValuePair.second;
+    }
+}
+
+/**
+* Removes key, which must be present, from the subtree in slot.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::removeAt(PNode*& slot, const Key& key)
+{
+    own(slot);
+    PNode* node = slot;
+    if (comp_(key, node -> item_.first))
+    {
+        removeAt(node -> left_, key);
+        rebalance(slot);
+        return;
+    }
+    if (comp_(node -> item_.first, key))
+    {
+        removeAt(node -> right_, key);
+        rebalance(slot);
+        return;
+    }
+    PNode* left = node -> left_;
+    PNode* right = node -> right_;
+    if (left == nullptr || right == nullptr)
+    {
+        node -> left_ = node -> right_ = nullptr;
+        slot = left != nullptr ? left : right;
+    }
+    else
+    {
+        // Two children: the successor is detached from the right subtree
+        // and takes the removed node's place before anything is rebalanced.
+        int steps = 0;
+        PNode* successor = detachMin(node -> right_, steps);
+        successor -> left_ = node -> left_;
+        successor -> right_ = node -> right_;
+        node -> left_ = node -> right_ = nullptr;
+        slot = successor;
+        rebalancePath(successor -> right_, steps - 1);
+        rebalance(slot);
+    }
+    release(node);
+    --count_;
+}
+
+/**
+* Unlinks the smallest node of the subtree in slot, making every node on the
+* way down unshared, and returns it unshared with no children. steps is set
+* to the number of left links followed.
+*/
+template<typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::PNode*
+PersistentAVLTree<Key, Value, Compare>::detachMin(PNode*& slot, int& steps)
+{
+    PNode** link = &slot;
+    own(*link);
+    while ((*link) -> left_ != nullptr)
+    {
+        link = &((*link) -> left_);
+        own(*link);
+        ++steps;
+    }
+    PNode* min = *link;
+    *link = min -> right_;
+    min -> right_ = nullptr;
+    return min;
+}
+
+/**
+* Rebalances, bottom-up, the unshared nodes on the path of steps left links
+* below slot, where detachMin took a node out.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::rebalancePath(PNode*& slot, int steps)
+{
+    if (steps < 0 || slot == nullptr)
+    {
+        return;
+    }
+    rebalancePath(slot -> left_, steps - 1);
+    rebalance(slot);
+}
+
+/**
+* Restores the AVL property at the unshared node in slot, whose subtrees
+* differ in height by at most two.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::rebalance(PNode*& slot)
+{
+    PNode* node = slot;
+    int leftHeight = height(node -> left_);
+    int rightHeight = height(node -> right_);
+    if (leftHeight > rightHeight + 1)
+    {
+        if (height(node -> left_ -> left_) < height(node -> left_ -> right_)) //zig-zag
+        {
+            own(node -> left_);
+            rotateLeft(node -> left_);
+        }
+        rotateRight(slot);
+    }
+    else if (rightHeight > leftHeight + 1)
+    {
+        if (height(node -> right_ -> right_) < height(node -> right_ -> left_)) //zig-zag
+        {
+            own(node -> right_);
+            rotateRight(node -> right_);
+        }
+        rotateLeft(slot);
+    }
+    else
+    {
+        node -> height_ = 1 + std::max(leftHeight, rightHeight);
+    }
+}
+
+/**
+* Rotates the unshared node in slot left. Its right child moves up, copied
+* first if another version shares it.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::rotateLeft(PNode*& slot)
+{
+    PNode* node = slot;
+    own(node -> right_);
+    PNode* newParent = node -> right_;
+    node -> right_ = newParent -> left_;
+    newParent -> left_ = node;
+    slot = newParent;
+    fixHeight(node);
+    fixHeight(newParent);
+}
+
+/**
+* Rotates the unshared node in slot right. Its left child moves up, copied
+* first if another version shares it.
+*/
+template<typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::rotateRight(PNode*& slot)
+{
+    PNode* node = slot;
+    own(node -> left_);
+    PNode* newParent = node -> left_;
+    node -> left_ = newParent -> right_;
+    newParent -> right_ = node;
+    slot = newParent;
+    fixHeight(node);
+    fixHeight(newParent);
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the PersistentAVLTree class.
+  ----------------------------------------------------
+*/
+
+#endif
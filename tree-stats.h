@@ -0,0 +1,420 @@
+#ifndef TREE_STATS_H
+#define TREE_STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * Structural counters for the search trees: key comparisons, nodes visited
+ * per descent, rotations, insertFix/removeFix recursion, nodeSwap calls and
+ * node allocations and frees.
+ *
+ * The counters are compiled in only when BST_STATS is defined; otherwise
+ * every update is an empty macro, comparisons go straight to the tree's
+ * Compare and TreeStats::snapshot() returns zeros.
+ *
+ * Every thread counts into its own block, so updates never contend. A
+ * snapshot sums the blocks of all live threads plus whatever threads that
+ * have exited left behind. Counters are process-wide, not per tree.
+ * Snapshots and resets taken while other threads are updating are not
+ * exact; take them when the trees are quiescent.
+ */
+enum TreeStatsCounter
+{
+    StatComparisons,
+    StatDescents,
+    StatNodesVisited,
+    StatRotateLeft,
+    StatRotateRight,
+    StatInsertFixCalls,
+    StatInsertFixRuns,
+    StatInsertFixMaxDepth,
+    StatRemoveFixCalls,
+    StatRemoveFixRuns,
+    StatRemoveFixMaxDepth,
+    StatNodeSwaps,
+    StatAllocations,
+    StatFrees,
+    StatCount
+};
+
+/**
+ * A snapshot of the counters. A run of insertFix or removeFix is one
+ * outermost call; calls counts every level of its recursion, so
+ * calls / runs is the mean depth and maxDepth the deepest seen.
+ */
+struct TreeStats
+{
+#ifdef BST_STATS
+    static const bool enabled = true;
+#else
+    static const bool enabled = false;
+#endif
+
+    std::uint64_t comparisons;
+    std::uint64_t descents;
+    std::uint64_t nodesVisited;
+    std::uint64_t rotateLeft;
+    std::uint64_t rotateRight;
+    std::uint64_t insertFixCalls;
+    std::uint64_t insertFixRuns;
+    std::uint64_t insertFixMaxDepth;
+    std::uint64_t removeFixCalls;
+    std::uint64_t removeFixRuns;
+    std::uint64_t removeFixMaxDepth;
+    std::uint64_t nodeSwaps;
+    std::uint64_t allocations;
+    std::uint64_t frees;
+
+    TreeStats();
+
+    double visitedPerDescent() const;
+    void add(const std::uint64_t* counters);
+
+    static TreeStats snapshot();
+    static void reset();
+};
+
+/**
+ * One thread's counters. Only the owning thread writes them; relaxed
+ * atomics let snapshot() read them from other threads.
+ */
+class TreeStatsBlock
+{
+public:
+    TreeStatsBlock();
+    ~TreeStatsBlock();
+
+    static TreeStatsBlock& local();
+
+    void add(TreeStatsCounter counter, std::uint64_t n);
+    void raise(TreeStatsCounter counter, std::uint64_t value);
+    void load(std::uint64_t* counters) const;
+    void clear();
+
+    unsigned depth[StatCount];   // current recursion depth, by calls counter
+
+private:
+    // Not copyable: registered by address.
+    TreeStatsBlock(const TreeStatsBlock&);
+    TreeStatsBlock& operator=(const TreeStatsBlock&);
+
+    friend struct TreeStats;
+    static std::mutex& registryLock();
+    static std::vector<TreeStatsBlock*>& registry();
+    static TreeStats& retired();
+
+    std::atomic<std::uint64_t> counters_[StatCount];
+};
+
+/**
+ * Counts one call of a recursive fix-up for as long as it is in scope:
+ * calls is the fix's calls counter, followed by its runs and max depth.
+ */
+class TreeStatsDepth
+{
+public:
+    explicit TreeStatsDepth(TreeStatsCounter calls);
+    ~TreeStatsDepth();
+
+private:
+    TreeStatsCounter calls_;
+};
+
+/**
+ * Wraps a Compare so each call is counted as a key comparison. Converts
+ * back to the Compare it holds wherever the tree hands its comparator out.
+ */
+template<typename Compare>
+struct CountingCompare
+{
+    CountingCompare() : comp()
+    {
+    }
+
+    CountingCompare(const Compare& c) : comp(c)
+    {
+    }
+
+    template<typename A, typename B>
+    bool operator()(const A& a, const B& b) const
+    {
+        TreeStatsBlock::local().add(StatComparisons, 1);
+        return comp(a, b);
+    }
+
+    operator const Compare&() const
+    {
+        return comp;
+    }
+
+    Compare comp;
+};
+
+#ifdef BST_STATS
+template<typename Compare>
+using StatsCompare = CountingCompare<Compare>;
+#define BST_STATS_ADD(counter, n) TreeStatsBlock::local().add(counter, n)
+#define BST_STATS_DEPTH(calls) TreeStatsDepth treeStatsDepth_(calls)
+#else
+template<typename Compare>
+using StatsCompare = Compare;
+#define BST_STATS_ADD(counter, n) ((void)0)
+#define BST_STATS_DEPTH(calls) ((void)0)
+#endif
+
+/*
+  --------------------------------------------
+  Begin implementations for the TreeStats class.
+  --------------------------------------------
+*/
+
+/**
+* Starts every counter at zero.
+*/
+inline TreeStats::TreeStats() :
+    comparisons(0), descents(0), nodesVisited(0), rotateLeft(0), rotateRight(0),
+    insertFixCalls(0), insertFixRuns(0), insertFixMaxDepth(0),
+    removeFixCalls(0), removeFixRuns(0), removeFixMaxDepth(0),
+    nodeSwaps(0), allocations(0), frees(0)
+{
+
+}
+
+/**
+* Mean number of nodes a key descent looked at, or 0 before any descent.
+*/
+inline double TreeStats::visitedPerDescent() const
+{
+    return descents == 0 ? 0 : static_cast<double>(nodesVisited) / descents;
+}
+
+/**
+* Folds one block's counters into the snapshot: sums, except for the
+* maximum depths.
+*/
+inline void TreeStats::add(const std::uint64_t* counters)
+{
+    std::uint64_t* fields[StatCount] = {
+        &comparisons, &descents, &nodesVisited, &rotateLeft, &rotateRight,
+        &insertFixCalls, &insertFixRuns, &insertFixMaxDepth,
+        &removeFixCalls, &removeFixRuns, &removeFixMaxDepth,
+        &nodeSwaps, &allocations, &frees
+    };
+    for (int i = 0; i < StatCount; i++)
+    {
+        if (i == StatInsertFixMaxDepth || i == StatRemoveFixMaxDepth)
+        {
+            *fields[i] = counters[i] > *fields[i] ? counters[i] : *fields[i];
+        }
+        else
+        {
+            *fields[i] += counters[i];
+        }
+    }
+}
+
+/**
+* The counters of every thread so far, summed.
+*/
+inline TreeStats TreeStats::snapshot()
+{
+    std::lock_guard<std::mutex> guard(TreeStatsBlock::registryLock());
+    TreeStats stats = TreeStatsBlock::retired();
+    std::vector<TreeStatsBlock*>& blocks = TreeStatsBlock::registry();
+    for (std::size_t i = 0; i < blocks.size(); i++)
+    {
+        std::uint64_t counters[StatCount];
+        blocks[i] -> load(counters);
+        stats.add(counters);
+    }
+    return stats;
+}
+
+/**
+* Zeroes the counters of every thread.
+*/
+inline void TreeStats::reset()
+{
+    std::lock_guard<std::mutex> guard(TreeStatsBlock::registryLock());
+    TreeStatsBlock::retired() = TreeStats();
+    std::vector<TreeStatsBlock*>& blocks = TreeStatsBlock::registry();
+    for (std::size_t i = 0; i < blocks.size(); i++)
+    {
+        blocks[i] -> clear();
+    }
+}
+
+/*
+  ------------------------------------------
+  End implementations for the TreeStats class.
+  ------------------------------------------
+*/
+
+/*
+  --------------------------------------------
+  Begin implementations for the TreeStatsBlock class.
+  --------------------------------------------
+*/
+
+/**
+* Starts at zero and registers the block so snapshots can find it.
+*/
+inline TreeStatsBlock::TreeStatsBlock()
+{
+    for (int i = 0; i < StatCount; i++)
+    {
+        counters_[i].store(0, std::memory_order_relaxed);
+        depth[i] = 0;
+    }
+    std::lock_guard<std::mutex> guard(registryLock());
+    registry().push_back(this);
+}
+
+/**
+* On thread exit, leaves the counts behind in the retired totals.
+*/
+inline TreeStatsBlock::~TreeStatsBlock()
+{
+    std::lock_guard<std::mutex> guard(registryLock());
+    std::uint64_t counters[StatCount];
+    load(counters);
+    retired().add(counters);
+    std::vector<TreeStatsBlock*>& blocks = registry();
+    for (std::size_t i = 0; i < blocks.size(); i++)
+    {
+        if (blocks[i] == this)
+        {
+            blocks[i] = blocks.back();
+            blocks.pop_back();
+            break;
+        }
+    }
+}
+
+/**
+* The calling thread's block.
+*/
+inline TreeStatsBlock& TreeStatsBlock::local()
+{
+    static thread_local TreeStatsBlock block;
+    return block;
+}
+
+/**
+* Adds n to a counter. Only the owning thread writes, so a relaxed load
+* and store are enough and cost no more than a plain increment.
+*/
+inline void TreeStatsBlock::add(TreeStatsCounter counter, std::uint64_t n)
+{
+    std::atomic<std::uint64_t>& slot = counters_[counter];
+    slot.store(slot.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/**
+* Raises a maximum-style counter to value if it is below it.
+*/
+inline void TreeStatsBlock::raise(TreeStatsCounter counter, std::uint64_t value)
+{
+    std::atomic<std::uint64_t>& slot = counters_[counter];
+    if (slot.load(std::memory_order_relaxed) < value)
+    {
+        slot.store(value, std::memory_order_relaxed);
+    }
+}
+
+/**
+* Copies the counters out.
+*/
+inline void TreeStatsBlock::load(std::uint64_t* counters) const
+{
+    for (int i = 0; i < StatCount; i++)
+    {
+        counters[i] = counters_[i].load(std::memory_order_relaxed);
+    }
+}
+
+/**
+* Zeroes the counters.
+*/
+inline void TreeStatsBlock::clear()
+{
+    for (int i = 0; i < StatCount; i++)
+    {
+        counters_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+* Guards the registry and the retired totals.
+*/
+inline std::mutex& TreeStatsBlock::registryLock()
+{
+    static std::mutex lock;
+    return lock;
+}
+
+/**
+* The blocks of all live threads that have counted anything.
+*/
+inline std::vector<TreeStatsBlock*>& TreeStatsBlock::registry()
+{
+    static std::vector<TreeStatsBlock*> blocks;
+    return blocks;
+}
+
+/**
+* Counts left behind by threads that have exited.
+*/
+inline TreeStats& TreeStatsBlock::retired()
+{
+    static TreeStats totals;
+    return totals;
+}
+
+/*
+  ------------------------------------------
+  End implementations for the TreeStatsBlock class.
+  ------------------------------------------
+*/
+
+/*
+  --------------------------------------------
+  Begin implementations for the TreeStatsDepth class.
+  --------------------------------------------
+*/
+
+/**
+* Enters one level of the fix-up: counts the call, a new run when this is
+* the outermost level, and the depth reached.
+*/
+inline TreeStatsDepth::TreeStatsDepth(TreeStatsCounter calls) :
+    calls_(calls)
+{
+    TreeStatsBlock& block = TreeStatsBlock::local();
+    unsigned depth = ++block.depth[calls];
+    block.add(calls, 1);
+    if (depth == 1)
+    {
+        block.add(static_cast<TreeStatsCounter>(calls + 1), 1);
+    }
+    block.raise(static_cast<TreeStatsCounter>(calls + 2), depth);
+}
+
+/**
+* Leaves the level.
+*/
+inline TreeStatsDepth::~TreeStatsDepth()
+{
+    --TreeStatsBlock::local().depth[calls_];
+}
+
+/*
+  ------------------------------------------
+  End implementations for the TreeStatsDepth class.
+  ------------------------------------------
+*/
+
+#endif